@@ -0,0 +1,51 @@
+/*
+@file
+@brief bounded lock-free queue of NLU answers, one producer and one
+	consumer, the thread that hands them to TTS. The producer copies the
+	answer into a slot and publishes it with a release store of tail;
+	head and tail sit on their own cache lines. A full queue drops the
+	new answer. Records how deep the queue was at each push and how long
+	each answer waited in it.
+	C++ only, the indexes use std::atomic.
+*/
+
+#ifndef __ANSWER_QUEUE_H__
+#define __ANSWER_QUEUE_H__
+
+#include <atomic>
+#include "latency_stats.h"
+
+#define AQ_SIZE		8	/* power of two */
+#define AQ_TEXT_LEN	4096
+
+struct aq_item {
+	unsigned int id;
+	double t_ms;		/* lat_now_ms() at push */
+	char text[AQ_TEXT_LEN];
+};
+
+struct answer_queue {
+	struct aq_item items[AQ_SIZE];
+	alignas(64) std::atomic<unsigned int> head;	/* next to pop, consumer */
+	alignas(64) std::atomic<unsigned int> tail;	/* next to push, producer */
+
+	/* producer */
+	std::atomic<unsigned int> pushed;
+	std::atomic<unsigned int> dropped;		/* queue full */
+	std::atomic<unsigned int> max_depth;
+	std::atomic<unsigned long> depth_sum;
+	/* consumer */
+	struct latency_stats wait;			/* push -> pop */
+	const char *name;
+};
+
+void aq_init(struct answer_queue *q, const char *name);
+/* producer: returns 0, -1 if the queue is full (text longer than a slot
+ * is cut) */
+int aq_push(struct answer_queue *q, unsigned int id, const char *text);
+/* consumer: returns 1 and the oldest answer, 0 if empty */
+int aq_pop(struct answer_queue *q, struct aq_item *out);
+/* consumer */
+void aq_report(struct answer_queue *q);
+
+#endif /* __ANSWER_QUEUE_H__ */
@@ -0,0 +1,38 @@
+/*
+@file
+@brief closed command grammar for the cloud asr engine (sub = asr). The
+	ABNF is generated from the command table and the object names, built
+	once with QISRBuildGrammar and its id cached on disk together with
+	the content hash, so it is rebuilt only when the content changes.
+*/
+
+#ifndef __ASR_GRAMMAR_H__
+#define __ASR_GRAMMAR_H__
+
+#include <stddef.h>
+
+#define GRAMMAR_ID_LEN		128
+#define GRAMMAR_MAX_LEN		16384
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* "机器人" + one command, or "机器人寻找" + one object name.
+ * returns the length written, -1 if out is too small */
+int grammar_write_abnf(char *out, size_t size,
+		const char *const *commands, int ncommands,
+		const char *const *objects, int nobjects);
+
+/* grammar id for abnf: from cache_path if the content hash matches,
+ * otherwise built in the cloud (MSPLogin must be done) and cached.
+ * returns 0 on success. a build that timed out may still be answered
+ * later; until it is, no other build starts and -1 is returned */
+int grammar_load_or_build(const char *abnf, const char *cache_path,
+		char *grammar_id, size_t id_size);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __ASR_GRAMMAR_H__ */
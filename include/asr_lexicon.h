@@ -0,0 +1,41 @@
+/*
+@file
+@brief hotword lexicon for dictation: the union of the command phrases and
+	the object names, uploaded as iat user words. The content hash of the
+	last successful upload is kept on disk, so the upload only happens
+	again after the vocabulary changed (new command, new object reported
+	by the detector at runtime).
+*/
+
+#ifndef __ASR_LEXICON_H__
+#define __ASR_LEXICON_H__
+
+#define LEXICON_MAX_WORDS	512
+#define LEXICON_WORD_LEN	64
+
+struct asr_lexicon {
+	char words[LEXICON_MAX_WORDS][LEXICON_WORD_LEN];
+	int count;
+	unsigned long long uploaded_hash;	/* 0 if never uploaded */
+	char hash_path[256];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* hash_path keeps the hash of the last upload across restarts, may be NULL */
+void lexicon_init(struct asr_lexicon *lex, const char *hash_path);
+/* returns 1 if the word is new, 0 if known, -1 if full or too long */
+int lexicon_add(struct asr_lexicon *lex, const char *word);
+unsigned long long lexicon_hash(const struct asr_lexicon *lex);
+int lexicon_dirty(const struct asr_lexicon *lex);
+/* upload if the content changed since the last upload. MSPLogin must be
+ * done. returns 0 if the cloud copy is current */
+int lexicon_sync(struct asr_lexicon *lex);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __ASR_LEXICON_H__ */
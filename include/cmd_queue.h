@@ -0,0 +1,84 @@
+/*
+@file
+@brief bounded lock-free queue of manual command codes (/voice/control),
+	any number of producers and one consumer, the dispatcher. Built like
+	event_queue.h, plus coalescing rules per code range applied when the
+	consumer drains it:
+	  keep    every code runs, in order
+	  latest  a run of codes of the same rule collapses to the last one,
+	          e.g. turn, turn, forward -> forward
+	  never   like keep, and a full queue still takes one of them in a
+	          spare slot, so a stop is never lost to a burst of moves
+	  cancel  like never, and the latest codes drained before it are
+	          dropped: a stop voids the moves queued ahead of it
+	Codes without a rule are kept. Each code carries the mark its
+	producer pushed it with, e.g. that it was acted upon already. The producer that finds the queue idle
+	is told to wake the consumer, one wake-up per drain.
+	C++ only, the slots use std::atomic.
+*/
+
+#ifndef __CMD_QUEUE_H__
+#define __CMD_QUEUE_H__
+
+#include <atomic>
+#include "latency_stats.h"
+
+#define CMDQ_SIZE	32	/* power of two */
+#define CMDQ_MAX_RULES	16
+#define CMDQ_DRAIN_MAX	(CMDQ_SIZE + 1)	/* ring + spare slot */
+
+enum {
+	CMDQ_KEEP,
+	CMDQ_LATEST,
+	CMDQ_NEVER_DROP,
+	CMDQ_CANCEL,
+};
+
+struct cmdq_rule {
+	int lo, hi;
+	int policy;
+};
+
+struct cmdq_entry {
+	int code;
+	int mark;		/* the producer's, handed back as is */
+	double t_ms;		/* lat_now_ms() at push */
+};
+
+struct cmdq_cell {
+	std::atomic<unsigned int> seq;
+	struct cmdq_entry e;
+};
+
+struct cmd_queue {
+	struct cmdq_cell cells[CMDQ_SIZE];
+	std::atomic<unsigned int> head;
+	unsigned int tail;			/* consumer only */
+	std::atomic<int> spare;			/* never-drop code of a full queue, -1 none */
+	int spare_mark;
+	double spare_ms;
+	std::atomic<bool> wake;			/* the consumer has been told */
+
+	struct cmdq_rule rules[CMDQ_MAX_RULES];	/* set before the producers start */
+	int nrules;
+
+	std::atomic<unsigned int> pushed;
+	std::atomic<unsigned int> dropped;	/* queue full */
+	unsigned int coalesced;			/* consumer only */
+	unsigned int cancelled;			/* consumer only */
+	struct latency_stats lat;		/* push -> drained, consumer only */
+};
+
+void cmdq_init(struct cmd_queue *q);
+/* "lo[-hi]:keep|latest|never|cancel,..." replaces the rules, returns their
+ * number or -1 on a bad spec (rules left as they were) */
+int cmdq_set_rules(struct cmd_queue *q, const char *spec);
+/* returns 1 if the caller has to wake the consumer, 0 if it is awake,
+ * -1 if the code was dropped */
+int cmdq_push(struct cmd_queue *q, int code, int mark);
+/* consumer: take what is queued, coalesced, oldest first. max should be
+ * CMDQ_DRAIN_MAX, with less call again until it returns 0 */
+int cmdq_drain(struct cmd_queue *q, struct cmdq_entry *out, int max);
+void cmdq_report(struct cmd_queue *q);
+
+#endif /* __CMD_QUEUE_H__ */
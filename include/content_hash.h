@@ -0,0 +1,26 @@
+/*
+@file
+@brief 64 bit FNV-1a, used to tell whether generated content (grammar,
+	lexicon, ...) changed since it was last uploaded
+*/
+
+#ifndef __CONTENT_HASH_H__
+#define __CONTENT_HASH_H__
+
+#include <stddef.h>
+
+#define FNV1A64_INIT	0xcbf29ce484222325ULL
+
+static inline unsigned long long fnv1a64(const void *data, size_t len, unsigned long long h)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+#endif /* __CONTENT_HASH_H__ */
@@ -0,0 +1,81 @@
+/*
+@file
+@brief adaptive end of speech detection. The trailing silence that ends an
+	utterance depends on the dialog context (short commands, open
+	questions, the answer to "请再说一遍") and on the speaker: the pauses
+	seen inside earlier utterances are kept in a histogram per user and
+	the timeout is set just above their p95. The same energy detector
+	decides locally when speech is over, so the recognizer can send the
+	last sample without waiting for the cloud VAD.
+*/
+
+#ifndef __ENDPOINTER_H__
+#define __ENDPOINTER_H__
+
+#include <stddef.h>
+
+enum ep_context {
+	EP_COMMAND,		/* "机器人 + command" */
+	EP_QUESTION,		/* open question for tuling */
+	EP_RETRY,		/* after "请再说一遍", people hesitate more */
+	EP_CONTEXTS
+};
+
+/* ep_feed return codes */
+#define EP_WAITING		0	/* no speech yet */
+#define EP_SPEAKING		1
+#define EP_END			2	/* trailing silence reached the timeout */
+
+#define EP_HIST_BIN_MS		50
+#define EP_HIST_BINS		40	/* pauses up to 2s */
+#define EP_MAX_PAUSES		32	/* per utterance */
+
+struct endpointer {
+	unsigned int sample_rate;
+	int context;
+	unsigned int eos_ms;		/* timeout of the running utterance */
+
+	/* energy detector, 10ms frames */
+	short frame[320];
+	unsigned int fill;
+	unsigned int hop;
+	float noise_db;
+	unsigned int voiced_ms;
+	unsigned int silence_ms;	/* since the last voiced frame */
+	double last_voiced_ms;		/* lat_now_ms() */
+	int ended;
+
+	/* pauses of the running utterance, learned at ep_end() */
+	unsigned int pauses[EP_MAX_PAUSES];
+	int npauses;
+
+	/* per user */
+	unsigned int hist[EP_HIST_BINS];
+	unsigned int hist_total;
+	char profile_path[256];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* profile_path keeps the pause histogram of one user, may be NULL */
+void ep_init(struct endpointer *ep, unsigned int sample_rate, const char *profile_path);
+/* timeout for a context given what was learned so far */
+unsigned int ep_eos_ms(const struct endpointer *ep, int context);
+/* start of an utterance, returns its timeout */
+unsigned int ep_begin(struct endpointer *ep, int context);
+/* the context may become clear while speaking (partial results) */
+void ep_set_context(struct endpointer *ep, int context);
+/* raw 16 bit pcm as delivered by the recorder */
+int ep_feed(struct endpointer *ep, const char *data, unsigned long len);
+/* lat_now_ms() of the last voiced frame, 0 if nothing was voiced */
+double ep_speech_end_ms(const struct endpointer *ep);
+/* end of the utterance: learn its pauses and save the profile */
+void ep_end(struct endpointer *ep);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __ENDPOINTER_H__ */
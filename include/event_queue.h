@@ -0,0 +1,51 @@
+/*
+@file
+@brief bounded lock-free event queue, any number of producers (ROS
+	callbacks, the listening thread, the recognizer) and one consumer,
+	the dispatcher. Pushing never blocks or allocates: a slot is claimed
+	with one compare-and-swap and published with its sequence number.
+	The consumer sleeps on a semaphore, posted once per event.
+	C++ only, the slots use std::atomic.
+*/
+
+#ifndef __EVENT_QUEUE_H__
+#define __EVENT_QUEUE_H__
+
+#include <atomic>
+#include <semaphore.h>
+
+#define EVQ_SIZE	64	/* power of two */
+#define EVQ_TEXT_LEN	128
+
+struct evq_event {
+	int type;
+	int value;
+	double t_ms;		/* lat_now_ms() at push */
+	char text[EVQ_TEXT_LEN];	/* "" if none, truncated */
+	void *data;		/* NULL if none, the consumer's from the pop on */
+};
+
+struct evq_cell {
+	std::atomic<unsigned int> seq;
+	struct evq_event ev;
+};
+
+struct event_queue {
+	struct evq_cell cells[EVQ_SIZE];
+	std::atomic<unsigned int> head;		/* next slot to claim */
+	unsigned int tail;			/* next slot to pop, consumer only */
+	std::atomic<unsigned int> dropped;	/* pushes refused, queue full */
+	sem_t ready;
+};
+
+int evq_init(struct event_queue *q);
+void evq_destroy(struct event_queue *q);
+/* text may be NULL. returns -1 if the queue is full */
+int evq_push(struct event_queue *q, int type, int value, const char *text);
+/* as evq_push, with a payload too big for the text. what it points to is
+ * handed over, the producer leaves it alone from here on */
+int evq_push_data(struct event_queue *q, int type, int value, void *data);
+/* consumer: wait up to timeout_ms, returns 1 with an event, 0 on timeout */
+int evq_pop(struct event_queue *q, struct evq_event *ev, int timeout_ms);
+
+#endif /* __EVENT_QUEUE_H__ */
@@ -0,0 +1,102 @@
+/*
+@file
+@brief long lived HTTP client of the NLU node. One curl multi handle runs
+	on its own thread with a few easy handles kept for reuse, so the
+	connection cache (keep-alive) and DNS cache carry over from one
+	question to the next and several requests can be out at once; the
+	connection is opened at start up. Each request has an id, a request
+	submitted with supersede cancels all that are older. The answer is
+	handed to the done callback, on the client thread, as soon as it is
+	complete. Every request records where its time went.
+*/
+
+#ifndef __HTTP_CLIENT_H__
+#define __HTTP_CLIENT_H__
+
+#include <string>
+#include <pthread.h>
+#include <curl/curl.h>
+#include "latency_stats.h"
+
+#define HTTP_URL_LEN		256
+#define HTTP_MAX_INFLIGHT	4
+#define HTTP_MAX_PENDING	8
+
+/* ms from the start of the request, as curl_easy_getinfo reports them */
+struct http_timing {
+	double dns_ms;
+	double connect_ms;
+	double ttfb_ms;		/* first byte of the answer */
+	double total_ms;
+	double queued_ms;	/* submitted -> started */
+	long status;		/* HTTP status, 0 if none */
+	bool reused;		/* no new connection was opened */
+};
+
+/* err: 0, or a CURLcode. body is only valid during the call */
+typedef void (*http_done_fn)(unsigned int id, int err, const std::string &body,
+		const struct http_timing *t, void *user);
+
+struct http_request {
+	unsigned int id;	/* 0: slot free */
+	bool head;		/* the preconnect */
+	CURL *curl;
+	std::string body;
+	std::string out;
+	double submit_ms;
+	double start_ms;
+};
+
+struct http_pending {
+	unsigned int id;
+	bool head;
+	std::string body;
+	double submit_ms;
+};
+
+struct http_client {
+	CURLM *multi;
+	struct curl_slist *headers;
+	char url[HTTP_URL_LEN];
+	http_done_fn done;
+	void *user;
+
+	pthread_t thread;
+	pthread_mutex_t lock;		/* the fields up to the stats */
+	int wake[2];			/* pipe, wakes the client thread */
+	bool quit;
+	unsigned int next_id;
+	unsigned int cancel_below;	/* ids under it are cancelled */
+	struct http_pending pending[HTTP_MAX_PENDING];
+	int npending;
+
+	/* client thread only */
+	struct http_request reqs[HTTP_MAX_INFLIGHT];
+	unsigned long requests;
+	unsigned long failures;
+	unsigned long cancelled;
+	unsigned long reused;
+	struct latency_stats lat_queued;
+	struct latency_stats lat_dns;
+	struct latency_stats lat_connect;
+	struct latency_stats lat_ttfb;
+	struct latency_stats lat_total;
+};
+
+/* curl_global_init must have been called. starts the client thread,
+ * returns 0 on success */
+int http_init(struct http_client *c, const char *url, long connect_timeout_ms,
+		long total_timeout_ms, long dns_cache_s, http_done_fn done, void *user);
+void http_cleanup(struct http_client *c);
+/* open the connection now, with a HEAD request */
+int http_preconnect(struct http_client *c);
+/* POST body as JSON. returns the id of the request, 0 if too many are
+ * waiting. supersede cancels every older request */
+unsigned int http_submit(struct http_client *c, const char *body, size_t len, bool supersede);
+/* an id newer than every request, which are all cancelled: the question
+ * was answered without asking */
+unsigned int http_supersede(struct http_client *c);
+/* call on the client thread (in done) */
+void http_report(const struct http_client *c);
+
+#endif /* __HTTP_CLIENT_H__ */
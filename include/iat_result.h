@@ -0,0 +1,86 @@
+/*
+@file
+@brief iat json results (result_type = json) and the running hypothesis
+	of a session with dynamic correction (dwa = wpgs). Each fragment
+	carries a sentence number sn; with pgs = "rpl" it replaces sentences
+	rg[0]..rg[1], otherwise it is appended.
+	With wbest each word position carries up to IAT_MAX_ALTS candidates
+	with a score (cw[].sc, 0..100); iat_fragment_nbest() turns them into
+	the best few sentences.
+*/
+
+#ifndef __IAT_RESULT_H__
+#define __IAT_RESULT_H__
+
+#include <stddef.h>
+#include "json_scan.h"
+
+#define IAT_MAX_SENTENCES	64
+#define IAT_SENTENCE_LEN	256
+#define IAT_TEXT_LEN		1024
+#define IAT_MAX_WORDS		64
+#define IAT_MAX_ALTS		3	/* keep in line with wbest of the session */
+#define IAT_NBEST		4
+
+/* candidates of one word position. the spans point into the result
+ * buffer given to iat_parse_fragment, valid as long as that buffer is */
+struct iat_word {
+	int nalt;
+	int sc[IAT_MAX_ALTS];		/* 0 if not scored (punctuation) */
+	struct json_span w[IAT_MAX_ALTS];
+};
+
+struct iat_fragment {
+	int sn;
+	int ls;			/* last fragment of the session */
+	int replace;		/* pgs = rpl */
+	int rg[2];
+	int sc;			/* sentence score of asr (grammar) results, -1 if absent */
+	char text[IAT_SENTENCE_LEN];	/* best word of each position */
+	int nwords;
+	struct iat_word words[IAT_MAX_WORDS];
+};
+
+struct iat_candidate {
+	int score;		/* 0..100, -1 if the engine gave no scores */
+	char text[IAT_TEXT_LEN];
+};
+
+/* best first */
+struct iat_nbest {
+	int count;
+	struct iat_candidate cand[IAT_NBEST];
+};
+
+struct iat_hypothesis {
+	int max_sn;
+	char sent[IAT_MAX_SENTENCES][IAT_SENTENCE_LEN];
+	char text[IAT_TEXT_LEN];
+	size_t text_len;
+	unsigned int updates;	/* fragments applied since reset */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int iat_parse_fragment(const char *json, size_t len, struct iat_fragment *frag);
+
+void iat_hyp_reset(struct iat_hypothesis *h);
+/* apply one fragment and rebuild h->text */
+int iat_hyp_apply(struct iat_hypothesis *h, const struct iat_fragment *frag);
+
+/* sentence candidates of one fragment: the best path, then the best path
+ * with one word swapped for its runner-up, ordered by score */
+int iat_fragment_nbest(const struct iat_fragment *frag, struct iat_nbest *nb);
+/* utterance candidates after frag was applied to h: the hypothesis with
+ * sentence frag->sn taken from each fragment candidate. utt holds the
+ * previous utterance candidates, its best score caps the new ones */
+int iat_hyp_nbest(const struct iat_hypothesis *h, const struct iat_fragment *frag,
+		const struct iat_nbest *fnb, struct iat_nbest *utt);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __IAT_RESULT_H__ */
@@ -0,0 +1,66 @@
+/*
+@file
+@brief local intent router for what no command matched: a linear model
+	over hashed character unigrams and bigrams of the normalized text
+	(text_norm.h), softmax over four routes. The weights come from a
+	model file written by intent_tool, nothing is allocated after load.
+
+	model file, one entry per line:
+	  intent_model <buckets>
+	  bias <class> <weight>
+	  w <class> <bucket> <weight>
+*/
+
+#ifndef __INTENT_MODEL_H__
+#define __INTENT_MODEL_H__
+
+#include <stddef.h>
+
+#define IM_BUCKETS_MAX	8192	/* power of two */
+#define IM_TEXT_LEN	512
+
+enum {
+	IM_COMMAND,		/* meant for the robot to do, retry */
+	IM_LOCAL,		/* answered on the robot: date, time, name */
+	IM_CLOUD,		/* chat, weather, jokes: tuling */
+	IM_REJECT,		/* noise, side talk */
+	IM_NCLASSES
+};
+
+struct intent_model {
+	int loaded;
+	unsigned int buckets;
+	float bias[IM_NCLASSES];
+	float w[IM_NCLASSES][IM_BUCKETS_MAX];
+};
+
+struct intent_result {
+	int intent;
+	float confidence;	/* softmax of the winner */
+	float p[IM_NCLASSES];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* an empty model of buckets features, for training */
+void im_init(struct intent_model *m, unsigned int buckets);
+/* returns 0 on success, -1 if the file is missing or malformed */
+int im_load(struct intent_model *m, const char *path);
+int im_save(const struct intent_model *m, const char *path);
+/* prefix: wake word removed before the features are taken, may be NULL */
+int im_classify(const struct intent_model *m, const char *text, size_t len,
+		const char *prefix, struct intent_result *r);
+/* one step of stochastic gradient descent on the log loss, returns the loss */
+float im_train(struct intent_model *m, const char *text, size_t len,
+		const char *prefix, int label, float rate, float l2);
+const char *im_name(int intent);
+/* IM_NCLASSES if unknown */
+int im_intent_of(const char *name);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __INTENT_MODEL_H__ */
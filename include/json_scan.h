@@ -0,0 +1,56 @@
+/*
+@file
+@brief zero-copy JSON scanner. Values are returned as spans pointing into
+	the caller's buffer, nothing is allocated and no DOM is built. Only
+	what the recognizer and NLU results need: walk objects and arrays,
+	compare keys, read numbers, booleans and strings.
+*/
+
+#ifndef __JSON_SCAN_H__
+#define __JSON_SCAN_H__
+
+#include <stddef.h>
+
+struct json_span {
+	const char *p;		/* strings include their quotes */
+	size_t len;
+};
+
+struct json_iter {
+	const char *cur;
+	const char *end;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* span of the first value in [p, p + len), p.len = 0 if malformed */
+struct json_span json_root(const char *p, size_t len);
+
+/* start walking the members of an object or the items of an array */
+int json_iter_init(struct json_iter *it, struct json_span container);
+/* key is returned without quotes. returns 1 per member, 0 at the end */
+int json_object_next(struct json_iter *it, struct json_span *key, struct json_span *val);
+int json_array_next(struct json_iter *it, struct json_span *val);
+
+/* member lookup in an object, returns 1 if found */
+int json_find(struct json_span obj, const char *key, struct json_span *val);
+/* the values of up to 32 keys in one walk over obj, which ends as soon as
+ * all are found. a missing key gets len 0. returns the number found */
+int json_pick(struct json_span obj, const char *const *keys, struct json_span *vals, int n);
+
+int json_key_is(struct json_span key, const char *s);
+int json_is_string(struct json_span v);
+int json_string_is(struct json_span v, const char *s);
+long json_to_long(struct json_span v);
+int json_is_true(struct json_span v);
+/* unescape a string value into out (NUL terminated, truncated to size).
+ * returns the length written */
+size_t json_copy_string(struct json_span v, char *out, size_t size);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __JSON_SCAN_H__ */
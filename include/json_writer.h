@@ -0,0 +1,53 @@
+/*
+@file
+@brief streaming JSON writer. Members and items are appended to a buffer
+	that grows as needed and is kept from one document to the next;
+	commas and string escaping are taken care of. Nothing is checked
+	beyond nesting depth, the caller writes a key before each value of
+	an object.
+*/
+
+#ifndef __JSON_WRITER_H__
+#define __JSON_WRITER_H__
+
+#include <stddef.h>
+
+#define JW_MAX_DEPTH	16
+
+struct json_writer {
+	char *buf;		/* NUL terminated */
+	size_t len;
+	size_t cap;
+	int depth;
+	int after_key;		/* the next value follows a key */
+	int need_comma[JW_MAX_DEPTH];
+	int err;		/* out of memory or nesting, the document is void */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void jw_init(struct json_writer *w);
+void jw_free(struct json_writer *w);
+/* start the next document, the buffer is kept */
+void jw_reset(struct json_writer *w);
+
+void jw_begin_object(struct json_writer *w);
+void jw_end_object(struct json_writer *w);
+void jw_begin_array(struct json_writer *w);
+void jw_end_array(struct json_writer *w);
+void jw_key(struct json_writer *w, const char *key);
+void jw_string(struct json_writer *w, const char *s, size_t len);
+void jw_long(struct json_writer *w, long v);
+void jw_bool(struct json_writer *w, int v);
+
+/* key and value in one go */
+void jw_member_string(struct json_writer *w, const char *key, const char *s);
+void jw_member_long(struct json_writer *w, const char *key, long v);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __JSON_WRITER_H__ */
@@ -0,0 +1,40 @@
+/*
+@file
+@brief small latency recorder: keeps the last samples of one measurement
+	point and reports count/mean/p50/p95/max in milliseconds
+*/
+
+#ifndef __LATENCY_STATS_H__
+#define __LATENCY_STATS_H__
+
+#define LAT_MAX_SAMPLES		256
+
+struct latency_stats {
+	const char *name;
+	unsigned long count;		/* samples seen since init */
+	unsigned int next;		/* ring write position */
+	double sum;
+	double max;
+	double samples[LAT_MAX_SAMPLES];	/* ms, last LAT_MAX_SAMPLES only */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* monotonic clock in ms, for measuring intervals only */
+double lat_now_ms(void);
+
+void lat_init(struct latency_stats *st, const char *name);
+void lat_add(struct latency_stats *st, double ms);
+/* p in [0, 100], over the samples still kept in the ring */
+double lat_percentile(const struct latency_stats *st, double p);
+double lat_mean(const struct latency_stats *st);
+/* one printf line: name n= last= mean= p50= p95= max= */
+void lat_report(const struct latency_stats *st);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __LATENCY_STATS_H__ */
@@ -0,0 +1,69 @@
+/*
+@file
+@brief offline small-vocabulary command spotter. Each command of
+	/etc/commands.txt is compiled into one or more MFCC templates recorded
+	by the user (<dir>/<code>.wav, <dir>/<code>_1.wav ... <code>_9.wav,
+	16 bit mono). Audio is fed in parallel to the cloud session; when the
+	local endpointer sees the end of speech, the utterance is matched to
+	all templates with subsequence DTW, so leading words do not hurt.
+	A match is acted on at once: record the takes with the "机器人"
+	prefix, a bare command word would fire inside any sentence.
+*/
+
+#ifndef __LOCAL_KWS_H__
+#define __LOCAL_KWS_H__
+
+#include <stddef.h>
+
+#define KWS_MAX_TEMPLATES	128
+#define KWS_MAX_FRAMES		600	/* 6s of 10ms frames per utterance */
+#define KWS_NUM_CEPS		13
+
+/* kws_feed return codes */
+#define KWS_LISTENING		0	/* no decision yet */
+#define KWS_FIRED		1	/* confident match, see kws_get_result */
+#define KWS_REJECTED		2	/* speech ended, no confident match */
+
+struct kws_config {
+	unsigned int sample_rate;	/* 16000 */
+	unsigned int trailing_ms;	/* silence that ends an utterance locally */
+	float max_cost;			/* reject a best match costing more than this */
+	float min_confidence;		/* (second - best) / second, in [0, 1] */
+};
+
+struct kws_result {
+	int code;
+	float cost;
+	float confidence;
+	double speech_end_ms;		/* lat_now_ms() of the last voiced frame */
+};
+
+struct kws_engine;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void kws_default_config(struct kws_config *cfg);
+int kws_create(struct kws_engine **out, const struct kws_config *cfg);
+void kws_destroy(struct kws_engine *eng);
+
+/* add one template from 16 bit pcm. returns 0 on success */
+int kws_add_template(struct kws_engine *eng, int code, const short *pcm, size_t samples);
+/* load every <dir>/<code>[_n].wav found for code. returns templates loaded */
+int kws_load_templates(struct kws_engine *eng, const char *dir, int code);
+int kws_template_count(const struct kws_engine *eng);
+
+/* start of a new utterance */
+void kws_reset(struct kws_engine *eng);
+/* feed raw 16 bit pcm as delivered by the recorder */
+int kws_feed(struct kws_engine *eng, const char *data, unsigned long len);
+int kws_get_result(const struct kws_engine *eng, struct kws_result *res);
+/* lat_now_ms() of the last voiced frame, 0 if speech has not ended */
+double kws_speech_end_ms(const struct kws_engine *eng);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __LOCAL_KWS_H__ */
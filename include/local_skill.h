@@ -0,0 +1,57 @@
+/*
+@file
+@brief questions the robot answers itself, without a cloud round trip.
+	Each skill is a handler with the keywords that trigger it, tried in
+	registration order on the normalized text (text_norm.h); the first
+	that answers wins. Built in: weekday, date, time and the robot's
+	name, from the system clock and the configuration.
+	Every skill keeps its own hit count and latency.
+*/
+
+#ifndef __LOCAL_SKILL_H__
+#define __LOCAL_SKILL_H__
+
+#include <stddef.h>
+#include "latency_stats.h"
+
+#define SKILL_MAX	16
+#define SKILL_KEYS	8
+#define SKILL_NAME_LEN	32
+
+/* write the answer to text, returns its length, 0 to pass */
+typedef size_t (*skill_fn)(const char *text, char *answer, size_t size, void *user);
+
+struct skill {
+	char name[SKILL_NAME_LEN];
+	const char *keys[SKILL_KEYS];	/* NULL terminated, any of them */
+	skill_fn fn;
+	void *user;
+	unsigned int hits;
+	struct latency_stats lat;	/* text in -> answer out */
+};
+
+struct skill_registry {
+	int count;
+	struct skill skills[SKILL_MAX];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void skill_init(struct skill_registry *reg);
+/* keys: NULL terminated, kept by reference. returns the index or -1 */
+int skill_register(struct skill_registry *reg, const char *name,
+		const char *const *keys, skill_fn fn, void *user);
+/* weekday, date, time, and name answering with robot_name */
+void skill_register_builtin(struct skill_registry *reg, const char *robot_name);
+/* returns the index of the skill that answered, -1 if none did */
+int skill_answer(struct skill_registry *reg, const char *text, size_t len,
+		char *answer, size_t size);
+void skill_report(const struct skill_registry *reg);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __LOCAL_SKILL_H__ */
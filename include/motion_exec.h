@@ -0,0 +1,72 @@
+/*
+@file
+@brief fixed-rate motion executor. A goal (velocity for a time, or for a
+	distance or angle) is streamed as setpoints at rate_hz from its own
+	thread, ramped up and down within the acceleration limits, because
+	the base stops on its own when setpoints stop coming. The distance
+	is integrated from the setpoints, there is no odometry.
+	motion_stop wakes the thread and sends zero at once.
+*/
+
+#ifndef __MOTION_EXEC_H__
+#define __MOTION_EXEC_H__
+
+#include <pthread.h>
+#include "latency_stats.h"
+
+/* send one setpoint, called with the executor lock held */
+typedef void (*motion_send_cb)(double vx, double wz, void *user);
+
+struct motion_goal {
+	double vx;		/* m/s */
+	double wz;		/* rad/s */
+	double duration_ms;	/* used if distance is 0 */
+	double distance;	/* m if vx != 0, else rad, 0: by duration */
+};
+
+struct motion_exec {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;		/* CLOCK_MONOTONIC */
+	int rate_hz;
+	double acc_lin;			/* m/s^2 */
+	double acc_ang;			/* rad/s^2 */
+	motion_send_cb send;
+	void *user;
+
+	int quit;
+	int active;
+	struct motion_goal goal;
+	double start_ms;
+	double travelled;		/* m or rad along the goal */
+	double vx, wz;			/* last setpoint */
+
+	unsigned long ticks;
+	unsigned long overruns;		/* ticks later than one period */
+	unsigned int goals;
+	unsigned int preempted;		/* goals ended by stop or a new goal */
+	struct latency_stats jitter;	/* tick time - deadline */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* starts the thread. returns 0 on success */
+int motion_init(struct motion_exec *m, int rate_hz, double acc_lin, double acc_ang,
+		motion_send_cb send, void *user);
+void motion_destroy(struct motion_exec *m);
+/* replace the running goal, ramping from the current setpoint. with
+ * vx = wz = 0 it ramps to rest and ends, whatever the distance */
+void motion_start(struct motion_exec *m, const struct motion_goal *goal);
+/* end the goal with a zero setpoint now, no ramp */
+void motion_stop(struct motion_exec *m);
+int motion_active(struct motion_exec *m);
+/* ticks, overruns, goals, jitter */
+void motion_report(struct motion_exec *m);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __MOTION_EXEC_H__ */
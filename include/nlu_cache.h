@@ -0,0 +1,92 @@
+/*
+@file
+@brief answers of the cloud NLU for questions asked before, keyed by the
+	normalized question. How long an answer stays depends on what was
+	asked: time and weather are never kept, who the robot is for long,
+	jokes only for a short while so they do not repeat. The cache has a
+	fixed number of slots, the least recently used goes when it is
+	full. It lives in a file mapped with mmap, so it survives restarts;
+	without a file it is kept in memory only. Not thread safe, the caller
+	serializes.
+*/
+
+#ifndef __NLU_CACHE_H__
+#define __NLU_CACHE_H__
+
+#include <stddef.h>
+#include "latency_stats.h"
+
+#define NC_KEY_LEN		128
+#define NC_ANSWER_LEN		1024
+#define NC_DEFAULT_SLOTS	512
+
+enum nc_kind {
+	NC_LIVE,		/* time, weather, news: never cached */
+	NC_IDENTITY,		/* name, age, who made it */
+	NC_JOKE,		/* jokes, stories, riddles */
+	NC_OTHER,
+	NC_KINDS
+};
+
+/* one slot of the file. hash 0: free */
+struct nc_entry {
+	unsigned long long hash;
+	long long expires;		/* time(NULL) */
+	unsigned long long used;	/* lru tick */
+	float fetch_ms;			/* what asking the cloud cost */
+	int kind;
+	char key[NC_KEY_LEN];
+	char answer[NC_ANSWER_LEN];
+};
+
+/* start of the file, followed by nslots entries */
+struct nc_header {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int entry_size;
+	unsigned int nslots;
+	unsigned long long tick;
+};
+
+struct nlu_cache {
+	struct nc_header *hdr;
+	struct nc_entry *slots;
+	size_t map_len;
+	int fd;				/* -1: memory only */
+	long ttl_s[NC_KINDS];
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long live;		/* questions that are never cached */
+	unsigned long stores;
+	unsigned long evictions;
+	struct latency_stats lookup;
+	struct latency_stats saved;	/* cloud time saved per hit */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* path NULL or "": memory only. a file of another layout is cleared.
+ * returns 0, -1 if no memory could be mapped */
+int nc_init(struct nlu_cache *c, const char *path, int nslots,
+		long ttl_identity_s, long ttl_joke_s, long ttl_other_s);
+void nc_close(struct nlu_cache *c);
+
+/* key of a question, "" if it is too long to be cached */
+size_t nc_key(const char *question, char *key, size_t size);
+int nc_kind_of(const char *key);
+
+/* returns 1 and the answer on a hit */
+int nc_lookup(struct nlu_cache *c, const char *key, char *answer, size_t size);
+/* keep the answer to key, which took fetch_ms to get */
+void nc_store(struct nlu_cache *c, const char *key, const char *answer, double fetch_ms);
+
+/* hit rate, lookup cost and saved latency */
+void nc_report(const struct nlu_cache *c);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __NLU_CACHE_H__ */
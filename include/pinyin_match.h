@@ -0,0 +1,82 @@
+/*
+@file
+@brief fuzzy phrase matching by sound. Phrases (command phrases, "寻找"
+	+ object names) are turned into toneless pinyin syllables and kept
+	in a trie. A text is searched for the phrase it sounds most like
+	with one pass over the trie, an edit distance row per trie level
+	against the syllables of the text (free start and end, so the
+	phrase may be anywhere in it). Costs are in half syllables:
+	  same syllable                        0
+	  near (zh/z ch/c sh/s n/l, -ng/-n)    1
+	  other syllable, missing or extra     2
+	A phrase of n syllables matches at a cost of at most n / 2.
+	Characters without a pinyin only match themselves.
+	Homophones cost nothing: 寻找水备 is 寻找水杯.
+*/
+
+#ifndef __PINYIN_MATCH_H__
+#define __PINYIN_MATCH_H__
+
+#include <stddef.h>
+#include "latency_stats.h"
+
+#define PM_MAX_SYL	16	/* syllables of a phrase */
+#define PM_MAX_TEXT	64	/* syllables of a searched text */
+#define PM_PHRASE_LEN	64
+
+struct pm_node {
+	unsigned int syl;
+	int child;		/* first child, -1 none */
+	int next;		/* next sibling, -1 none */
+	int phrase;		/* phrase ending here, -1 none */
+	int max_cost;		/* allowed to the longest phrase from here on */
+};
+
+struct pm_phrase {
+	char text[PM_PHRASE_LEN];
+	int value;
+	int nsyl;
+};
+
+struct pm_index {
+	struct pm_node *nodes;		/* [0] is the root */
+	int nnodes, max_nodes;
+	struct pm_phrase *phrases;
+	int nphrases, max_phrases;
+
+	unsigned long searches;
+	unsigned long hits;
+	struct latency_stats lat;
+};
+
+struct pm_match {
+	int phrase;
+	int value;
+	const char *text;
+	int cost;		/* half syllables */
+	int score;		/* 0..100, 100 sounds the same */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* allocates for max_phrases at once, returns 0 on success */
+int pm_init(struct pm_index *idx, int max_phrases);
+void pm_destroy(struct pm_index *idx);
+/* returns the phrase id, -1 if full or it has no syllables.
+ * a phrase that sounds like one already there replaces it */
+int pm_add(struct pm_index *idx, const char *text, int value);
+/* syllables of a UTF-8 text after tn_normalize, returns their number */
+int pm_syllables(const char *text, size_t len, unsigned int *out, int max);
+/* best phrase in text, returns 1 if one is close enough */
+int pm_search(struct pm_index *idx, const char *text, size_t len, struct pm_match *m);
+/* the syllables as a string, "xun zhao shui bei" */
+size_t pm_spell(const unsigned int *syl, int n, char *out, size_t size);
+void pm_report(const struct pm_index *idx);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __PINYIN_MATCH_H__ */
@@ -0,0 +1,53 @@
+/*
+@file
+@brief recent object detections with their pose. A search for an object
+	seen less than ttl_ms ago is answered from here instead of running
+	another detection pass. Only sightings are kept: an object that was
+	not found may have come into view since.
+*/
+
+#ifndef __SIGHTING_CACHE_H__
+#define __SIGHTING_CACHE_H__
+
+#include "latency_stats.h"
+
+#define SIGHT_MAX		64
+#define SIGHT_NAME_LEN		64
+
+struct sighting {
+	char name[SIGHT_NAME_LEN];
+	float x, y, z;
+	double t_ms;		/* lat_now_ms() of the detection */
+	double search_ms;	/* what finding it cost, saved by each hit */
+};
+
+struct sighting_cache {
+	struct sighting items[SIGHT_MAX];
+	int count;
+	double ttl_ms;
+	unsigned long hits;
+	unsigned long misses;
+	struct latency_stats search;	/* detection passes */
+	struct latency_stats saved;	/* search time saved per hit */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sight_init(struct sighting_cache *c, double ttl_ms);
+/* returns 1 and the sighting if name was seen within ttl_ms */
+int sight_lookup(struct sighting_cache *c, const char *name, struct sighting *out);
+/* result of a detection pass that took search_ms. a miss forgets name */
+void sight_store(struct sighting_cache *c, const char *name, int found,
+		float x, float y, float z, double search_ms);
+/* forget every sighting: the poses are relative to the robot, which moved */
+void sight_clear(struct sighting_cache *c);
+/* hit rate, search and saved latency */
+void sight_report(const struct sighting_cache *c);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __SIGHTING_CACHE_H__ */
@@ -6,6 +6,7 @@
 @date		2016/05/27
 */
 
+#include "linuxrec.h"
 
 enum sr_audsrc
 {
@@ -23,13 +24,25 @@ enum sr_audsrc
 #define E_SR_ALREADY			5
 
 
+/* on_audio return values */
+#define SR_AUDIO_CONTINUE	0	/* keep streaming to the cloud session */
+#define SR_AUDIO_CANCEL		1	/* decided locally, drop the cloud session */
+#define SR_AUDIO_FINISH		2	/* speech is over, send the last sample now */
+
+/* every callback gets the user pointer of the notifier, so several
+ * recognizers can run in one process without sharing state */
 struct speech_rec_notifier {
-	void (*on_result)(const char *result, char is_last);
-	void (*on_speech_begin)();
-	void (*on_speech_end)(int reason);	/* 0 if VAD.  others, error : see E_SR_xxx and msp_errors.h  */
+	void (*on_result)(void *user, const char *result, char is_last);
+	void (*on_speech_begin)(void *user);
+	void (*on_speech_end)(void *user, int reason);	/* 0 if VAD.  others, error : see E_SR_xxx and msp_errors.h  */
+	/* optional, sees every captured buffer before it is sent to the cloud */
+	int (*on_audio)(void *user, const char *data, unsigned long len);
+	void *user;
 };
 
 #define END_REASON_VAD_DETECT	0	/* detected speech done  */
+#define END_REASON_CANCELED	1	/* on_audio returned SR_AUDIO_CANCEL */
+#define END_REASON_LOCAL_EOS	2	/* on_audio returned SR_AUDIO_FINISH */
 
 struct speech_rec {
 	enum sr_audsrc aud_src;  /* from mic or manual  stream write */
@@ -41,6 +54,7 @@ struct speech_rec {
 	struct recorder *recorder;
 	volatile int state;
 	char * session_begin_params;
+	char * grammar_list;	/* NULL for dictation */
 };
 
 
@@ -51,8 +65,18 @@ extern "C" {
 /* must init before start . is aud_src is SR_MIC, the default capture device
  * will be used. see sr_init_ex */
 int sr_init(struct speech_rec * sr, const char * session_begin_params, enum sr_audsrc aud_src, struct speech_rec_notifier * notifier);
+/* devid picks the capture device when aud_src is SR_MIC */
+int sr_init_ex(struct speech_rec * sr, const char * session_begin_params,
+			enum sr_audsrc aud_src, record_dev_id devid,
+				struct speech_rec_notifier * notify);
+/* open the cloud session ahead of time, sr_start_listening then only has
+ * to start the recorder */
+int sr_prepare(struct speech_rec *sr);
 int sr_start_listening(struct speech_rec *sr);
 int sr_stop_listening(struct speech_rec *sr);
+/* grammar ids for sub = asr sessions, NULL to go back to dictation.
+ * call after init, takes effect on the next start */
+int sr_set_grammar(struct speech_rec *sr, const char *grammar_list);
 /* only used for the manual write way. */
 int sr_write_audio_data(struct speech_rec *sr, char *data, unsigned int len);
 /* must call uninit after you don't use it */
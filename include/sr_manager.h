@@ -0,0 +1,84 @@
+/*
+@file
+@brief several recognizers in one process. Each session owns its
+	speech_rec, its running hypothesis and its counters, and runs on its
+	own thread over a microphone (SR_MIC, any capture device) or over a
+	pcm buffer written as a stream (SR_USER). MSPLogin must be done
+	before sr_mgr_start.
+*/
+
+#ifndef __SR_MANAGER_H__
+#define __SR_MANAGER_H__
+
+#include <pthread.h>
+#include "linuxrec.h"
+#include "speech_recognizer.h"
+#include "iat_result.h"
+#include "latency_stats.h"
+
+#define SR_MAX_SESSIONS		16
+#define SR_MGR_SAMPLE_RATE	16000
+
+struct sr_session;
+struct sr_manager;
+
+/* one finished utterance, called on the session's thread */
+typedef void (*sr_utterance_cb)(struct sr_session *s, const char *text, void *user);
+
+struct sr_session {
+	int id;
+	struct sr_manager *mgr;
+	struct speech_rec rec;
+	enum sr_audsrc src;
+	record_dev_id devid;		/* SR_MIC */
+	const short *pcm;		/* SR_USER: the utterance, written again each loop */
+	size_t samples;
+	int realtime;			/* pace the stream like a microphone */
+
+	int json;			/* result_type = json in the params */
+	struct iat_hypothesis hyp;
+	volatile int speech_end;
+	int end_reason;
+	pthread_t thread;
+	int running;
+
+	unsigned int utterances;
+	unsigned int errors;
+	double audio_ms;
+	double last_audio_ms;		/* lat_now_ms() of the last sample written */
+	struct latency_stats lat;	/* end of audio -> final result */
+};
+
+struct sr_manager {
+	char params[512];
+	sr_utterance_cb on_utterance;
+	void *user;
+	int count;
+	int loops;			/* utterances per session, 0 until sr_mgr_stop */
+	volatile int stop;
+	struct sr_session sessions[SR_MAX_SESSIONS];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sr_mgr_init(struct sr_manager *mgr, const char *params, sr_utterance_cb cb, void *user);
+/* returns the session id, -1 if full */
+int sr_mgr_add_mic(struct sr_manager *mgr, record_dev_id devid);
+int sr_mgr_add_stream(struct sr_manager *mgr, const short *pcm, size_t samples, int realtime);
+/* one thread per session. returns the number of sessions started */
+int sr_mgr_start(struct sr_manager *mgr, int loops);
+/* wait for every session to finish its loops */
+void sr_mgr_join(struct sr_manager *mgr);
+/* end the running utterances and join */
+void sr_mgr_stop(struct sr_manager *mgr);
+/* all sessions: utterances, errors, audio, latency percentiles */
+void sr_mgr_stats(const struct sr_manager *mgr, struct latency_stats *lat,
+		unsigned int *utterances, unsigned int *errors, double *audio_ms);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __SR_MANAGER_H__ */
@@ -0,0 +1,112 @@
+/*
+@file
+@brief task state machine of the robot (PF, VSLAM, hand, object search).
+	The transitions are a table of rows, first match wins, compiled into
+	a dense [state][event] array: the built-in table at build time, the
+	table of a robot profile when it is loaded. Every entry and exit of
+	a state is stamped, time spent per state and refused commands are
+	counted.
+
+	profile file, one row per line, '#' comments:
+	<src|ANY> <event> <dst|SAME|REJECT> <action> [pub code|-1] [via state|NONE]
+*/
+
+#ifndef __TASK_SM_H__
+#define __TASK_SM_H__
+
+#include "latency_stats.h"
+
+enum sm_state {
+	SM_IDLE,
+	SM_PF,
+	SM_VSLAM,
+	SM_FR,
+	SM_MOVING,
+	SM_OR,
+	SM_HAND_OPEN,
+	SM_HAND_CLOSE,
+	SM_NSTATES,
+	/* only in rows */
+	SM_ANY = SM_NSTATES,	/* src: every state */
+	SM_SAME,		/* dst: stay */
+	SM_REJECT,		/* dst: refuse the event */
+	SM_NONE			/* via: no state in between */
+};
+
+enum sm_event {
+	SM_EV_STOP,
+	SM_EV_PF_START,
+	SM_EV_PF_STOP,
+	SM_EV_VSLAM_START,
+	SM_EV_VSLAM_STOP,
+	SM_EV_BYE,
+	SM_EV_ARM,
+	SM_EV_HAND_OPEN,
+	SM_EV_HAND_CLOSE,
+	SM_EV_FIND,
+	SM_EV_MOVE,
+	SM_EV_TASK_DONE,
+	SM_NEVENTS
+};
+
+/* what the node does on a transition, see exec_command */
+enum sm_action {
+	SM_ACT_NONE,
+	SM_ACT_PUBLISH,		/* task command pub_code (-1: the command code) */
+	SM_ACT_LOCK,		/* stop the task (pub_code if >= 0), lock, start FR */
+	SM_ACT_FIND,		/* object search */
+	SM_ACT_MOVE,		/* velocity command */
+	SM_NACTIONS
+};
+
+struct sm_transition {
+	int src;
+	int event;
+	int dst;
+	int action;
+	int pub_code;
+	int via;		/* state while the action runs, then dst */
+};
+
+#define SM_MAX_ROWS	64
+
+struct task_sm {
+	int state;
+	double entered_ms;		/* lat_now_ms() of the last entry */
+	double via_ms;			/* entry into the via state, 0 if none */
+	signed char cell[SM_NSTATES][SM_NEVENTS];	/* row, -1 if none */
+	struct sm_transition rows[SM_MAX_ROWS];
+	int nrows;
+	struct latency_stats time_in[SM_NSTATES];
+	unsigned int rejected[SM_NSTATES][SM_NEVENTS];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* built-in table, state IDLE */
+void sm_init(struct task_sm *sm);
+/* replace the table by a profile file. the built-in one stays if the
+ * file is missing or has a bad row, returns 0 if loaded */
+int sm_load_profile(struct task_sm *sm, const char *path);
+
+/* the row for event in the current state, NULL if refused (counted) */
+const struct sm_transition *sm_lookup(struct task_sm *sm, int event);
+/* the row for event in state, NULL if refused. changes and counts
+ * nothing, the table is constant once loaded: safe from any thread */
+const struct sm_transition *sm_peek(const struct task_sm *sm, int state, int event);
+/* around the action of t: enter its via state, then leave it for dst */
+void sm_begin(struct task_sm *sm, const struct sm_transition *t);
+void sm_finish(struct task_sm *sm, const struct sm_transition *t);
+
+const char *sm_state_name(int state);
+const char *sm_event_name(int event);
+/* time per state, refused events */
+void sm_report(const struct task_sm *sm);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __TASK_SM_H__ */
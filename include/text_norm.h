@@ -0,0 +1,40 @@
+/*
+@file
+@brief normalizer for recognizer text before it is matched against the
+	command table. One pass over UTF-8 input into a caller buffer,
+	nothing is allocated:
+	  - punctuation, symbols and whitespace are dropped (。，！？ ...)
+	  - full-width ASCII is folded to ASCII, letters to lower case
+	  - the digits 零〇一幺二两三四五六七八九 become 0..9, so 两/二/2 match
+	  - every occurrence of the wake prefix (机器人) is removed
+	Runs of ASCII are checked 16 bytes at a time with SSE2 where it is
+	available. Invalid UTF-8 is skipped and counted.
+	Both sides of a match must be normalized the same way.
+*/
+
+#ifndef __TEXT_NORM_H__
+#define __TEXT_NORM_H__
+
+#include <stddef.h>
+
+struct tn_stats {
+	int prefixes;		/* wake prefixes removed */
+	int dropped;		/* punctuation and whitespace characters */
+	int invalid;		/* bytes of malformed UTF-8 */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* prefix: normalized text to remove, NULL for none. st may be NULL.
+ * out is NUL terminated and truncated to size at a character boundary.
+ * returns the length written */
+size_t tn_normalize(const char *in, size_t len, char *out, size_t size,
+		const char *prefix, struct tn_stats *st);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* C++ */
+
+#endif /* __TEXT_NORM_H__ */
@@ -0,0 +1,78 @@
+/*
+@file
+@brief utterance scoped memory. One block is allocated at start up and
+	handed out by bumping a pointer; arena_reset() gives all of it back
+	at once when the next utterance begins. str_builder keeps its length
+	so appending and stripping never rescan the text, str_view passes
+	(pointer, length) pairs around without copying.
+*/
+
+#ifndef __UTT_ARENA_H__
+#define __UTT_ARENA_H__
+
+#include <stddef.h>
+
+struct utt_arena {
+	char *base;
+	size_t size;
+	size_t used;
+	size_t peak;
+	unsigned long heap_allocs;	/* malloc calls, 1 after arena_init */
+	unsigned long allocs;		/* arena_alloc calls */
+	unsigned long resets;
+	unsigned long overflows;	/* arena_alloc calls that did not fit */
+};
+
+struct str_view {
+	const char *p;
+	size_t len;
+};
+
+struct str_builder {
+	char *buf;			/* always NUL terminated */
+	size_t len;
+	size_t cap;			/* including the NUL */
+	unsigned long truncated;	/* appends that did not fit */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int arena_init(struct utt_arena *a, size_t size);
+void arena_destroy(struct utt_arena *a);
+/* 8 byte aligned, NULL if the arena is exhausted */
+void *arena_alloc(struct utt_arena *a, size_t n);
+void arena_reset(struct utt_arena *a);
+/* one printf line with the counters */
+void arena_report(const struct utt_arena *a);
+
+/* first occurrence of needle, NULL if none */
+const char *sv_find(struct str_view hay, const char *needle, size_t nlen);
+
+/* cap bytes from the arena, or a caller buffer */
+int sb_init(struct str_builder *sb, struct utt_arena *a, size_t cap);
+void sb_init_buf(struct str_builder *sb, char *buf, size_t cap);
+void sb_clear(struct str_builder *sb);
+/* both truncate to the capacity, return the new length */
+size_t sb_append(struct str_builder *sb, const char *p, size_t n);
+size_t sb_set(struct str_builder *sb, const char *p, size_t n);
+/* drop every occurrence of t in one pass, returns how many */
+int sb_remove_all(struct str_builder *sb, const char *t, size_t tlen);
+
+#ifdef __cplusplus
+} /* extern "C" */
+
+static inline struct str_view sv_make(const char *p, size_t len)
+{
+	struct str_view v = { p, len };
+	return v;
+}
+
+static inline struct str_view sb_view(const struct str_builder *sb)
+{
+	return sv_make(sb->buf, sb->len);
+}
+#endif /* C++ */
+
+#endif /* __UTT_ARENA_H__ */
@@ -0,0 +1,74 @@
+/*
+@file
+@brief lock-free SPSC queue of NLU answers, see answer_queue.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "answer_queue.h"
+
+void aq_init(struct answer_queue *q, const char *name)
+{
+	q->head.store(0, std::memory_order_relaxed);
+	q->tail.store(0, std::memory_order_relaxed);
+	q->pushed.store(0, std::memory_order_relaxed);
+	q->dropped.store(0, std::memory_order_relaxed);
+	q->max_depth.store(0, std::memory_order_relaxed);
+	q->depth_sum.store(0, std::memory_order_relaxed);
+	q->name = name;
+	lat_init(&q->wait, name);
+}
+
+int aq_push(struct answer_queue *q, unsigned int id, const char *text)
+{
+	unsigned int tail = q->tail.load(std::memory_order_relaxed);
+	unsigned int head = q->head.load(std::memory_order_acquire);
+	unsigned int depth;
+	struct aq_item *it;
+
+	if (tail - head >= AQ_SIZE) {
+		q->dropped.fetch_add(1, std::memory_order_relaxed);
+		return -1;
+	}
+	it = &q->items[tail & (AQ_SIZE - 1)];
+	it->id = id;
+	strncpy(it->text, text, AQ_TEXT_LEN - 1);
+	it->text[AQ_TEXT_LEN - 1] = '\0';
+	it->t_ms = lat_now_ms();
+	q->tail.store(tail + 1, std::memory_order_release);
+
+	/* what the consumer had not taken yet, this answer included */
+	depth = tail + 1 - head;
+	q->pushed.fetch_add(1, std::memory_order_relaxed);
+	q->depth_sum.fetch_add(depth, std::memory_order_relaxed);
+	if (depth > q->max_depth.load(std::memory_order_relaxed))
+		q->max_depth.store(depth, std::memory_order_relaxed);
+	return 0;
+}
+
+int aq_pop(struct answer_queue *q, struct aq_item *out)
+{
+	unsigned int head = q->head.load(std::memory_order_relaxed);
+	unsigned int tail = q->tail.load(std::memory_order_acquire);
+	const struct aq_item *it;
+
+	if (head == tail)
+		return 0;
+	it = &q->items[head & (AQ_SIZE - 1)];
+	out->id = it->id;
+	out->t_ms = it->t_ms;
+	strcpy(out->text, it->text);
+	q->head.store(head + 1, std::memory_order_release);
+	lat_add(&q->wait, lat_now_ms() - out->t_ms);
+	return 1;
+}
+
+void aq_report(struct answer_queue *q)
+{
+	unsigned int pushed = q->pushed.load();
+
+	printf("[answers] %s: %u pushed, %u dropped, depth mean %.2f max %u\n",
+		q->name, pushed, q->dropped.load(),
+		pushed ? (double)q->depth_sum.load() / pushed : 0.0, q->max_depth.load());
+	lat_report(&q->wait);
+}
@@ -0,0 +1,222 @@
+/*
+@file
+@brief command grammar generation and the grammar id cache, see
+	asr_grammar.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "qisr.h"
+#include "msp_cmn.h"
+#include "msp_errors.h"
+#include "asr_grammar.h"
+#include "content_hash.h"
+
+#define GRM_DBGON 0
+#if GRM_DBGON == 1
+#	define grm_dbg printf
+#else
+#	define grm_dbg(...)
+#endif
+
+#define GRAMMAR_BUILD_PARAMS \
+	"engine_type = cloud, text_encoding = utf8, sample_rate = 16000"
+#define GRAMMAR_BUILD_TIMEOUT_MS	10000
+
+/* one build at a time. the SDK keeps the context pointer until it calls
+ * build_cb, which can be after grammar_load_or_build gave up waiting, so
+ * the context belongs to the module and not to a stack frame */
+struct build_ctx {
+	int pending;		/* QISRBuildGrammar called, build_cb not yet */
+	int done;
+	int errcode;
+	char id[GRAMMAR_ID_LEN];
+};
+
+static struct build_ctx build;
+static pthread_mutex_t build_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int append(char *out, size_t size, size_t *n, const char *fmt, ...)
+{
+	va_list ap;
+	int w;
+
+	if (*n >= size)
+		return -1;
+	va_start(ap, fmt);
+	w = vsnprintf(out + *n, size - *n, fmt, ap);
+	va_end(ap);
+	if (w < 0 || (size_t)w >= size - *n)
+		return -1;
+	*n += w;
+	return 0;
+}
+
+static int seen_before(const char *const *list, int i)
+{
+	int j;
+
+	for (j = 0; j < i; j++) {
+		if (!strcmp(list[j], list[i]))
+			return 1;
+	}
+	return 0;
+}
+
+static int append_alternatives(char *out, size_t size, size_t *n,
+		const char *rule, const char *const *list, int count)
+{
+	int i, first = 1;
+
+	if (append(out, size, n, "$%s = ", rule))
+		return -1;
+	for (i = 0; i < count; i++) {
+		if (list[i][0] == '\0' || seen_before(list, i))
+			continue;
+		if (append(out, size, n, "%s%s", first ? "" : " | ", list[i]))
+			return -1;
+		first = 0;
+	}
+	return append(out, size, n, ";\n");
+}
+
+int grammar_write_abnf(char *out, size_t size,
+		const char *const *commands, int ncommands,
+		const char *const *objects, int nobjects)
+{
+	size_t n = 0;
+
+	if (append(out, size, &n,
+			"#ABNF 1.0 UTF-8;\n"
+			"language zh-CN;\n"
+			"mode voice;\n\n"
+			"root $main;\n"
+			"$main = 机器人 ($cmd | 寻找 $obj);\n"))
+		return -1;
+	if (append_alternatives(out, size, &n, "cmd", commands, ncommands))
+		return -1;
+	if (nobjects > 0) {
+		if (append_alternatives(out, size, &n, "obj", objects, nobjects))
+			return -1;
+	} else if (append(out, size, &n, "$obj = 玩具;\n")) {
+		return -1;
+	}
+
+	return (int)n;
+}
+
+static int build_cb(int ecode, const char *info, void *udata)
+{
+	struct build_ctx *ctx = (struct build_ctx *)udata;
+
+	pthread_mutex_lock(&build_lock);
+	ctx->errcode = ecode;
+	if (MSP_SUCCESS == ecode && info) {
+		strncpy(ctx->id, info, sizeof(ctx->id) - 1);
+		ctx->id[sizeof(ctx->id) - 1] = '\0';
+	}
+	ctx->done = 1;
+	ctx->pending = 0;
+	pthread_mutex_unlock(&build_lock);
+	return 0;
+}
+
+/* cache file: "<hash hex>\n<grammar id>\n" */
+static int read_cache(const char *path, unsigned long long hash, char *id, size_t id_size)
+{
+	FILE *f;
+	unsigned long long cached = 0;
+	char line[GRAMMAR_ID_LEN];
+	int ret = -1;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%llx\n", &cached) == 1 && cached == hash
+		&& fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0]) {
+			strncpy(id, line, id_size - 1);
+			id[id_size - 1] = '\0';
+			ret = 0;
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+static void write_cache(const char *path, unsigned long long hash, const char *id)
+{
+	FILE *f = fopen(path, "w");
+
+	if (!f) {
+		printf("grammar: cannot write %s\n", path);
+		return;
+	}
+	fprintf(f, "%llx\n%s\n", hash, id);
+	fclose(f);
+}
+
+int grammar_load_or_build(const char *abnf, const char *cache_path,
+		char *grammar_id, size_t id_size)
+{
+	struct build_ctx ctx;
+	unsigned long long hash;
+	unsigned int len = strlen(abnf);
+	int waited = 0;
+	int ret;
+
+	hash = fnv1a64(abnf, len, FNV1A64_INIT);
+	if (cache_path && read_cache(cache_path, hash, grammar_id, id_size) == 0) {
+		grm_dbg("grammar: cached id %s (%llx)\n", grammar_id, hash);
+		return 0;
+	}
+
+	pthread_mutex_lock(&build_lock);
+	if (build.pending) {
+		pthread_mutex_unlock(&build_lock);
+		printf("grammar: an earlier build is still pending\n");
+		return -1;
+	}
+	memset(&build, 0, sizeof(build));
+	build.pending = 1;
+	pthread_mutex_unlock(&build_lock);
+
+	ret = QISRBuildGrammar("abnf", abnf, len, GRAMMAR_BUILD_PARAMS, build_cb, &build);
+	if (MSP_SUCCESS != ret) {
+		pthread_mutex_lock(&build_lock);
+		build.pending = 0;
+		pthread_mutex_unlock(&build_lock);
+		printf("grammar: QISRBuildGrammar failed %d\n", ret);
+		return ret;
+	}
+	for (;;) {
+		pthread_mutex_lock(&build_lock);
+		ctx = build;
+		pthread_mutex_unlock(&build_lock);
+		if (ctx.done || waited >= GRAMMAR_BUILD_TIMEOUT_MS)
+			break;
+		usleep(10 * 1000);
+		waited += 10;
+	}
+	if (!ctx.done) {
+		/* build stays pending, build_cb clears it whenever it comes */
+		printf("grammar: build timeout\n");
+		return -1;
+	}
+	if (MSP_SUCCESS != ctx.errcode || ctx.id[0] == '\0') {
+		printf("grammar: build failed %d\n", ctx.errcode);
+		return ctx.errcode ? ctx.errcode : -1;
+	}
+
+	strncpy(grammar_id, ctx.id, id_size - 1);
+	grammar_id[id_size - 1] = '\0';
+	grm_dbg("grammar: built id %s (%llx) in %dms\n", grammar_id, hash, waited);
+	if (cache_path)
+		write_cache(cache_path, hash, grammar_id);
+	return 0;
+}
@@ -0,0 +1,126 @@
+/*
+@file
+@brief hotword lexicon upload, see asr_lexicon.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "msp_cmn.h"
+#include "msp_errors.h"
+#include "asr_lexicon.h"
+#include "content_hash.h"
+
+#define LEX_DBGON 0
+#if LEX_DBGON == 1
+#	define lex_dbg printf
+#else
+#	define lex_dbg(...)
+#endif
+
+/* iat user words, see "iFlytek MSC Reference Manual" */
+#define LEXICON_UPLOAD_PARAMS	"sub = uup, dtt = userword"
+#define LEXICON_NAME		"voice_system"
+#define LEXICON_JSON_MAX	(LEXICON_MAX_WORDS * (LEXICON_WORD_LEN * 2 + 4) + 128)
+
+void lexicon_init(struct asr_lexicon *lex, const char *hash_path)
+{
+	FILE *f;
+
+	memset(lex, 0, sizeof(*lex));
+	if (!hash_path)
+		return;
+
+	strncpy(lex->hash_path, hash_path, sizeof(lex->hash_path) - 1);
+	f = fopen(lex->hash_path, "r");
+	if (f) {
+		if (fscanf(f, "%llx", &lex->uploaded_hash) != 1)
+			lex->uploaded_hash = 0;
+		fclose(f);
+	}
+}
+
+int lexicon_add(struct asr_lexicon *lex, const char *word)
+{
+	int i;
+
+	if (!word || word[0] == '\0' || strlen(word) >= LEXICON_WORD_LEN)
+		return -1;
+	for (i = 0; i < lex->count; i++) {
+		if (!strcmp(lex->words[i], word))
+			return 0;
+	}
+	if (lex->count >= LEXICON_MAX_WORDS)
+		return -1;
+
+	strcpy(lex->words[lex->count++], word);
+	return 1;
+}
+
+unsigned long long lexicon_hash(const struct asr_lexicon *lex)
+{
+	unsigned long long h = FNV1A64_INIT;
+	int i;
+
+	for (i = 0; i < lex->count; i++)
+		h = fnv1a64(lex->words[i], strlen(lex->words[i]) + 1, h);
+	return h;
+}
+
+int lexicon_dirty(const struct asr_lexicon *lex)
+{
+	return lexicon_hash(lex) != lex->uploaded_hash;
+}
+
+/* {"userword":[{"name":"...","words":["w1","w2"]}]} */
+static int write_json(const struct asr_lexicon *lex, char *out, size_t size)
+{
+	size_t n = 0;
+	int i;
+	const char *p;
+
+	n += snprintf(out, size, "{\"userword\":[{\"name\":\"%s\",\"words\":[", LEXICON_NAME);
+	for (i = 0; i < lex->count && n + LEXICON_WORD_LEN * 2 + 8 < size; i++) {
+		if (i)
+			out[n++] = ',';
+		out[n++] = '"';
+		for (p = lex->words[i]; *p; p++) {
+			if (*p == '"' || *p == '\\')
+				out[n++] = '\\';
+			out[n++] = *p;
+		}
+		out[n++] = '"';
+	}
+	n += snprintf(out + n, size - n, "]}]}");
+	return (int)n;
+}
+
+int lexicon_sync(struct asr_lexicon *lex)
+{
+	static char json[LEXICON_JSON_MAX];
+	unsigned long long hash = lexicon_hash(lex);
+	int len;
+	int ret = MSP_SUCCESS;
+	FILE *f;
+
+	if (hash == lex->uploaded_hash)
+		return 0;
+
+	len = write_json(lex, json, sizeof(json));
+	MSPUploadData("userwords", json, len, LEXICON_UPLOAD_PARAMS, &ret);
+	if (MSP_SUCCESS != ret) {
+		printf("lexicon: upload of %d words failed %d\n", lex->count, ret);
+		return ret;
+	}
+
+	lex_dbg("lexicon: uploaded %d words (%llx)\n", lex->count, hash);
+	lex->uploaded_hash = hash;
+	if (lex->hash_path[0]) {
+		f = fopen(lex->hash_path, "w");
+		if (f) {
+			fprintf(f, "%llx\n", hash);
+			fclose(f);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,200 @@
+/*
+@file
+@brief lock-free coalescing queue of manual command codes, see cmd_queue.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmd_queue.h"
+
+static const char *policy_names[] = { "keep", "latest", "never", "cancel" };
+
+void cmdq_init(struct cmd_queue *q)
+{
+	unsigned int i;
+
+	for (i = 0; i < CMDQ_SIZE; i++)
+		q->cells[i].seq.store(i, std::memory_order_relaxed);
+	q->head.store(0, std::memory_order_relaxed);
+	q->tail = 0;
+	q->spare.store(-1, std::memory_order_relaxed);
+	q->spare_mark = 0;
+	q->spare_ms = 0;
+	q->wake.store(false, std::memory_order_relaxed);
+	q->nrules = 0;
+	q->pushed.store(0, std::memory_order_relaxed);
+	q->dropped.store(0, std::memory_order_relaxed);
+	q->coalesced = 0;
+	q->cancelled = 0;
+	lat_init(&q->lat, "manual code push->drained");
+}
+
+int cmdq_set_rules(struct cmd_queue *q, const char *spec)
+{
+	struct cmdq_rule rules[CMDQ_MAX_RULES];
+	const char *p = spec;
+	char *end;
+	int n = 0;
+	unsigned int k;
+
+	while (*p) {
+		if (n >= CMDQ_MAX_RULES)
+			return -1;
+		rules[n].lo = strtol(p, &end, 10);
+		if (end == p)
+			return -1;
+		rules[n].hi = rules[n].lo;
+		p = end;
+		if (*p == '-') {
+			rules[n].hi = strtol(p + 1, &end, 10);
+			if (end == p + 1)
+				return -1;
+			p = end;
+		}
+		if (*p++ != ':')
+			return -1;
+		for (k = 0; k < sizeof(policy_names) / sizeof(policy_names[0]); k++) {
+			size_t len = strlen(policy_names[k]);
+			if (!strncmp(p, policy_names[k], len) && (p[len] == ',' || p[len] == '\0'))
+				break;
+		}
+		if (k == sizeof(policy_names) / sizeof(policy_names[0]))
+			return -1;
+		rules[n++].policy = k;
+		p += strlen(policy_names[k]);
+		if (*p == ',')
+			p++;
+	}
+
+	memcpy(q->rules, rules, n * sizeof(rules[0]));
+	q->nrules = n;
+	return n;
+}
+
+/* index of the first rule of code, -1 if none */
+static int rule_of(const struct cmd_queue *q, int code)
+{
+	int i;
+
+	for (i = 0; i < q->nrules; i++) {
+		if (code >= q->rules[i].lo && code <= q->rules[i].hi)
+			return i;
+	}
+	return -1;
+}
+
+static int policy_of(const struct cmd_queue *q, int rule)
+{
+	return rule < 0 ? CMDQ_KEEP : q->rules[rule].policy;
+}
+
+int cmdq_push(struct cmd_queue *q, int code, int mark)
+{
+	unsigned int pos = q->head.load(std::memory_order_relaxed);
+	struct cmdq_cell *cell;
+	int expected = -1;
+
+	q->pushed.fetch_add(1, std::memory_order_relaxed);
+	for (;;) {
+		cell = &q->cells[pos & (CMDQ_SIZE - 1)];
+		int dif = (int)(cell->seq.load(std::memory_order_acquire) - pos);
+		if (dif == 0) {
+			if (q->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (dif < 0) {
+			/* full. the spare slot takes one code that must not be lost */
+			int policy = policy_of(q, rule_of(q, code));
+			if ((policy == CMDQ_NEVER_DROP || policy == CMDQ_CANCEL)
+				&& q->spare.compare_exchange_strong(expected, -2)) {
+				q->spare_mark = mark;
+				q->spare_ms = lat_now_ms();
+				q->spare.store(code, std::memory_order_release);
+				goto wake;
+			}
+			q->dropped.fetch_add(1, std::memory_order_relaxed);
+			return -1;
+		} else {
+			pos = q->head.load(std::memory_order_relaxed);
+		}
+	}
+
+	cell->e.code = code;
+	cell->e.mark = mark;
+	cell->e.t_ms = lat_now_ms();
+	cell->seq.store(pos + 1, std::memory_order_release);
+
+wake:
+	return q->wake.exchange(true) ? 0 : 1;
+}
+
+/* append e, collapsing it into the last entry if both are of one
+ * latest rule. a cancel code first drops the latest ones before it */
+static int put(struct cmd_queue *q, struct cmdq_entry *out, int n, const struct cmdq_entry *e)
+{
+	int rule = rule_of(q, e->code);
+	int i, k;
+
+	if (policy_of(q, rule) == CMDQ_CANCEL) {
+		for (i = k = 0; i < n; i++) {
+			if (policy_of(q, rule_of(q, out[i].code)) == CMDQ_LATEST) {
+				q->cancelled++;
+				continue;
+			}
+			out[k++] = out[i];
+		}
+		n = k;
+	}
+
+	if (n > 0 && rule >= 0 && policy_of(q, rule) == CMDQ_LATEST
+		&& rule_of(q, out[n - 1].code) == rule) {
+		out[n - 1] = *e;
+		q->coalesced++;
+		return n;
+	}
+	out[n] = *e;
+	return n + 1;
+}
+
+int cmdq_drain(struct cmd_queue *q, struct cmdq_entry *out, int max)
+{
+	struct cmdq_cell *cell;
+	struct cmdq_entry e;
+	double now = lat_now_ms();
+	int n = 0;
+	int i, code;
+
+	/* pushes from here on wake us again */
+	q->wake.store(false);
+
+	while (n < max) {
+		cell = &q->cells[q->tail & (CMDQ_SIZE - 1)];
+		if (cell->seq.load(std::memory_order_acquire) != q->tail + 1)
+			break;
+		e = cell->e;
+		cell->seq.store(q->tail + CMDQ_SIZE, std::memory_order_release);
+		q->tail++;
+		n = put(q, out, n, &e);
+	}
+
+	/* it came when the ring was full, after what is in it */
+	code = q->spare.load(std::memory_order_acquire);
+	if (code >= 0 && n < max) {
+		e.code = code;
+		e.mark = q->spare_mark;
+		e.t_ms = q->spare_ms;
+		q->spare.store(-1, std::memory_order_release);
+		n = put(q, out, n, &e);
+	}
+
+	for (i = 0; i < n; i++)
+		lat_add(&q->lat, now - out[i].t_ms);
+	return n;
+}
+
+void cmdq_report(struct cmd_queue *q)
+{
+	printf("[cmdq] %u pushed, %u dropped, %u coalesced, %u cancelled\n",
+		q->pushed.load(), q->dropped.load(), q->coalesced, q->cancelled);
+	lat_report(&q->lat);
+}
@@ -0,0 +1,220 @@
+/*
+@file
+@brief adaptive end of speech detection, see endpointer.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "endpointer.h"
+#include "latency_stats.h"
+
+#define VOICED_DB_ABOVE_NOISE	12.0f
+#define VOICED_DB_MIN		35.0f
+#define MIN_SPEECH_MS		150	/* shorter bursts are clicks, not speech */
+#define MIN_PAUSE_MS		100	/* shorter gaps are within a word */
+#define MIN_LEARNED_PAUSES	20	/* use the defaults until then */
+#define HIST_DECAY_TOTAL	1000	/* halve the counts past this, users change */
+
+struct ep_context_limits {
+	unsigned int default_ms;	/* nothing learned yet */
+	unsigned int margin_ms;		/* added to the p95 pause */
+	unsigned int min_ms;
+	unsigned int max_ms;
+};
+
+static const struct ep_context_limits limits[EP_CONTEXTS] = {
+	{  500, 100, 300,  800 },	/* EP_COMMAND */
+	{ 1000, 300, 600, 1500 },	/* EP_QUESTION */
+	{  800, 200, 500, 1200 },	/* EP_RETRY */
+};
+
+static void load_profile(struct endpointer *ep)
+{
+	FILE *f = fopen(ep->profile_path, "r");
+	int i;
+
+	if (!f)
+		return;
+	for (i = 0; i < EP_HIST_BINS; i++) {
+		if (fscanf(f, "%u", &ep->hist[i]) != 1) {
+			memset(ep->hist, 0, sizeof(ep->hist));
+			break;
+		}
+	}
+	fclose(f);
+
+	ep->hist_total = 0;
+	for (i = 0; i < EP_HIST_BINS; i++)
+		ep->hist_total += ep->hist[i];
+}
+
+static void save_profile(const struct endpointer *ep)
+{
+	FILE *f = fopen(ep->profile_path, "w");
+	int i;
+
+	if (!f)
+		return;
+	for (i = 0; i < EP_HIST_BINS; i++)
+		fprintf(f, "%u%c", ep->hist[i], i == EP_HIST_BINS - 1 ? '\n' : ' ');
+	fclose(f);
+}
+
+void ep_init(struct endpointer *ep, unsigned int sample_rate, const char *profile_path)
+{
+	memset(ep, 0, sizeof(*ep));
+	ep->sample_rate = sample_rate;
+	ep->hop = sample_rate / 100;
+	if (ep->hop > sizeof(ep->frame) / sizeof(ep->frame[0]))
+		ep->hop = sizeof(ep->frame) / sizeof(ep->frame[0]);
+	if (profile_path) {
+		strncpy(ep->profile_path, profile_path, sizeof(ep->profile_path) - 1);
+		load_profile(ep);
+	}
+	ep_begin(ep, EP_COMMAND);
+}
+
+static unsigned int pause_p95_ms(const struct endpointer *ep)
+{
+	unsigned int want = (ep->hist_total * 95 + 99) / 100;
+	unsigned int seen = 0;
+	int i;
+
+	for (i = 0; i < EP_HIST_BINS; i++) {
+		seen += ep->hist[i];
+		if (seen >= want)
+			break;
+	}
+	return (i + 1) * EP_HIST_BIN_MS;
+}
+
+unsigned int ep_eos_ms(const struct endpointer *ep, int context)
+{
+	const struct ep_context_limits *l;
+	unsigned int ms;
+
+	if (context < 0 || context >= EP_CONTEXTS)
+		context = EP_COMMAND;
+	l = &limits[context];
+	if (ep->hist_total < MIN_LEARNED_PAUSES)
+		return l->default_ms;
+
+	ms = pause_p95_ms(ep) + l->margin_ms;
+	if (ms < l->min_ms)
+		ms = l->min_ms;
+	if (ms > l->max_ms)
+		ms = l->max_ms;
+	return ms;
+}
+
+unsigned int ep_begin(struct endpointer *ep, int context)
+{
+	ep->fill = 0;
+	ep->noise_db = 1e9f;
+	ep->voiced_ms = 0;
+	ep->silence_ms = 0;
+	ep->last_voiced_ms = 0;
+	ep->ended = 0;
+	ep->npauses = 0;
+	ep_set_context(ep, context);
+	return ep->eos_ms;
+}
+
+void ep_set_context(struct endpointer *ep, int context)
+{
+	ep->context = context;
+	ep->eos_ms = ep_eos_ms(ep, context);
+}
+
+static float frame_db(const short *pcm, unsigned int n)
+{
+	double sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		sum += (double)pcm[i] * pcm[i];
+	return 10.0f * log10f((float)(sum / n) + 1.0f);
+}
+
+static void process_frame(struct endpointer *ep)
+{
+	float e = frame_db(ep->frame, ep->hop);
+	int voiced;
+
+	/* noise floor follows quiet frames down fast and unvoiced ones up
+	 * slowly; speech never raises it, or a long question would stop
+	 * counting as voiced */
+	if (e < ep->noise_db)
+		ep->noise_db = e;
+	voiced = e > ep->noise_db + VOICED_DB_ABOVE_NOISE && e > VOICED_DB_MIN;
+	if (!voiced)
+		ep->noise_db += 0.01f * (e - ep->noise_db);
+
+	if (voiced) {
+		/* a gap between voiced stretches is a pause of this speaker */
+		if (ep->voiced_ms >= MIN_SPEECH_MS && ep->silence_ms >= MIN_PAUSE_MS
+			&& ep->npauses < EP_MAX_PAUSES)
+			ep->pauses[ep->npauses++] = ep->silence_ms;
+		ep->voiced_ms += 10;
+		ep->silence_ms = 0;
+		ep->last_voiced_ms = lat_now_ms();
+	} else if (ep->voiced_ms > 0) {
+		ep->silence_ms += 10;
+	}
+
+	if (ep->voiced_ms >= MIN_SPEECH_MS && ep->silence_ms >= ep->eos_ms)
+		ep->ended = 1;
+}
+
+int ep_feed(struct endpointer *ep, const char *data, unsigned long len)
+{
+	const short *pcm = (const short *)data;
+	unsigned long samples = len / sizeof(short);
+	unsigned long i;
+
+	for (i = 0; i < samples && !ep->ended; i++) {
+		ep->frame[ep->fill++] = pcm[i];
+		if (ep->fill == ep->hop) {
+			process_frame(ep);
+			ep->fill = 0;
+		}
+	}
+
+	if (ep->ended)
+		return EP_END;
+	return ep->voiced_ms >= MIN_SPEECH_MS ? EP_SPEAKING : EP_WAITING;
+}
+
+double ep_speech_end_ms(const struct endpointer *ep)
+{
+	return ep->last_voiced_ms;
+}
+
+void ep_end(struct endpointer *ep)
+{
+	unsigned int bin;
+	int i;
+
+	if (ep->npauses == 0)
+		return;
+
+	for (i = 0; i < ep->npauses; i++) {
+		bin = ep->pauses[i] / EP_HIST_BIN_MS;
+		if (bin >= EP_HIST_BINS)
+			bin = EP_HIST_BINS - 1;
+		ep->hist[bin]++;
+		ep->hist_total++;
+	}
+	if (ep->hist_total > HIST_DECAY_TOTAL) {
+		ep->hist_total = 0;
+		for (i = 0; i < EP_HIST_BINS; i++) {
+			ep->hist[i] /= 2;
+			ep->hist_total += ep->hist[i];
+		}
+	}
+	ep->npauses = 0;
+
+	if (ep->profile_path[0])
+		save_profile(ep);
+}
@@ -0,0 +1,100 @@
+/*
+@file
+@brief lock-free event queue, see event_queue.h
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "event_queue.h"
+#include "latency_stats.h"
+
+int evq_init(struct event_queue *q)
+{
+	unsigned int i;
+
+	for (i = 0; i < EVQ_SIZE; i++)
+		q->cells[i].seq.store(i, std::memory_order_relaxed);
+	q->head.store(0, std::memory_order_relaxed);
+	q->tail = 0;
+	q->dropped.store(0, std::memory_order_relaxed);
+	return sem_init(&q->ready, 0, 0);
+}
+
+void evq_destroy(struct event_queue *q)
+{
+	sem_destroy(&q->ready);
+}
+
+static int push(struct event_queue *q, int type, int value, const char *text, void *data)
+{
+	unsigned int pos = q->head.load(std::memory_order_relaxed);
+	struct evq_cell *cell;
+
+	for (;;) {
+		cell = &q->cells[pos & (EVQ_SIZE - 1)];
+		int dif = (int)(cell->seq.load(std::memory_order_acquire) - pos);
+		if (dif == 0) {
+			/* free slot, claim it. pos is reloaded if someone else did */
+			if (q->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (dif < 0) {
+			/* the consumer has not freed it yet: full */
+			q->dropped.fetch_add(1, std::memory_order_relaxed);
+			return -1;
+		} else {
+			pos = q->head.load(std::memory_order_relaxed);
+		}
+	}
+
+	cell->ev.type = type;
+	cell->ev.value = value;
+	cell->ev.t_ms = lat_now_ms();
+	cell->ev.text[0] = '\0';
+	if (text) {
+		strncpy(cell->ev.text, text, EVQ_TEXT_LEN - 1);
+		cell->ev.text[EVQ_TEXT_LEN - 1] = '\0';
+	}
+	cell->ev.data = data;
+	cell->seq.store(pos + 1, std::memory_order_release);
+	sem_post(&q->ready);
+	return 0;
+}
+
+int evq_push(struct event_queue *q, int type, int value, const char *text)
+{
+	return push(q, type, value, text, NULL);
+}
+
+int evq_push_data(struct event_queue *q, int type, int value, void *data)
+{
+	return push(q, type, value, NULL, data);
+}
+
+int evq_pop(struct event_queue *q, struct evq_event *ev, int timeout_ms)
+{
+	struct evq_cell *cell;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	while (sem_timedwait(&q->ready, &ts)) {
+		if (errno != EINTR)
+			return 0;
+	}
+
+	/* one event is published. with several producers it may be a later
+	 * slot, the one at tail is then a few stores from ready */
+	cell = &q->cells[q->tail & (EVQ_SIZE - 1)];
+	while (cell->seq.load(std::memory_order_acquire) != q->tail + 1)
+		;
+	*ev = cell->ev;
+	cell->seq.store(q->tail + EVQ_SIZE, std::memory_order_release);
+	q->tail++;
+	return 1;
+}
@@ -0,0 +1,338 @@
+/*
+@file
+@brief long lived HTTP client, see http_client.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "http_client.h"
+
+static size_t append_cb(char *data, size_t size, size_t nmemb, void *user)
+{
+	std::string *out = (std::string *)user;
+
+	out->append(data, size * nmemb);
+	return size * nmemb;
+}
+
+static void get_timing(CURL *curl, struct http_timing *t)
+{
+	double dns = 0, conn = 0, ttfb = 0, total = 0;
+	long connects = 0;
+
+	curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &dns);
+	curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &conn);
+	curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &ttfb);
+	curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total);
+	curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+	t->status = 0;
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &t->status);
+	t->dns_ms = dns * 1000;
+	t->connect_ms = conn * 1000;
+	t->ttfb_ms = ttfb * 1000;
+	t->total_ms = total * 1000;
+	t->reused = connects == 0;
+}
+
+static void wake(struct http_client *c)
+{
+	char b = 1;
+
+	/* a full pipe already wakes it */
+	if (write(c->wake[1], &b, 1) < 0 && errno != EAGAIN)
+		printf("[http] cannot wake the client thread: %s\n", strerror(errno));
+}
+
+static void start(struct http_client *c, struct http_request *r, struct http_pending *p)
+{
+	r->id = p->id;
+	r->head = p->head;
+	r->body.swap(p->body);
+	r->out.clear();
+	r->submit_ms = p->submit_ms;
+	r->start_ms = lat_now_ms();
+
+	curl_easy_setopt(r->curl, CURLOPT_NOBODY, r->head ? 1L : 0L);
+	if (!r->head) {
+		curl_easy_setopt(r->curl, CURLOPT_POST, 1L);
+		curl_easy_setopt(r->curl, CURLOPT_POSTFIELDS, r->body.c_str());
+		curl_easy_setopt(r->curl, CURLOPT_POSTFIELDSIZE, (long)r->body.size());
+	}
+	curl_multi_add_handle(c->multi, r->curl);
+}
+
+static void stop(struct http_client *c, struct http_request *r)
+{
+	curl_multi_remove_handle(c->multi, r->curl);
+	r->id = 0;
+}
+
+/* under the lock: drop what was cancelled, start what fits */
+static void take_requests(struct http_client *c)
+{
+	int i, k, n;
+
+	for (i = 0; i < HTTP_MAX_INFLIGHT; i++) {
+		struct http_request *r = &c->reqs[i];
+		if (r->id && !r->head && r->id < c->cancel_below) {
+			stop(c, r);
+			c->cancelled++;
+		}
+	}
+
+	n = 0;
+	for (i = 0; i < c->npending; i++) {
+		struct http_pending *p = &c->pending[i];
+		if (!p->head && p->id < c->cancel_below) {
+			c->cancelled++;
+			continue;
+		}
+		for (k = 0; k < HTTP_MAX_INFLIGHT && c->reqs[k].id; k++)
+			;
+		if (k < HTTP_MAX_INFLIGHT) {
+			start(c, &c->reqs[k], p);
+			continue;
+		}
+		if (n != i) {
+			c->pending[n].id = p->id;
+			c->pending[n].head = p->head;
+			c->pending[n].body.swap(p->body);
+			c->pending[n].submit_ms = p->submit_ms;
+		}
+		n++;
+	}
+	c->npending = n;
+}
+
+static void finish(struct http_client *c, CURL *curl, CURLcode res)
+{
+	struct http_request *r = NULL;
+	struct http_timing t;
+	unsigned int id;
+	int i;
+
+	for (i = 0; i < HTTP_MAX_INFLIGHT; i++) {
+		if (c->reqs[i].id && c->reqs[i].curl == curl)
+			r = &c->reqs[i];
+	}
+	if (!r)
+		return;
+
+	get_timing(curl, &t);
+	t.queued_ms = r->start_ms - r->submit_ms;
+	id = r->id;
+	stop(c, r);
+	if (r->head) {
+		printf("[http] preconnect %s: %s, dns %.1fms connect %.1fms\n", c->url,
+			res == CURLE_OK ? "ok" : curl_easy_strerror(res), t.dns_ms, t.connect_ms);
+		return;
+	}
+
+	c->requests++;
+	if (res != CURLE_OK) {
+		c->failures++;
+		printf("[http] request %u failed after %.1fms: %s\n", id, t.total_ms,
+			curl_easy_strerror(res));
+	} else {
+		if (t.reused)
+			c->reused++;
+		lat_add(&c->lat_queued, t.queued_ms);
+		lat_add(&c->lat_dns, t.dns_ms);
+		lat_add(&c->lat_connect, t.connect_ms);
+		lat_add(&c->lat_ttfb, t.ttfb_ms);
+		lat_add(&c->lat_total, t.total_ms);
+	}
+	/* the slot is not reused before done returns */
+	c->done(id, res, r->out, &t, c->user);
+}
+
+static void *client_proc(void *arg)
+{
+	struct http_client *c = (struct http_client *)arg;
+	struct curl_waitfd wfd;
+	CURLMsg *msg;
+	char drain[64];
+	int running, left, numfds;
+
+	for (;;) {
+		pthread_mutex_lock(&c->lock);
+		if (c->quit) {
+			pthread_mutex_unlock(&c->lock);
+			break;
+		}
+		take_requests(c);
+		pthread_mutex_unlock(&c->lock);
+
+		curl_multi_perform(c->multi, &running);
+		while ((msg = curl_multi_info_read(c->multi, &left))) {
+			if (msg->msg == CURLMSG_DONE)
+				finish(c, msg->easy_handle, msg->data.result);
+		}
+
+		/* sockets of curl, or a new request on the pipe */
+		wfd.fd = c->wake[0];
+		wfd.events = CURL_WAIT_POLLIN;
+		wfd.revents = 0;
+		curl_multi_wait(c->multi, &wfd, 1, 1000, &numfds);
+		if (wfd.revents)
+			while (read(c->wake[0], drain, sizeof(drain)) > 0)
+				;
+	}
+	return NULL;
+}
+
+int http_init(struct http_client *c, const char *url, long connect_timeout_ms,
+		long total_timeout_ms, long dns_cache_s, http_done_fn done, void *user)
+{
+	int i;
+
+	c->multi = NULL;
+	c->headers = NULL;
+	strncpy(c->url, url, sizeof(c->url) - 1);
+	c->url[sizeof(c->url) - 1] = '\0';
+	c->done = done;
+	c->user = user;
+	c->quit = false;
+	c->next_id = 1;
+	c->cancel_below = 0;
+	c->npending = 0;
+	c->requests = c->failures = c->cancelled = c->reused = 0;
+	lat_init(&c->lat_queued, "nlu http queued");
+	lat_init(&c->lat_dns, "nlu http dns");
+	lat_init(&c->lat_connect, "nlu http connect");
+	lat_init(&c->lat_ttfb, "nlu http first byte");
+	lat_init(&c->lat_total, "nlu http total");
+	for (i = 0; i < HTTP_MAX_INFLIGHT; i++) {
+		c->reqs[i].id = 0;
+		c->reqs[i].curl = NULL;
+	}
+
+	c->multi = curl_multi_init();
+	c->headers = curl_slist_append(NULL, "Content-Type:application/json; charset=utf-8");
+	if (!c->multi || !c->headers)
+		goto FAIL;
+	for (i = 0; i < HTTP_MAX_INFLIGHT; i++) {
+		CURL *curl = curl_easy_init();
+		if (!curl)
+			goto FAIL;
+		c->reqs[i].curl = curl;
+		curl_easy_setopt(curl, CURLOPT_URL, c->url);
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, c->headers);
+		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, connect_timeout_ms);
+		curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, total_timeout_ms);
+		curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, dns_cache_s);
+		curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+		curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, append_cb);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &c->reqs[i].out);
+	}
+
+	if (pipe(c->wake))
+		goto FAIL;
+	fcntl(c->wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(c->wake[1], F_SETFL, O_NONBLOCK);
+	pthread_mutex_init(&c->lock, NULL);
+	if (pthread_create(&c->thread, NULL, client_proc, c)) {
+		pthread_mutex_destroy(&c->lock);
+		close(c->wake[0]);
+		close(c->wake[1]);
+		goto FAIL;
+	}
+	return 0;
+
+FAIL:
+	for (i = 0; i < HTTP_MAX_INFLIGHT; i++) {
+		if (c->reqs[i].curl)
+			curl_easy_cleanup(c->reqs[i].curl);
+		c->reqs[i].curl = NULL;
+	}
+	if (c->multi)
+		curl_multi_cleanup(c->multi);
+	if (c->headers)
+		curl_slist_free_all(c->headers);
+	c->multi = NULL;
+	c->headers = NULL;
+	return -1;
+}
+
+void http_cleanup(struct http_client *c)
+{
+	int i;
+
+	pthread_mutex_lock(&c->lock);
+	c->quit = true;
+	pthread_mutex_unlock(&c->lock);
+	wake(c);
+	pthread_join(c->thread, NULL);
+
+	for (i = 0; i < HTTP_MAX_INFLIGHT; i++) {
+		if (c->reqs[i].id)
+			curl_multi_remove_handle(c->multi, c->reqs[i].curl);
+		curl_easy_cleanup(c->reqs[i].curl);
+	}
+	curl_multi_cleanup(c->multi);
+	curl_slist_free_all(c->headers);
+	close(c->wake[0]);
+	close(c->wake[1]);
+	pthread_mutex_destroy(&c->lock);
+}
+
+static unsigned int queue(struct http_client *c, const char *body, size_t len,
+		bool head, bool supersede)
+{
+	struct http_pending *p;
+	unsigned int id;
+
+	pthread_mutex_lock(&c->lock);
+	if (supersede)
+		c->cancel_below = c->next_id;
+	if (c->npending >= HTTP_MAX_PENDING) {
+		pthread_mutex_unlock(&c->lock);
+		return 0;
+	}
+	id = c->next_id++;
+	p = &c->pending[c->npending++];
+	p->id = id;
+	p->head = head;
+	p->body.assign(body, len);
+	p->submit_ms = lat_now_ms();
+	pthread_mutex_unlock(&c->lock);
+	wake(c);
+	return id;
+}
+
+int http_preconnect(struct http_client *c)
+{
+	return queue(c, "", 0, true, false) ? 0 : -1;
+}
+
+unsigned int http_submit(struct http_client *c, const char *body, size_t len, bool supersede)
+{
+	return queue(c, body, len, false, supersede);
+}
+
+unsigned int http_supersede(struct http_client *c)
+{
+	unsigned int id;
+
+	pthread_mutex_lock(&c->lock);
+	id = c->next_id++;
+	c->cancel_below = c->next_id;
+	pthread_mutex_unlock(&c->lock);
+	wake(c);
+	return id;
+}
+
+void http_report(const struct http_client *c)
+{
+	printf("[http] %lu requests, %lu failed, %lu cancelled, %lu on a kept connection\n",
+		c->requests, c->failures, c->cancelled, c->reused);
+	lat_report(&c->lat_queued);
+	lat_report(&c->lat_dns);
+	lat_report(&c->lat_connect);
+	lat_report(&c->lat_ttfb);
+	lat_report(&c->lat_total);
+}
@@ -0,0 +1,245 @@
+/*
+@file
+@brief iat json fragments and the dynamic correction hypothesis, see
+	iat_result.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "iat_result.h"
+#include "json_scan.h"
+
+int iat_parse_fragment(const char *json, size_t len, struct iat_fragment *frag)
+{
+	struct json_span root, key, val, item, cw, w, sc;
+	struct json_iter it, words;
+	size_t n = 0;
+
+	memset(frag, 0, sizeof(*frag));
+	frag->sc = -1;
+	root = json_root(json, len);
+	if (json_iter_init(&it, root) || root.p[0] != '{')
+		return -1;
+
+	while (json_object_next(&it, &key, &val)) {
+		if (json_key_is(key, "sn")) {
+			frag->sn = json_to_long(val);
+		} else if (json_key_is(key, "sc")) {
+			frag->sc = json_to_long(val);
+		} else if (json_key_is(key, "ls")) {
+			frag->ls = json_is_true(val);
+		} else if (json_key_is(key, "pgs")) {
+			frag->replace = json_string_is(val, "rpl");
+		} else if (json_key_is(key, "rg")) {
+			struct json_iter rg;
+			if (json_iter_init(&rg, val) == 0) {
+				if (json_array_next(&rg, &item))
+					frag->rg[0] = json_to_long(item);
+				if (json_array_next(&rg, &item))
+					frag->rg[1] = json_to_long(item);
+			}
+		} else if (json_key_is(key, "ws")) {
+			if (json_iter_init(&words, val))
+				continue;
+			/* ws: [{ "cw": [{ "w": "...", "sc": 0 }, ...] }, ...] */
+			while (json_array_next(&words, &item)) {
+				struct json_iter cands;
+				struct iat_word spare;
+				struct iat_word *wd = &spare;
+
+				if (!json_find(item, "cw", &cw) || json_iter_init(&cands, cw))
+					continue;
+				/* past IAT_MAX_WORDS only the text is kept */
+				if (frag->nwords < IAT_MAX_WORDS)
+					wd = &frag->words[frag->nwords];
+				wd->nalt = 0;
+				while (wd->nalt < IAT_MAX_ALTS && json_array_next(&cands, &item)) {
+					if (!json_find(item, "w", &w))
+						continue;
+					wd->w[wd->nalt] = w;
+					wd->sc[wd->nalt] = json_find(item, "sc", &sc) ? json_to_long(sc) : 0;
+					wd->nalt++;
+				}
+				if (wd->nalt == 0)
+					continue;
+				n += json_copy_string(wd->w[0], frag->text + n, sizeof(frag->text) - n);
+				if (wd != &spare)
+					frag->nwords++;
+			}
+		}
+	}
+
+	return 0;
+}
+
+void iat_hyp_reset(struct iat_hypothesis *h)
+{
+	h->max_sn = 0;
+	h->text[0] = '\0';
+	h->text_len = 0;
+	h->updates = 0;
+	memset(h->sent, 0, sizeof(h->sent));
+}
+
+int iat_hyp_apply(struct iat_hypothesis *h, const struct iat_fragment *frag)
+{
+	int i;
+
+	if (frag->sn <= 0 || frag->sn >= IAT_MAX_SENTENCES)
+		return -1;
+
+	if (frag->replace) {
+		for (i = frag->rg[0]; i <= frag->rg[1]; i++) {
+			if (i > 0 && i < IAT_MAX_SENTENCES)
+				h->sent[i][0] = '\0';
+		}
+	}
+	strcpy(h->sent[frag->sn], frag->text);
+	if (frag->sn > h->max_sn)
+		h->max_sn = frag->sn;
+
+	h->text_len = 0;
+	for (i = 1; i <= h->max_sn; i++) {
+		size_t n = strlen(h->sent[i]);
+		if (h->text_len + n >= sizeof(h->text))
+			n = sizeof(h->text) - 1 - h->text_len;
+		memcpy(h->text + h->text_len, h->sent[i], n);
+		h->text_len += n;
+	}
+	h->text[h->text_len] = '\0';
+	h->updates++;
+
+	return 0;
+}
+
+/* mean score of the scored words, -1 if none is scored */
+static int fragment_score(const struct iat_fragment *frag, int *nscored)
+{
+	int i, sum = 0;
+
+	*nscored = 0;
+	for (i = 0; i < frag->nwords; i++) {
+		if (frag->words[i].sc[0] > 0) {
+			sum += frag->words[i].sc[0];
+			(*nscored)++;
+		}
+	}
+	if (frag->sc >= 0)
+		return frag->sc;
+	return *nscored ? sum / *nscored : -1;
+}
+
+static int same_word(struct json_span a, struct json_span b)
+{
+	return a.len == b.len && memcmp(a.p, b.p, a.len) == 0;
+}
+
+/* best word everywhere except alternative alt at position pos */
+static void build_text(const struct iat_fragment *frag, int pos, int alt,
+		char *out, size_t size)
+{
+	size_t n = 0;
+	int i;
+
+	out[0] = '\0';
+	for (i = 0; i < frag->nwords && n + 1 < size; i++)
+		n += json_copy_string(frag->words[i].w[i == pos ? alt : 0], out + n, size - n);
+}
+
+int iat_fragment_nbest(const struct iat_fragment *frag, struct iat_nbest *nb)
+{
+	struct { int pos, alt, delta; } swap[IAT_NBEST - 1];
+	int nswap = 0;
+	int base, nscored;
+	int i, a, k;
+
+	base = fragment_score(frag, &nscored);
+	nb->count = 1;
+	nb->cand[0].score = base;
+	if (frag->nwords > 0)
+		build_text(frag, -1, 0, nb->cand[0].text, IAT_SENTENCE_LEN);
+	else
+		strcpy(nb->cand[0].text, frag->text);
+
+	/* the swaps that cost the least score, in order of appearance on ties */
+	for (i = 0; i < frag->nwords; i++) {
+		const struct iat_word *wd = &frag->words[i];
+		for (a = 1; a < wd->nalt; a++) {
+			int delta = wd->sc[0] - wd->sc[a];
+			if (same_word(wd->w[0], wd->w[a]))
+				continue;
+			for (k = nswap; k > 0 && swap[k - 1].delta > delta; k--) {
+				if (k < IAT_NBEST - 1)
+					swap[k] = swap[k - 1];
+			}
+			if (k >= IAT_NBEST - 1)
+				continue;
+			swap[k].pos = i;
+			swap[k].alt = a;
+			swap[k].delta = delta;
+			if (nswap < IAT_NBEST - 1)
+				nswap++;
+		}
+	}
+
+	for (k = 0; k < nswap; k++) {
+		struct iat_candidate *c = &nb->cand[nb->count++];
+		build_text(frag, swap[k].pos, swap[k].alt, c->text, IAT_SENTENCE_LEN);
+		if (base < 0)
+			c->score = -1;
+		else if (nscored > 0)
+			c->score = base - swap[k].delta / nscored;
+		else
+			c->score = base;
+	}
+
+	return nb->count;
+}
+
+int iat_hyp_nbest(const struct iat_hypothesis *h, const struct iat_fragment *frag,
+		const struct iat_nbest *fnb, struct iat_nbest *utt)
+{
+	/* a replacing fragment (wpgs) supersedes what it capped before */
+	int prev = utt->count > 0 && !frag->replace ? utt->cand[0].score : -1;
+	int i, j;
+
+	if (frag->sn <= 0 || frag->sn >= IAT_MAX_SENTENCES || fnb->count == 0)
+		return utt->count;
+
+	/* an appended sentence without alternatives (often just the closing
+	 * punctuation) keeps the alternatives of what came before */
+	if (fnb->count == 1 && utt->count > 1 && !frag->replace && frag->sn == h->max_sn) {
+		for (i = 0; i < utt->count; i++) {
+			struct iat_candidate *c = &utt->cand[i];
+			size_t n = strlen(c->text);
+			strncpy(c->text + n, fnb->cand[0].text, sizeof(c->text) - 1 - n);
+			c->text[sizeof(c->text) - 1] = '\0';
+			if (fnb->cand[0].score >= 0 && (c->score < 0 || fnb->cand[0].score < c->score))
+				c->score = fnb->cand[0].score;
+		}
+		return utt->count;
+	}
+
+	for (i = 0; i < fnb->count; i++) {
+		struct iat_candidate *c = &utt->cand[i];
+		size_t n = 0;
+
+		for (j = 1; j <= h->max_sn; j++) {
+			const char *s = j == frag->sn ? fnb->cand[i].text : h->sent[j];
+			size_t len = strlen(s);
+			if (n + len >= sizeof(c->text))
+				len = sizeof(c->text) - 1 - n;
+			memcpy(c->text + n, s, len);
+			n += len;
+		}
+		c->text[n] = '\0';
+
+		/* an utterance is as trustworthy as its weakest scored part */
+		c->score = fnb->cand[i].score;
+		if (prev >= 0 && (c->score < 0 || prev < c->score))
+			c->score = prev;
+	}
+	utt->count = fnb->count;
+
+	return utt->count;
+}
@@ -0,0 +1,192 @@
+/*
+@file
+@brief local intent router, see intent_model.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "intent_model.h"
+#include "text_norm.h"
+#include "content_hash.h"
+
+#define IM_MAX_FEATURES	(IM_TEXT_LEN * 2 + 1)
+#define BIGRAM_SEED	0x9e3779b97f4a7c15ULL
+
+static const char *const names[IM_NCLASSES] = {
+	"command", "local", "cloud", "reject"
+};
+
+const char *im_name(int intent)
+{
+	return intent >= 0 && intent < IM_NCLASSES ? names[intent] : "?";
+}
+
+int im_intent_of(const char *name)
+{
+	int i;
+
+	for (i = 0; i < IM_NCLASSES; i++) {
+		if (!strcmp(names[i], name))
+			return i;
+	}
+	return IM_NCLASSES;
+}
+
+void im_init(struct intent_model *m, unsigned int buckets)
+{
+	memset(m, 0, sizeof(*m));
+	m->buckets = buckets;
+	m->loaded = 1;
+}
+
+/* length of the UTF-8 character at p */
+static size_t char_len(unsigned char c)
+{
+	if (c >= 0xf0)
+		return 4;
+	if (c >= 0xe0)
+		return 3;
+	if (c >= 0xc0)
+		return 2;
+	return 1;
+}
+
+/* buckets of the unigrams and bigrams of the normalized text */
+static int features(const struct intent_model *m, const char *text, size_t len,
+		const char *prefix, unsigned int *f)
+{
+	char buf[IM_TEXT_LEN];
+	size_t n, i, k, prev = 0, prev_len = 0;
+	unsigned int mask = m->buckets - 1;
+	int nf = 0;
+
+	n = tn_normalize(text, len, buf, sizeof(buf), prefix, NULL);
+	for (i = 0; i < n; i += k) {
+		k = char_len((unsigned char)buf[i]);
+		if (i + k > n)
+			break;
+		f[nf++] = fnv1a64(buf + i, k, FNV1A64_INIT) & mask;
+		if (prev_len)
+			f[nf++] = fnv1a64(buf + prev, prev_len + k, BIGRAM_SEED) & mask;
+		prev = i;
+		prev_len = k;
+	}
+	return nf;
+}
+
+static void softmax(const struct intent_model *m, const unsigned int *f, int nf, float *p)
+{
+	float max = -1e30f, sum = 0;
+	int c, i;
+
+	for (c = 0; c < IM_NCLASSES; c++) {
+		float s = m->bias[c];
+		for (i = 0; i < nf; i++)
+			s += m->w[c][f[i]];
+		p[c] = s;
+		if (s > max)
+			max = s;
+	}
+	for (c = 0; c < IM_NCLASSES; c++) {
+		p[c] = expf(p[c] - max);
+		sum += p[c];
+	}
+	for (c = 0; c < IM_NCLASSES; c++)
+		p[c] /= sum;
+}
+
+int im_classify(const struct intent_model *m, const char *text, size_t len,
+		const char *prefix, struct intent_result *r)
+{
+	unsigned int f[IM_MAX_FEATURES];
+	int nf, c;
+
+	if (!m->loaded)
+		return -1;
+	nf = features(m, text, len, prefix, f);
+	softmax(m, f, nf, r->p);
+	r->intent = 0;
+	for (c = 1; c < IM_NCLASSES; c++) {
+		if (r->p[c] > r->p[r->intent])
+			r->intent = c;
+	}
+	r->confidence = r->p[r->intent];
+	return 0;
+}
+
+float im_train(struct intent_model *m, const char *text, size_t len,
+		const char *prefix, int label, float rate, float l2)
+{
+	unsigned int f[IM_MAX_FEATURES];
+	float p[IM_NCLASSES];
+	int nf, c, i;
+
+	nf = features(m, text, len, prefix, f);
+	softmax(m, f, nf, p);
+	for (c = 0; c < IM_NCLASSES; c++) {
+		float g = p[c] - (c == label);
+		m->bias[c] -= rate * g;
+		for (i = 0; i < nf; i++)
+			m->w[c][f[i]] -= rate * (g + l2 * m->w[c][f[i]]);
+	}
+	return -logf(p[label] > 1e-12f ? p[label] : 1e-12f);
+}
+
+int im_load(struct intent_model *m, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[128], name[16];
+	unsigned int buckets, bucket;
+	float weight;
+	int c, ret = -1;
+
+	if (!f)
+		return -1;
+	if (!fgets(line, sizeof(line), f) || sscanf(line, "intent_model %u", &buckets) != 1
+		|| buckets == 0 || buckets > IM_BUCKETS_MAX || (buckets & (buckets - 1)))
+		goto DONE;
+
+	im_init(m, buckets);
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "w %15s %u %f", name, &bucket, &weight) == 3) {
+			c = im_intent_of(name);
+			if (c == IM_NCLASSES || bucket >= buckets)
+				goto DONE;
+			m->w[c][bucket] = weight;
+		} else if (sscanf(line, "bias %15s %f", name, &weight) == 2) {
+			c = im_intent_of(name);
+			if (c == IM_NCLASSES)
+				goto DONE;
+			m->bias[c] = weight;
+		}
+	}
+	ret = 0;
+
+DONE:
+	if (ret)
+		m->loaded = 0;
+	fclose(f);
+	return ret;
+}
+
+int im_save(const struct intent_model *m, const char *path)
+{
+	FILE *f = fopen(path, "w");
+	unsigned int b;
+	int c;
+
+	if (!f)
+		return -1;
+	fprintf(f, "intent_model %u\n", m->buckets);
+	for (c = 0; c < IM_NCLASSES; c++)
+		fprintf(f, "bias %s %.5g\n", names[c], m->bias[c]);
+	for (c = 0; c < IM_NCLASSES; c++) {
+		for (b = 0; b < m->buckets; b++) {
+			/* only what the training moved */
+			if (fabsf(m->w[c][b]) >= 1e-4f)
+				fprintf(f, "w %s %u %.4g\n", names[c], b, m->w[c][b]);
+		}
+	}
+	return fclose(f);
+}
@@ -0,0 +1,152 @@
+/*
+@file
+@brief trains the local intent model and evaluates it: accuracy, the
+	confusion matrix and the cost of one decision. Corpus lines are
+	"<command|local|cloud|reject>\t<result text>".
+
+	intent_tool train <corpus.txt> <model> [buckets=4096] [epochs=30]
+	intent_tool eval <model> <corpus.txt> [loops=200]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intent_model.h"
+#include "latency_stats.h"
+
+#define MAX_LINES	8192
+#define PREFIX		"机器人"
+
+static int labels[MAX_LINES];
+static char texts[MAX_LINES][IM_TEXT_LEN];
+static int nlines;
+static struct intent_model model;
+
+static int read_corpus(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[IM_TEXT_LEN + 16];
+	char *tab;
+
+	if (!f)
+		return -1;
+	while (nlines < MAX_LINES && fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		tab = strchr(line, '\t');
+		if (!tab)
+			continue;
+		*tab = '\0';
+		labels[nlines] = im_intent_of(line);
+		if (labels[nlines] == IM_NCLASSES) {
+			printf("unknown intent %s\n", line);
+			continue;
+		}
+		strncpy(texts[nlines], tab + 1, IM_TEXT_LEN - 1);
+		nlines++;
+	}
+	fclose(f);
+	return nlines;
+}
+
+static int train(const char *corpus, const char *path, unsigned int buckets, int epochs)
+{
+	int order[MAX_LINES];
+	int e, i, j, t;
+	float loss;
+
+	if (read_corpus(corpus) <= 0) {
+		printf("cannot read %s\n", corpus);
+		return -1;
+	}
+	im_init(&model, buckets);
+	for (i = 0; i < nlines; i++)
+		order[i] = i;
+	srand(1);
+	for (e = 0; e < epochs; e++) {
+		for (i = nlines - 1; i > 0; i--) {
+			j = rand() % (i + 1);
+			t = order[i];
+			order[i] = order[j];
+			order[j] = t;
+		}
+		loss = 0;
+		for (i = 0; i < nlines; i++) {
+			int k = order[i];
+			loss += im_train(&model, texts[k], strlen(texts[k]), PREFIX, labels[k],
+				0.5f / (1 + e * 0.1f), 1e-4f);
+		}
+		if (e == 0 || e == epochs - 1 || (e + 1) % 10 == 0)
+			printf("epoch %d loss %.4f\n", e + 1, loss / nlines);
+	}
+	if (im_save(&model, path)) {
+		printf("cannot write %s\n", path);
+		return -1;
+	}
+	printf("%d examples, %u buckets -> %s\n", nlines, buckets, path);
+	return 0;
+}
+
+static int eval(const char *path, const char *corpus, int loops)
+{
+	int confusion[IM_NCLASSES][IM_NCLASSES];
+	struct intent_result r;
+	struct latency_stats lat;
+	int correct = 0;
+	int i, c, l;
+
+	if (im_load(&model, path)) {
+		printf("cannot load %s\n", path);
+		return -1;
+	}
+	if (read_corpus(corpus) <= 0) {
+		printf("cannot read %s\n", corpus);
+		return -1;
+	}
+
+	memset(confusion, 0, sizeof(confusion));
+	for (i = 0; i < nlines; i++) {
+		im_classify(&model, texts[i], strlen(texts[i]), PREFIX, &r);
+		confusion[labels[i]][r.intent]++;
+		if (r.intent == labels[i])
+			correct++;
+		else
+			printf("[%s] %s, got %s %.2f\n", texts[i], im_name(labels[i]),
+				im_name(r.intent), r.confidence);
+	}
+	printf("%d/%d correct (%.1f%%)\n", correct, nlines, 100.0 * correct / nlines);
+	printf("%-8s", "");
+	for (c = 0; c < IM_NCLASSES; c++)
+		printf("%8s", im_name(c));
+	printf("\n");
+	for (i = 0; i < IM_NCLASSES; i++) {
+		printf("%-8s", im_name(i));
+		for (c = 0; c < IM_NCLASSES; c++)
+			printf("%8d", confusion[i][c]);
+		printf("\n");
+	}
+
+	lat_init(&lat, "intent decision");
+	for (l = 0; l < loops; l++) {
+		for (i = 0; i < nlines; i++) {
+			double t0 = lat_now_ms();
+			im_classify(&model, texts[i], strlen(texts[i]), PREFIX, &r);
+			lat_add(&lat, lat_now_ms() - t0);
+		}
+	}
+	printf("%.2f us per decision\n", lat_mean(&lat) * 1000);
+	lat_report(&lat);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc >= 4 && !strcmp(argv[1], "train"))
+		return train(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 4096,
+			argc > 5 ? atoi(argv[5]) : 30) ? 1 : 0;
+	if (argc >= 4 && !strcmp(argv[1], "eval"))
+		return eval(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 200) ? 1 : 0;
+
+	printf("usage: %s train <corpus.txt> <model> [buckets] [epochs]\n"
+		"       %s eval <model> <corpus.txt> [loops]\n", argv[0], argv[0]);
+	return 1;
+}
@@ -0,0 +1,253 @@
+/*
+@file
+@brief tuling request and response handling with json_writer/json_pick
+	against the jsoncpp path the node used before: building the request
+	by string concatenation or Json::FastWriter, reading code and text
+	with a Json::Reader DOM. Each line of the input is a question; the
+	answers are made up in the shapes tuling sends (text, link, news).
+
+	json_bench <questions.txt> [loops=2000]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <jsoncpp/json/json.h>
+#include "json_writer.h"
+#include "json_scan.h"
+#include "latency_stats.h"
+
+#define MAX_LINES	4096
+#define LINE_LEN	1024
+#define KEY		"7086890091eb41bf9f39242a78f0eed3"
+
+static char lines[MAX_LINES][LINE_LEN];
+static int nlines;
+static std::string responses[MAX_LINES];
+
+/* a few questions that broke the concatenated request */
+static const char *tricky[] = {
+	"他说\"你好\"是什么意思",
+	"C:\\temp 是什么目录",
+	"第一行\n第二行",
+	"制表\t符",
+};
+
+static int read_lines(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	int n = 0;
+
+	if (!f)
+		return -1;
+	while (n < MAX_LINES && fgets(lines[n], LINE_LEN, f)) {
+		lines[n][strcspn(lines[n], "\r\n")] = '\0';
+		if (lines[n][0])
+			n++;
+	}
+	fclose(f);
+	return n;
+}
+
+static std::string build_concat(const char *q)
+{
+	std::string s = "{";
+	s += "\"key\" : \"" KEY "\",";
+	s += "\"info\" : ";
+	s += "\"";
+	s += q;
+	s += "\"";
+	s += "}";
+	return s;
+}
+
+static std::string build_jsoncpp(const char *q)
+{
+	Json::FastWriter writer;
+	Json::Value root;
+
+	root["key"] = KEY;
+	root["info"] = q;
+	return writer.write(root);
+}
+
+static void build_jw(struct json_writer *w, const char *q)
+{
+	jw_reset(w);
+	jw_begin_object(w);
+	jw_member_string(w, "key", KEY);
+	jw_member_string(w, "info", q);
+	jw_end_object(w);
+}
+
+/* the question as tuling got it, "" if the request was not valid JSON */
+static std::string info_of(const std::string &req)
+{
+	Json::Reader reader;
+	Json::Value root;
+
+	if (!reader.parse(req, root) || !root.isObject())
+		return "";
+	return root["info"].asString();
+}
+
+static void make_response(struct json_writer *w, int i, const char *q)
+{
+	std::string text = std::string("你问的是") + q;
+
+	jw_reset(w);
+	jw_begin_object(w);
+	switch (i % 3) {
+	case 0:
+		jw_member_long(w, "code", 100000);
+		jw_member_string(w, "text", text.c_str());
+		break;
+	case 1:
+		jw_member_long(w, "code", 200000);
+		jw_member_string(w, "text", text.c_str());
+		jw_member_string(w, "url", "http://m.tuling123.com/link?q=1");
+		break;
+	default:
+		jw_member_long(w, "code", 302000);
+		jw_member_string(w, "text", text.c_str());
+		jw_key(w, "list");
+		jw_begin_array(w);
+		jw_begin_object(w);
+		jw_member_string(w, "article", "机器人走进家庭");
+		jw_member_string(w, "source", "新闻");
+		jw_member_string(w, "detailurl", "http://m.tuling123.com/news/1");
+		jw_end_object(w);
+		jw_end_array(w);
+		break;
+	}
+	jw_end_object(w);
+}
+
+static long parse_jsoncpp(const std::string &in, std::string *text)
+{
+	Json::Reader reader;
+	Json::Value root;
+
+	if (!reader.parse(in, root))
+		return -1;
+	*text = root["text"].asString();
+	return root["code"].asInt64();
+}
+
+static const char *const answer_keys[] = { "code", "text" };
+
+static long parse_pick(const std::string &in, char *text, size_t size)
+{
+	struct json_span vals[2];
+
+	if (json_pick(json_root(in.data(), in.size()), answer_keys, vals, 2) == 0)
+		return -1;
+	json_copy_string(vals[1], text, size);
+	return json_to_long(vals[0]);
+}
+
+typedef void (*pass_fn)(struct json_writer *w, size_t *sink);
+
+static void pass_concat(struct json_writer *, size_t *sink)
+{
+	for (int i = 0; i < nlines; i++)
+		*sink += build_concat(lines[i]).size();
+}
+
+static void pass_fastwriter(struct json_writer *, size_t *sink)
+{
+	for (int i = 0; i < nlines; i++)
+		*sink += build_jsoncpp(lines[i]).size();
+}
+
+static void pass_writer(struct json_writer *w, size_t *sink)
+{
+	for (int i = 0; i < nlines; i++) {
+		build_jw(w, lines[i]);
+		*sink += w->len;
+	}
+}
+
+static void pass_reader(struct json_writer *, size_t *sink)
+{
+	std::string text;
+
+	for (int i = 0; i < nlines; i++)
+		*sink += parse_jsoncpp(responses[i], &text) + text.size();
+}
+
+static void pass_pick(struct json_writer *, size_t *sink)
+{
+	char text[LINE_LEN * 2];
+
+	for (int i = 0; i < nlines; i++) {
+		*sink += parse_pick(responses[i], text, sizeof(text));
+		*sink += strlen(text);
+	}
+}
+
+static void bench(const char *name, pass_fn fn, struct json_writer *w, int loops)
+{
+	struct latency_stats lat;
+	size_t sink = 0;
+	double t0;
+	int l;
+
+	lat_init(&lat, name);
+	for (l = 0; l < loops; l++) {
+		t0 = lat_now_ms();
+		fn(w, &sink);
+		lat_add(&lat, lat_now_ms() - t0);
+	}
+	printf("%-24s %7.1f ns per document (%zu)\n", name,
+		lat_mean(&lat) * 1e6 / nlines, sink % 10);
+}
+
+int main(int argc, char *argv[])
+{
+	int loops = argc > 2 ? atoi(argv[2]) : 2000;
+	struct json_writer w;
+	char text[LINE_LEN * 2];
+	std::string want;
+	int bad_concat = 0, bad_jw = 0, bad_pick = 0;
+	size_t i;
+	int n;
+
+	if (argc < 2) {
+		printf("usage: %s <questions.txt> [loops]\n", argv[0]);
+		return -1;
+	}
+	nlines = read_lines(argv[1]);
+	if (nlines <= 0) {
+		printf("cannot read %s\n", argv[1]);
+		return -1;
+	}
+	for (i = 0; i < sizeof(tricky) / sizeof(tricky[0]) && nlines < MAX_LINES; i++)
+		strcpy(lines[nlines++], tricky[i]);
+
+	jw_init(&w);
+	for (n = 0; n < nlines; n++) {
+		build_jw(&w, lines[n]);
+		if (info_of(w.buf) != lines[n])
+			bad_jw++;
+		if (info_of(build_concat(lines[n])) != lines[n])
+			bad_concat++;
+
+		make_response(&w, n, lines[n]);
+		responses[n] = w.buf;
+		if (parse_jsoncpp(responses[n], &want) != parse_pick(responses[n], text, sizeof(text))
+			|| want != text)
+			bad_pick++;
+	}
+	printf("%d questions: %d requests wrong by concatenation, %d by json_writer; "
+		"%d answers read differently than jsoncpp\n", nlines, bad_concat, bad_jw, bad_pick);
+
+	bench("request, concatenation", pass_concat, &w, loops);
+	bench("request, FastWriter", pass_fastwriter, &w, loops);
+	bench("request, json_writer", pass_writer, &w, loops);
+	bench("answer, Json::Reader", pass_reader, &w, loops);
+	bench("answer, json_pick", pass_pick, &w, loops);
+	jw_free(&w);
+	return 0;
+}
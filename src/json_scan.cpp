@@ -0,0 +1,331 @@
+/*
+@file
+@brief zero-copy JSON scanner, see json_scan.h
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "json_scan.h"
+
+static const char *skip_ws(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+		p++;
+	return p;
+}
+
+/* p points at the opening quote, returns the char after the closing one */
+static const char *skip_string(const char *p, const char *end)
+{
+	for (p++; p < end; p++) {
+		if (*p == '\\')
+			p++;
+		else if (*p == '"')
+			return p + 1;
+	}
+	return NULL;
+}
+
+/* returns the char after the value starting at p, NULL if malformed */
+static const char *skip_value(const char *p, const char *end)
+{
+	int depth = 0;
+
+	if (p >= end)
+		return NULL;
+
+	if (*p == '"')
+		return skip_string(p, end);
+
+	if (*p != '{' && *p != '[') {
+		/* number, true, false, null */
+		while (p < end && *p != ',' && *p != '}' && *p != ']'
+			&& *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+			p++;
+		return p;
+	}
+
+	while (p < end) {
+		switch (*p) {
+		case '"':
+			p = skip_string(p, end);
+			if (!p)
+				return NULL;
+			continue;
+		case '{':
+		case '[':
+			depth++;
+			break;
+		case '}':
+		case ']':
+			if (--depth == 0)
+				return p + 1;
+			break;
+		default:
+			break;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+struct json_span json_root(const char *p, size_t len)
+{
+	struct json_span v = { p, 0 };
+	const char *end = p + len;
+	const char *e;
+
+	p = skip_ws(p, end);
+	e = skip_value(p, end);
+	if (e) {
+		v.p = p;
+		v.len = e - p;
+	}
+	return v;
+}
+
+int json_iter_init(struct json_iter *it, struct json_span container)
+{
+	if (container.len < 2 || (container.p[0] != '{' && container.p[0] != '['))
+		return -1;
+	it->cur = container.p + 1;
+	it->end = container.p + container.len - 1;
+	return 0;
+}
+
+static int next_value(struct json_iter *it, struct json_span *val)
+{
+	const char *e;
+
+	it->cur = skip_ws(it->cur, it->end);
+	e = skip_value(it->cur, it->end);
+	if (!e || e == it->cur)
+		return 0;
+	val->p = it->cur;
+	val->len = e - it->cur;
+
+	it->cur = skip_ws(e, it->end);
+	if (it->cur < it->end && *it->cur == ',')
+		it->cur++;
+	return 1;
+}
+
+int json_object_next(struct json_iter *it, struct json_span *key, struct json_span *val)
+{
+	const char *e;
+
+	it->cur = skip_ws(it->cur, it->end);
+	if (it->cur >= it->end || *it->cur != '"')
+		return 0;
+	e = skip_string(it->cur, it->end);
+	if (!e)
+		return 0;
+	key->p = it->cur + 1;
+	key->len = e - it->cur - 2;
+
+	it->cur = skip_ws(e, it->end);
+	if (it->cur >= it->end || *it->cur != ':')
+		return 0;
+	it->cur++;
+	return next_value(it, val);
+}
+
+int json_array_next(struct json_iter *it, struct json_span *val)
+{
+	return next_value(it, val);
+}
+
+int json_find(struct json_span obj, const char *key, struct json_span *val)
+{
+	struct json_iter it;
+	struct json_span k;
+
+	if (json_iter_init(&it, obj) || obj.p[0] != '{')
+		return 0;
+	while (json_object_next(&it, &k, val)) {
+		if (json_key_is(k, key))
+			return 1;
+	}
+	return 0;
+}
+
+int json_pick(struct json_span obj, const char *const *keys, struct json_span *vals, int n)
+{
+	struct json_iter it;
+	struct json_span k, v;
+	unsigned int left;
+	int i, found = 0;
+
+	if (n > 32)
+		n = 32;
+	for (i = 0; i < n; i++) {
+		vals[i].p = obj.p;
+		vals[i].len = 0;
+	}
+	if (json_iter_init(&it, obj) || obj.p[0] != '{')
+		return 0;
+	left = n == 32 ? 0xffffffffu : (1u << n) - 1;
+	while (left && json_object_next(&it, &k, &v)) {
+		for (i = 0; i < n; i++) {
+			if ((left & 1u << i) && json_key_is(k, keys[i])) {
+				vals[i] = v;
+				left &= ~(1u << i);
+				found++;
+				break;
+			}
+		}
+	}
+	return found;
+}
+
+int json_key_is(struct json_span key, const char *s)
+{
+	size_t n = strlen(s);
+
+	return key.len == n && memcmp(key.p, s, n) == 0;
+}
+
+int json_is_string(struct json_span v)
+{
+	return v.len >= 2 && v.p[0] == '"';
+}
+
+int json_string_is(struct json_span v, const char *s)
+{
+	size_t n = strlen(s);
+
+	return json_is_string(v) && v.len == n + 2 && memcmp(v.p + 1, s, n) == 0;
+}
+
+long json_to_long(struct json_span v)
+{
+	long x = 0;
+	int neg = 0;
+	size_t i = 0;
+
+	/* iflytek sends some numbers as strings, e.g. "sc":"47" */
+	if (json_is_string(v)) {
+		v.p++;
+		v.len -= 2;
+	}
+	if (i < v.len && v.p[i] == '-') {
+		neg = 1;
+		i++;
+	}
+	for (; i < v.len && v.p[i] >= '0' && v.p[i] <= '9'; i++)
+		x = x * 10 + (v.p[i] - '0');
+	return neg ? -x : x;
+}
+
+int json_is_true(struct json_span v)
+{
+	return v.len == 4 && memcmp(v.p, "true", 4) == 0;
+}
+
+static int hexval(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* append one code point as utf-8, returns bytes written or 0 if no room */
+static size_t put_utf8(char *out, size_t room, unsigned int cp)
+{
+	if (cp < 0x80 && room >= 1) {
+		out[0] = cp;
+		return 1;
+	}
+	if (cp < 0x800 && room >= 2) {
+		out[0] = 0xc0 | (cp >> 6);
+		out[1] = 0x80 | (cp & 0x3f);
+		return 2;
+	}
+	if (cp < 0x10000 && room >= 3) {
+		out[0] = 0xe0 | (cp >> 12);
+		out[1] = 0x80 | ((cp >> 6) & 0x3f);
+		out[2] = 0x80 | (cp & 0x3f);
+		return 3;
+	}
+	if (room >= 4) {
+		out[0] = 0xf0 | (cp >> 18);
+		out[1] = 0x80 | ((cp >> 12) & 0x3f);
+		out[2] = 0x80 | ((cp >> 6) & 0x3f);
+		out[3] = 0x80 | (cp & 0x3f);
+		return 4;
+	}
+	return 0;
+}
+
+size_t json_copy_string(struct json_span v, char *out, size_t size)
+{
+	const char *p, *end;
+	size_t n = 0;
+
+	if (size == 0)
+		return 0;
+	if (!json_is_string(v)) {
+		out[0] = '\0';
+		return 0;
+	}
+
+	p = v.p + 1;
+	end = v.p + v.len - 1;
+	while (p < end && n + 1 < size) {
+		char c = *p++;
+		if (c != '\\') {
+			out[n++] = c;
+			continue;
+		}
+		if (p >= end)
+			break;
+		c = *p++;
+		switch (c) {
+		case 'n': out[n++] = '\n'; break;
+		case 't': out[n++] = '\t'; break;
+		case 'r': out[n++] = '\r'; break;
+		case 'b': out[n++] = '\b'; break;
+		case 'f': out[n++] = '\f'; break;
+		case 'u': {
+			unsigned int cp = 0;
+			int i;
+			for (i = 0; i < 4 && p < end; i++) {
+				int h = hexval(*p++);
+				if (h < 0)
+					break;
+				cp = cp << 4 | h;
+			}
+			/* surrogate pair */
+			if (cp >= 0xd800 && cp < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+				unsigned int lo = 0;
+				for (i = 0; i < 4; i++) {
+					int h = hexval(p[2 + i]);
+					if (h < 0)
+						break;
+					lo = lo << 4 | h;
+				}
+				if (i == 4 && lo >= 0xdc00 && lo < 0xe000) {
+					cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+					p += 6;
+				}
+			}
+			i = put_utf8(out + n, size - 1 - n, cp);
+			if (i == 0)
+				goto exit;
+			n += i;
+			break;
+		}
+		default:
+			out[n++] = c;	/* \" \\ \/ */
+			break;
+		}
+	}
+
+exit:
+	out[n] = '\0';
+	return n;
+}
@@ -0,0 +1,242 @@
+/*
+@file
+@brief streaming JSON writer, see json_writer.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json_writer.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define JW_MIN_CAP	256
+
+void jw_init(struct json_writer *w)
+{
+	memset(w, 0, sizeof(*w));
+}
+
+void jw_free(struct json_writer *w)
+{
+	free(w->buf);
+	memset(w, 0, sizeof(*w));
+}
+
+void jw_reset(struct json_writer *w)
+{
+	w->len = 0;
+	w->depth = 0;
+	w->after_key = 0;
+	w->need_comma[0] = 0;
+	w->err = 0;
+	if (w->buf)
+		w->buf[0] = '\0';
+}
+
+/* room for n more bytes and the NUL */
+static int reserve(struct json_writer *w, size_t n)
+{
+	size_t cap;
+	char *p;
+
+	if (w->err)
+		return -1;
+	if (w->len + n + 1 <= w->cap)
+		return 0;
+	cap = w->cap ? w->cap : JW_MIN_CAP;
+	while (cap < w->len + n + 1)
+		cap *= 2;
+	p = (char *)realloc(w->buf, cap);
+	if (!p) {
+		w->err = 1;
+		return -1;
+	}
+	w->buf = p;
+	w->cap = cap;
+	return 0;
+}
+
+static void put(struct json_writer *w, const char *s, size_t n)
+{
+	if (reserve(w, n))
+		return;
+	memcpy(w->buf + w->len, s, n);
+	w->len += n;
+	w->buf[w->len] = '\0';
+}
+
+/* comma before every value but the first of its container */
+static void begin_value(struct json_writer *w)
+{
+	if (w->after_key) {
+		w->after_key = 0;
+		return;
+	}
+	if (w->need_comma[w->depth])
+		put(w, ",", 1);
+	w->need_comma[w->depth] = 1;
+}
+
+static void open_container(struct json_writer *w, char c)
+{
+	begin_value(w);
+	if (w->depth + 1 >= JW_MAX_DEPTH) {
+		w->err = 1;
+		return;
+	}
+	put(w, &c, 1);
+	w->need_comma[++w->depth] = 0;
+}
+
+static void close_container(struct json_writer *w, char c)
+{
+	if (w->depth == 0) {
+		w->err = 1;
+		return;
+	}
+	w->depth--;
+	put(w, &c, 1);
+}
+
+void jw_begin_object(struct json_writer *w)
+{
+	open_container(w, '{');
+}
+
+void jw_end_object(struct json_writer *w)
+{
+	close_container(w, '}');
+}
+
+void jw_begin_array(struct json_writer *w)
+{
+	open_container(w, '[');
+}
+
+void jw_end_array(struct json_writer *w)
+{
+	close_container(w, ']');
+}
+
+static int needs_escape(unsigned char c)
+{
+	return c < 0x20 || c == '"' || c == '\\';
+}
+
+/* index of the first byte from i on that needs escaping, len if none */
+static size_t plain_run(const char *s, size_t i, size_t len)
+{
+#if defined(__SSE2__)
+	/* sixteen bytes at once: control characters, quotes, backslashes */
+	const __m128i ctl = _mm_set1_epi8(0x1f);
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i bslash = _mm_set1_epi8('\\');
+
+	while (len - i >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		__m128i m = _mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl);
+		int bits;
+
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, quote));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, bslash));
+		bits = _mm_movemask_epi8(m);
+		if (bits)
+			return i + __builtin_ctz(bits);
+		i += 16;
+	}
+#endif
+	while (i < len && !needs_escape(s[i]))
+		i++;
+	return i;
+}
+
+/* quotes, backslashes and control characters are escaped, UTF-8 is
+ * copied as is. the runs in between go with one memcpy */
+static void put_escaped(struct json_writer *w, const char *s, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t i, run = 0;
+	char esc[6];
+	size_t n;
+
+	/* at worst every byte becomes \u00xx */
+	if (reserve(w, len * 6 + 2))
+		return;
+	w->buf[w->len++] = '"';
+	for (i = 0; (i = plain_run(s, i, len)) < len; i++) {
+		unsigned char c = s[i];
+
+		memcpy(w->buf + w->len, s + run, i - run);
+		w->len += i - run;
+		run = i + 1;
+		esc[0] = '\\';
+		n = 2;
+		switch (c) {
+		case '"': esc[1] = '"'; break;
+		case '\\': esc[1] = '\\'; break;
+		case '\n': esc[1] = 'n'; break;
+		case '\r': esc[1] = 'r'; break;
+		case '\t': esc[1] = 't'; break;
+		case '\b': esc[1] = 'b'; break;
+		case '\f': esc[1] = 'f'; break;
+		default:
+			memcpy(esc + 1, "u00", 3);
+			esc[4] = hex[c >> 4];
+			esc[5] = hex[c & 0xf];
+			n = 6;
+			break;
+		}
+		memcpy(w->buf + w->len, esc, n);
+		w->len += n;
+	}
+	memcpy(w->buf + w->len, s + run, len - run);
+	w->len += len - run;
+	w->buf[w->len++] = '"';
+	w->buf[w->len] = '\0';
+}
+
+void jw_key(struct json_writer *w, const char *key)
+{
+	begin_value(w);
+	put_escaped(w, key, strlen(key));
+	put(w, ":", 1);
+	w->after_key = 1;
+}
+
+void jw_string(struct json_writer *w, const char *s, size_t len)
+{
+	begin_value(w);
+	put_escaped(w, s, len);
+}
+
+void jw_long(struct json_writer *w, long v)
+{
+	char num[24];
+	int n = snprintf(num, sizeof(num), "%ld", v);
+
+	begin_value(w);
+	put(w, num, n);
+}
+
+void jw_bool(struct json_writer *w, int v)
+{
+	begin_value(w);
+	if (v)
+		put(w, "true", 4);
+	else
+		put(w, "false", 5);
+}
+
+void jw_member_string(struct json_writer *w, const char *key, const char *s)
+{
+	jw_key(w, key);
+	jw_string(w, s, strlen(s));
+}
+
+void jw_member_long(struct json_writer *w, const char *key, long v)
+{
+	jw_key(w, key);
+	jw_long(w, v);
+}
@@ -0,0 +1,81 @@
+/*
+@file
+@brief latency recorder, see latency_stats.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "latency_stats.h"
+
+double lat_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void lat_init(struct latency_stats *st, const char *name)
+{
+	memset(st, 0, sizeof(*st));
+	st->name = name;
+}
+
+void lat_add(struct latency_stats *st, double ms)
+{
+	st->samples[st->next] = ms;
+	st->next = (st->next + 1) % LAT_MAX_SAMPLES;
+	st->count++;
+	st->sum += ms;
+	if (ms > st->max)
+		st->max = ms;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+double lat_percentile(const struct latency_stats *st, double p)
+{
+	double sorted[LAT_MAX_SAMPLES];
+	unsigned int n;
+	unsigned int idx;
+
+	n = st->count < LAT_MAX_SAMPLES ? (unsigned int)st->count : LAT_MAX_SAMPLES;
+	if (n == 0)
+		return 0;
+
+	memcpy(sorted, st->samples, n * sizeof(double));
+	qsort(sorted, n, sizeof(double), cmp_double);
+
+	idx = (unsigned int)(p / 100.0 * (n - 1) + 0.5);
+	if (idx >= n)
+		idx = n - 1;
+	return sorted[idx];
+}
+
+double lat_mean(const struct latency_stats *st)
+{
+	return st->count ? st->sum / st->count : 0;
+}
+
+void lat_report(const struct latency_stats *st)
+{
+	double last;
+
+	if (st->count == 0) {
+		printf("[lat] %s n=0\n", st->name);
+		return;
+	}
+
+	last = st->samples[(st->next + LAT_MAX_SAMPLES - 1) % LAT_MAX_SAMPLES];
+	printf("[lat] %s n=%lu last=%.1fms mean=%.1fms p50=%.1fms p95=%.1fms max=%.1fms\n",
+		st->name, st->count, last, lat_mean(st),
+		lat_percentile(st, 50), lat_percentile(st, 95), st->max);
+}
@@ -0,0 +1,599 @@
+/*
+@file
+@brief offline command spotter: MFCC front end, energy endpointer and
+	subsequence DTW against user recorded templates. see local_kws.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "local_kws.h"
+#include "latency_stats.h"
+
+#define KWS_DBGON 0
+#if KWS_DBGON == 1
+#	define kws_dbg printf
+#else
+#	define kws_dbg(...)
+#endif
+
+#define FRAME_MAX	512	/* 25ms at 16k fits, so does the fft */
+#define NUM_MEL		26
+#define PREEMPH		0.97f
+
+/* endpointer, in 10ms frames / dB */
+#define VOICED_DB_ABOVE_NOISE	12.0f
+#define VOICED_DB_MIN		35.0f
+#define SPEECH_START_FRAMES	3
+#define SEGMENT_PAD_FRAMES	5
+
+enum {
+	KS_SILENCE,
+	KS_SPEECH,
+	KS_DONE
+};
+
+struct kws_template {
+	int code;
+	int frames;
+	float *feat;		/* frames * KWS_NUM_CEPS */
+};
+
+struct kws_engine {
+	struct kws_config cfg;
+	int frame_len;
+	int hop;
+	int fft_size;
+	float window[FRAME_MAX];
+	float mel[NUM_MEL][FRAME_MAX / 2 + 1];
+	float dct[KWS_NUM_CEPS][NUM_MEL];
+
+	struct kws_template tpl[KWS_MAX_TEMPLATES];
+	int ntpl;
+
+	/* per utterance state */
+	short pcm[FRAME_MAX];
+	int fill;
+	float feat[KWS_MAX_FRAMES][KWS_NUM_CEPS];
+	int nframes;		/* frames stored in feat */
+	int total;		/* frames seen, may exceed KWS_MAX_FRAMES */
+	float noise_db;
+	int voiced_run;
+	int speech_start;
+	int last_voiced;
+	int state;
+	int decision;
+	struct kws_result result;
+
+	/* scratch for matching, kept here so feeding never allocates */
+	float seg[KWS_MAX_FRAMES][KWS_NUM_CEPS];
+	float dtw_prev[KWS_MAX_FRAMES];
+	float dtw_cur[KWS_MAX_FRAMES];
+	int start_prev[KWS_MAX_FRAMES];
+	int start_cur[KWS_MAX_FRAMES];
+	float cost[KWS_MAX_TEMPLATES];
+};
+
+void kws_default_config(struct kws_config *cfg)
+{
+	cfg->sample_rate = 16000;
+	cfg->trailing_ms = 300;
+	cfg->max_cost = 12.0f;
+	cfg->min_confidence = 0.15f;
+}
+
+static float hz_to_mel(float hz)
+{
+	return 1127.0f * logf(1.0f + hz / 700.0f);
+}
+
+static float mel_to_hz(float mel)
+{
+	return 700.0f * (expf(mel / 1127.0f) - 1.0f);
+}
+
+static void init_front_end(struct kws_engine *eng)
+{
+	int i, k;
+	int nbins;
+	float lo, hi;
+	float centers[NUM_MEL + 2];
+
+	eng->frame_len = eng->cfg.sample_rate * 25 / 1000;
+	eng->hop = eng->cfg.sample_rate / 100;
+	if (eng->frame_len > FRAME_MAX)
+		eng->frame_len = FRAME_MAX;
+	eng->fft_size = 2;
+	while (eng->fft_size < eng->frame_len)
+		eng->fft_size <<= 1;
+
+	for (i = 0; i < eng->frame_len; i++)
+		eng->window[i] = 0.54f - 0.46f * cosf(2.0f * (float)M_PI * i / (eng->frame_len - 1));
+
+	/* triangular mel filters over the positive fft bins */
+	nbins = eng->fft_size / 2 + 1;
+	lo = hz_to_mel(20.0f);
+	hi = hz_to_mel(eng->cfg.sample_rate / 2.0f);
+	for (i = 0; i < NUM_MEL + 2; i++)
+		centers[i] = mel_to_hz(lo + (hi - lo) * i / (NUM_MEL + 1)) * eng->fft_size / eng->cfg.sample_rate;
+
+	for (i = 0; i < NUM_MEL; i++) {
+		for (k = 0; k < nbins; k++) {
+			float w = 0;
+			if (k > centers[i] && k <= centers[i + 1])
+				w = (k - centers[i]) / (centers[i + 1] - centers[i]);
+			else if (k > centers[i + 1] && k < centers[i + 2])
+				w = (centers[i + 2] - k) / (centers[i + 2] - centers[i + 1]);
+			eng->mel[i][k] = w;
+		}
+	}
+
+	for (i = 0; i < KWS_NUM_CEPS; i++)
+		for (k = 0; k < NUM_MEL; k++)
+			eng->dct[i][k] = cosf((float)M_PI * i * (k + 0.5f) / NUM_MEL);
+}
+
+/* in place radix-2 complex fft, n is a power of 2 */
+static void fft(float *re, float *im, int n)
+{
+	int i, j, k, len;
+
+	for (i = 1, j = 0; i < n; i++) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+		if (i < j) {
+			float t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	for (len = 2; len <= n; len <<= 1) {
+		float ang = -2.0f * (float)M_PI / len;
+		float wr = cosf(ang), wi = sinf(ang);
+		for (i = 0; i < n; i += len) {
+			float cr = 1.0f, ci = 0.0f;
+			for (k = 0; k < len / 2; k++) {
+				int a = i + k, b = i + k + len / 2;
+				float tr = re[b] * cr - im[b] * ci;
+				float ti = re[b] * ci + im[b] * cr;
+				float nr;
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+				nr = cr * wr - ci * wi;
+				ci = cr * wi + ci * wr;
+				cr = nr;
+			}
+		}
+	}
+}
+
+/* one frame of pcm -> KWS_NUM_CEPS cepstra, returns frame energy in dB */
+static float compute_frame(const struct kws_engine *eng, const short *pcm, float *ceps)
+{
+	float re[FRAME_MAX], im[FRAME_MAX];
+	float logmel[NUM_MEL];
+	float power = 0;
+	int i, k;
+	int nbins = eng->fft_size / 2 + 1;
+
+	for (i = 0; i < eng->fft_size; i++) {
+		float x = 0;
+		if (i < eng->frame_len) {
+			x = pcm[i];
+			power += x * x;
+			x -= PREEMPH * (i ? pcm[i - 1] : pcm[0]);
+			x *= eng->window[i];
+		}
+		re[i] = x;
+		im[i] = 0;
+	}
+	fft(re, im, eng->fft_size);
+
+	for (i = 0; i < NUM_MEL; i++) {
+		float e = 0;
+		for (k = 0; k < nbins; k++) {
+			if (eng->mel[i][k] != 0)
+				e += eng->mel[i][k] * (re[k] * re[k] + im[k] * im[k]);
+		}
+		logmel[i] = logf(e + 1e-3f);
+	}
+
+	for (i = 0; i < KWS_NUM_CEPS; i++) {
+		float c = 0;
+		for (k = 0; k < NUM_MEL; k++)
+			c += eng->dct[i][k] * logmel[k];
+		ceps[i] = c;
+	}
+
+	return 10.0f * log10f(power / eng->frame_len + 1e-9f);
+}
+
+/* cepstral mean normalisation, removes channel and gain differences */
+static void cmn(float (*feat)[KWS_NUM_CEPS], int frames)
+{
+	float mean[KWS_NUM_CEPS] = { 0 };
+	int i, k;
+
+	if (frames <= 0)
+		return;
+	for (i = 0; i < frames; i++)
+		for (k = 0; k < KWS_NUM_CEPS; k++)
+			mean[k] += feat[i][k];
+	for (k = 0; k < KWS_NUM_CEPS; k++)
+		mean[k] /= frames;
+	for (i = 0; i < frames; i++)
+		for (k = 0; k < KWS_NUM_CEPS; k++)
+			feat[i][k] -= mean[k];
+}
+
+int kws_create(struct kws_engine **out, const struct kws_config *cfg)
+{
+	struct kws_engine *eng;
+
+	if (!out || !cfg || cfg->sample_rate == 0)
+		return -1;
+
+	eng = (struct kws_engine *)calloc(1, sizeof(struct kws_engine));
+	if (!eng)
+		return -1;
+	eng->cfg = *cfg;
+	init_front_end(eng);
+	kws_reset(eng);
+
+	*out = eng;
+	return 0;
+}
+
+void kws_destroy(struct kws_engine *eng)
+{
+	int i;
+
+	if (!eng)
+		return;
+	for (i = 0; i < eng->ntpl; i++)
+		free(eng->tpl[i].feat);
+	free(eng);
+}
+
+int kws_add_template(struct kws_engine *eng, int code, const short *pcm, size_t samples)
+{
+	struct kws_template *tpl;
+	float (*feat)[KWS_NUM_CEPS];
+	float *energy;
+	float noise = 1e9f;
+	int frames, first = -1, last = -1;
+	int i;
+
+	if (eng->ntpl >= KWS_MAX_TEMPLATES || samples < (size_t)eng->frame_len)
+		return -1;
+
+	frames = (samples - eng->frame_len) / eng->hop + 1;
+	if (frames > KWS_MAX_FRAMES)
+		frames = KWS_MAX_FRAMES;
+
+	feat = (float (*)[KWS_NUM_CEPS])malloc(frames * sizeof(*feat));
+	energy = (float *)malloc(frames * sizeof(float));
+	if (!feat || !energy) {
+		free(feat);
+		free(energy);
+		return -1;
+	}
+
+	for (i = 0; i < frames; i++) {
+		energy[i] = compute_frame(eng, pcm + i * eng->hop, feat[i]);
+		if (energy[i] < noise)
+			noise = energy[i];
+	}
+
+	/* trim leading/trailing silence the same way the live endpointer does */
+	for (i = 0; i < frames; i++) {
+		if (energy[i] > noise + VOICED_DB_ABOVE_NOISE && energy[i] > VOICED_DB_MIN) {
+			if (first < 0)
+				first = i;
+			last = i;
+		}
+	}
+	free(energy);
+	if (first < 0) {
+		printf("kws: template for %d has no speech\n", code);
+		free(feat);
+		return -1;
+	}
+	first = first > SEGMENT_PAD_FRAMES ? first - SEGMENT_PAD_FRAMES : 0;
+	last = last + SEGMENT_PAD_FRAMES < frames ? last + SEGMENT_PAD_FRAMES : frames - 1;
+
+	memmove(feat[0], feat[first], (last - first + 1) * sizeof(*feat));
+	cmn(feat, last - first + 1);
+
+	tpl = &eng->tpl[eng->ntpl++];
+	tpl->code = code;
+	tpl->frames = last - first + 1;
+	tpl->feat = (float *)feat;
+	return 0;
+}
+
+/* 16 bit mono pcm out of a RIFF/WAVE file, caller frees *pcm */
+static int read_wav(const char *path, unsigned int rate, short **pcm, size_t *samples)
+{
+	FILE *f;
+	char id[4];
+	unsigned int size;
+	unsigned short channels = 0, bits = 0;
+	unsigned int file_rate = 0;
+	int ret = -1;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return -1;
+
+	if (fread(id, 1, 4, f) != 4 || memcmp(id, "RIFF", 4)
+		|| fread(&size, 4, 1, f) != 1
+		|| fread(id, 1, 4, f) != 4 || memcmp(id, "WAVE", 4))
+		goto exit;
+
+	while (fread(id, 1, 4, f) == 4 && fread(&size, 4, 1, f) == 1) {
+		if (!memcmp(id, "fmt ", 4)) {
+			unsigned char fmt[16];
+			if (size < 16 || fread(fmt, 1, 16, f) != 16)
+				goto exit;
+			memcpy(&channels, fmt + 2, 2);
+			memcpy(&file_rate, fmt + 4, 4);
+			memcpy(&bits, fmt + 14, 2);
+			fseek(f, size - 16 + (size & 1), SEEK_CUR);
+		} else if (!memcmp(id, "data", 4)) {
+			if (channels != 1 || bits != 16 || file_rate != rate) {
+				printf("kws: %s must be 16 bit mono %uHz\n", path, rate);
+				goto exit;
+			}
+			*pcm = (short *)malloc(size);
+			if (!*pcm)
+				goto exit;
+			*samples = fread(*pcm, 2, size / 2, f);
+			ret = 0;
+			goto exit;
+		} else {
+			fseek(f, size + (size & 1), SEEK_CUR);
+		}
+	}
+
+exit:
+	fclose(f);
+	return ret;
+}
+
+int kws_load_templates(struct kws_engine *eng, const char *dir, int code)
+{
+	char path[512];
+	short *pcm;
+	size_t samples;
+	int loaded = 0;
+	int n;
+
+	for (n = 0; n <= 9; n++) {
+		if (n == 0)
+			snprintf(path, sizeof(path), "%s/%d.wav", dir, code);
+		else
+			snprintf(path, sizeof(path), "%s/%d_%d.wav", dir, code, n);
+
+		pcm = NULL;
+		if (read_wav(path, eng->cfg.sample_rate, &pcm, &samples))
+			continue;
+		if (kws_add_template(eng, code, pcm, samples) == 0) {
+			kws_dbg("kws: template %s %d frames\n", path, eng->tpl[eng->ntpl - 1].frames);
+			loaded++;
+		}
+		free(pcm);
+	}
+
+	return loaded;
+}
+
+int kws_template_count(const struct kws_engine *eng)
+{
+	return eng->ntpl;
+}
+
+void kws_reset(struct kws_engine *eng)
+{
+	eng->fill = 0;
+	eng->nframes = 0;
+	eng->total = 0;
+	eng->noise_db = 1e9f;
+	eng->voiced_run = 0;
+	eng->speech_start = 0;
+	eng->last_voiced = 0;
+	eng->state = KS_SILENCE;
+	eng->decision = KWS_LISTENING;
+	memset(&eng->result, 0, sizeof(eng->result));
+	eng->result.code = -1;
+}
+
+/* symmetric subsequence DTW, normalised by path length. the template may
+ * match anywhere inside the segment */
+static float dtw_cost(struct kws_engine *eng, const struct kws_template *tpl, int n)
+{
+	const float (*t)[KWS_NUM_CEPS] = (const float (*)[KWS_NUM_CEPS])tpl->feat;
+	float *prev = eng->dtw_prev, *cur = eng->dtw_cur;
+	int *sprev = eng->start_prev, *scur = eng->start_cur;
+	float best = 1e30f;
+	int i, j, k;
+
+	for (i = 0; i < tpl->frames; i++) {
+		for (j = 0; j < n; j++) {
+			float d = 0, c;
+			int s;
+			for (k = 0; k < KWS_NUM_CEPS; k++) {
+				float diff = t[i][k] - eng->seg[j][k];
+				d += diff * diff;
+			}
+			d = sqrtf(d);
+
+			if (i == 0) {
+				/* free start anywhere in the segment */
+				c = d;
+				s = j;
+			} else {
+				c = prev[j] + d;
+				s = sprev[j];
+				if (j > 0 && prev[j - 1] + 2 * d < c) {
+					c = prev[j - 1] + 2 * d;
+					s = sprev[j - 1];
+				}
+				if (j > 0 && cur[j - 1] + d < c) {
+					c = cur[j - 1] + d;
+					s = scur[j - 1];
+				}
+			}
+			cur[j] = c;
+			scur[j] = s;
+		}
+		float *tf = prev; prev = cur; cur = tf;
+		int *ti = sprev; sprev = scur; scur = ti;
+	}
+
+	/* prev holds the last template row */
+	for (j = 0; j < n; j++) {
+		int len = j - sprev[j] + 1;
+		float c;
+		if (len * 2 < tpl->frames || len > tpl->frames * 2)
+			continue;
+		c = prev[j] / (tpl->frames + len);
+		if (c < best)
+			best = c;
+	}
+	return best;
+}
+
+static void match_utterance(struct kws_engine *eng)
+{
+	float best = 1e30f, second = 1e30f;
+	int best_code = -1;
+	int s, e, n, i;
+
+	s = eng->speech_start > SEGMENT_PAD_FRAMES ? eng->speech_start - SEGMENT_PAD_FRAMES : 0;
+	e = eng->last_voiced + SEGMENT_PAD_FRAMES < eng->nframes ? eng->last_voiced + SEGMENT_PAD_FRAMES : eng->nframes - 1;
+	n = e - s + 1;
+	if (n <= 0 || eng->ntpl == 0) {
+		eng->decision = KWS_REJECTED;
+		return;
+	}
+
+	memcpy(eng->seg[0], eng->feat[s], n * sizeof(eng->seg[0]));
+	cmn(eng->seg, n);
+
+	/* best template overall, then the best template of any other code */
+	for (i = 0; i < eng->ntpl; i++) {
+		eng->cost[i] = dtw_cost(eng, &eng->tpl[i], n);
+		if (eng->cost[i] < best) {
+			best = eng->cost[i];
+			best_code = eng->tpl[i].code;
+		}
+	}
+	for (i = 0; i < eng->ntpl; i++) {
+		if (eng->tpl[i].code != best_code && eng->cost[i] < second)
+			second = eng->cost[i];
+	}
+	if (second >= 1e30f)
+		second = eng->cfg.max_cost * 2;
+
+	eng->result.code = best_code;
+	eng->result.cost = best;
+	eng->result.confidence = second > 0 ? (second - best) / second : 0;
+
+	kws_dbg("kws: best code=%d cost=%.2f second=%.2f conf=%.2f\n",
+		best_code, best, second, eng->result.confidence);
+
+	if (best_code >= 0 && best <= eng->cfg.max_cost
+		&& eng->result.confidence >= eng->cfg.min_confidence)
+		eng->decision = KWS_FIRED;
+	else
+		eng->decision = KWS_REJECTED;
+}
+
+static void process_frame(struct kws_engine *eng, const short *pcm)
+{
+	float scratch[KWS_NUM_CEPS];
+	float *ceps = eng->nframes < KWS_MAX_FRAMES ? eng->feat[eng->nframes] : scratch;
+	float e = compute_frame(eng, pcm, ceps);
+	int frame = eng->total++;
+	int voiced;
+
+	if (eng->nframes < KWS_MAX_FRAMES)
+		eng->nframes++;
+
+	/* noise floor follows quiet frames down fast and up slowly */
+	if (e < eng->noise_db)
+		eng->noise_db = e;
+	else if (eng->state == KS_SILENCE)
+		eng->noise_db += 0.01f * (e - eng->noise_db);
+
+	voiced = e > eng->noise_db + VOICED_DB_ABOVE_NOISE && e > VOICED_DB_MIN;
+
+	switch (eng->state) {
+	case KS_SILENCE:
+		eng->voiced_run = voiced ? eng->voiced_run + 1 : 0;
+		if (eng->voiced_run >= SPEECH_START_FRAMES) {
+			eng->speech_start = frame - SPEECH_START_FRAMES + 1;
+			eng->last_voiced = frame;
+			eng->state = KS_SPEECH;
+		}
+		break;
+	case KS_SPEECH:
+		if (voiced) {
+			eng->last_voiced = frame;
+		} else if ((frame - eng->last_voiced) * 10 >= (int)eng->cfg.trailing_ms) {
+			eng->state = KS_DONE;
+			eng->result.speech_end_ms = lat_now_ms() - (frame - eng->last_voiced) * 10;
+			if (eng->total > KWS_MAX_FRAMES)
+				eng->decision = KWS_REJECTED;	/* too long for a command */
+			else
+				match_utterance(eng);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+int kws_feed(struct kws_engine *eng, const char *data, unsigned long len)
+{
+	const short *pcm = (const short *)data;
+	unsigned long samples = len / 2;
+	unsigned long i = 0;
+
+	if (eng->state == KS_DONE)
+		return eng->decision;
+
+	while (i < samples && eng->state != KS_DONE) {
+		int take = eng->frame_len - eng->fill;
+		if ((unsigned long)take > samples - i)
+			take = samples - i;
+		memcpy(eng->pcm + eng->fill, pcm + i, take * sizeof(short));
+		eng->fill += take;
+		i += take;
+
+		if (eng->fill == eng->frame_len) {
+			process_frame(eng, eng->pcm);
+			memmove(eng->pcm, eng->pcm + eng->hop, (eng->frame_len - eng->hop) * sizeof(short));
+			eng->fill -= eng->hop;
+		}
+	}
+
+	return eng->decision;
+}
+
+int kws_get_result(const struct kws_engine *eng, struct kws_result *res)
+{
+	*res = eng->result;
+	return eng->decision;
+}
+
+double kws_speech_end_ms(const struct kws_engine *eng)
+{
+	return eng->state == KS_DONE ? eng->result.speech_end_ms : 0;
+}
@@ -0,0 +1,170 @@
+/*
+@file
+@brief local skill registry and the built-in skills, see local_skill.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "local_skill.h"
+#include "text_norm.h"
+
+#define SKILL_TEXT_LEN	512
+
+void skill_init(struct skill_registry *reg)
+{
+	memset(reg, 0, sizeof(*reg));
+}
+
+int skill_register(struct skill_registry *reg, const char *name,
+		const char *const *keys, skill_fn fn, void *user)
+{
+	struct skill *sk;
+	int i;
+
+	if (reg->count >= SKILL_MAX)
+		return -1;
+	sk = &reg->skills[reg->count];
+	memset(sk, 0, sizeof(*sk));
+	strncpy(sk->name, name, sizeof(sk->name) - 1);
+	for (i = 0; keys[i] && i < SKILL_KEYS - 1; i++)
+		sk->keys[i] = keys[i];
+	sk->fn = fn;
+	sk->user = user;
+	lat_init(&sk->lat, sk->name);
+	return reg->count++;
+}
+
+static int has_key(const struct skill *sk, const char *text)
+{
+	int i;
+
+	for (i = 0; sk->keys[i]; i++) {
+		if (strstr(text, sk->keys[i]))
+			return 1;
+	}
+	return 0;
+}
+
+int skill_answer(struct skill_registry *reg, const char *text, size_t len,
+		char *answer, size_t size)
+{
+	char norm[SKILL_TEXT_LEN];
+	double t0 = lat_now_ms();
+	int i;
+
+	tn_normalize(text, len, norm, sizeof(norm), NULL, NULL);
+	for (i = 0; i < reg->count; i++) {
+		struct skill *sk = &reg->skills[i];
+
+		if (!has_key(sk, norm) || sk->fn(norm, answer, size, sk->user) == 0)
+			continue;
+		sk->hits++;
+		lat_add(&sk->lat, lat_now_ms() - t0);
+		return i;
+	}
+	return -1;
+}
+
+void skill_report(const struct skill_registry *reg)
+{
+	int i;
+
+	for (i = 0; i < reg->count; i++) {
+		printf("[skill] %s %u hits\n", reg->skills[i].name, reg->skills[i].hits);
+		if (reg->skills[i].hits)
+			lat_report(&reg->skills[i].lat);
+	}
+}
+
+/* 明天 / 后天 / 昨天 / 前天, text is normalized */
+static int day_offset(const char *text, const char **day)
+{
+	static const struct { const char *word; int offset; } days[] = {
+		{ "大后天", 3 }, { "后天", 2 }, { "明天", 1 },
+		{ "大前天", -3 }, { "前天", -2 }, { "昨天", -1 },
+	};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(days) / sizeof(days[0]); i++) {
+		if (strstr(text, days[i].word)) {
+			*day = days[i].word;
+			return days[i].offset;
+		}
+	}
+	*day = "今天";
+	return 0;
+}
+
+static struct tm local_day(int offset)
+{
+	time_t t = time(NULL) + offset * 86400;
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	return tm;
+}
+
+static size_t weekday_skill(const char *text, char *answer, size_t size, void *)
+{
+	static const char *const names[] = { "日", "一", "二", "三", "四", "五", "六" };
+	const char *day;
+	struct tm tm = local_day(day_offset(text, &day));
+	int n;
+
+	n = snprintf(answer, size, "%s是星期%s", day, names[tm.tm_wday]);
+	return n > 0 && (size_t)n < size ? n : 0;
+}
+
+static size_t date_skill(const char *text, char *answer, size_t size, void *)
+{
+	const char *day;
+	struct tm tm = local_day(day_offset(text, &day));
+	int n;
+
+	n = snprintf(answer, size, "%s是%d年%d月%d日", day,
+		tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+	return n > 0 && (size_t)n < size ? n : 0;
+}
+
+static size_t time_skill(const char *text, char *answer, size_t size, void *)
+{
+	struct tm tm = local_day(0);
+	int n;
+
+	/* "现在时间" yes, "有时间吗" is not ours */
+	if (strstr(text, "时间") && !strstr(text, "现在") && !strstr(text, "几点")
+		&& !strstr(text, "多少"))
+		return 0;
+	if (tm.tm_min == 0)
+		n = snprintf(answer, size, "现在是%d点整", tm.tm_hour);
+	else
+		n = snprintf(answer, size, "现在是%d点%d分", tm.tm_hour, tm.tm_min);
+	return n > 0 && (size_t)n < size ? n : 0;
+}
+
+static size_t name_skill(const char *text, char *answer, size_t size, void *user)
+{
+	const char *name = (const char *)user;
+	int n;
+
+	/* "我的名字" is about the user */
+	if (strstr(text, "我的名字") || strstr(text, "我叫"))
+		return 0;
+	n = snprintf(answer, size, "我叫%s", name);
+	return n > 0 && (size_t)n < size ? n : 0;
+}
+
+void skill_register_builtin(struct skill_registry *reg, const char *robot_name)
+{
+	/* weekday before date, "今天星期几" has both */
+	static const char *const weekday_keys[] = { "星期几", "礼拜几", "周几", NULL };
+	static const char *const date_keys[] = { "几号", "几月", "日期", "多少号", NULL };
+	static const char *const time_keys[] = { "几点", "时间", NULL };
+	static const char *const name_keys[] = { "名字", "叫什么", "叫啥", "你是谁", NULL };
+
+	skill_register(reg, "skill weekday", weekday_keys, weekday_skill, NULL);
+	skill_register(reg, "skill date", date_keys, date_skill, NULL);
+	skill_register(reg, "skill time", time_keys, time_skill, NULL);
+	skill_register(reg, "skill name", name_keys, name_skill, (void *)robot_name);
+}
@@ -0,0 +1,214 @@
+/*
+@file
+@brief fixed-rate motion executor, see motion_exec.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include "motion_exec.h"
+
+#define MOTION_EPS	1e-3
+
+static void add_ms(struct timespec *ts, double ms)
+{
+	long ns = ts->tv_nsec + (long)(ms * 1000000.0);
+
+	ts->tv_sec += ns / 1000000000L;
+	ts->tv_nsec = ns % 1000000000L;
+}
+
+static double ts_ms(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000.0 + ts->tv_nsec / 1000000.0;
+}
+
+/* move cur toward target by at most step */
+static double slew(double cur, double target, double step)
+{
+	if (target > cur + step)
+		return cur + step;
+	if (target < cur - step)
+		return cur - step;
+	return target;
+}
+
+/* the fastest speed from which acc brings us to rest within what is
+ * left of the goal */
+static double brake_limit(double acc, double left_dist, double left_ms)
+{
+	if (left_dist >= 0)
+		return sqrt(2.0 * acc * left_dist);
+	return acc * left_ms / 1000.0;
+}
+
+/* one control period, lock held. returns 0 once the goal is done */
+static int step(struct motion_exec *m, double now_ms, double dt)
+{
+	const struct motion_goal *g = &m->goal;
+	double left_dist = -1, left_ms = 0;
+	double tvx = g->vx, twz = g->wz;
+	double lim;
+
+	if (g->vx == 0 && g->wz == 0) {
+		/* nothing would ever be covered: to rest, then done */
+		left_dist = 0;
+	} else if (g->distance > 0) {
+		left_dist = g->distance - m->travelled;
+		if (left_dist < 0)
+			left_dist = 0;
+	} else {
+		left_ms = g->duration_ms - (now_ms - m->start_ms);
+		if (left_ms < 0)
+			left_ms = 0;
+	}
+
+	/* ramp down in time to end at rest */
+	lim = brake_limit(m->acc_lin, left_dist, left_ms);
+	if (fabs(tvx) > lim)
+		tvx = tvx > 0 ? lim : -lim;
+	lim = brake_limit(m->acc_ang, left_dist, left_ms);
+	if (fabs(twz) > lim)
+		twz = twz > 0 ? lim : -lim;
+
+	m->vx = slew(m->vx, tvx, m->acc_lin * dt);
+	m->wz = slew(m->wz, twz, m->acc_ang * dt);
+	m->travelled += (g->vx != 0 ? fabs(m->vx) : fabs(m->wz)) * dt;
+
+	return fabs(m->vx) > MOTION_EPS || fabs(m->wz) > MOTION_EPS
+		|| (left_dist > MOTION_EPS) || (left_dist < 0 && left_ms > 0);
+}
+
+static void *motion_proc(void *arg)
+{
+	struct motion_exec *m = (struct motion_exec *)arg;
+	double period = 1000.0 / m->rate_hz;
+	struct timespec deadline, now;
+	int more;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	pthread_mutex_lock(&m->lock);
+	while (!m->quit) {
+		if (!m->active) {
+			pthread_cond_wait(&m->cond, &m->lock);
+			/* a new goal ticks at once */
+			clock_gettime(CLOCK_MONOTONIC, &deadline);
+			continue;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (ts_ms(&now) < ts_ms(&deadline)) {
+			/* stop and new goals wake us early */
+			if (pthread_cond_timedwait(&m->cond, &m->lock, &deadline) != ETIMEDOUT)
+				continue;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+		}
+
+		lat_add(&m->jitter, ts_ms(&now) - ts_ms(&deadline));
+		m->ticks++;
+		if (ts_ms(&now) - ts_ms(&deadline) > period) {
+			/* missed ticks are not caught up, the next one is a period away */
+			m->overruns++;
+			deadline = now;
+		}
+		add_ms(&deadline, period);
+
+		more = step(m, ts_ms(&now), period / 1000.0);
+		if (!more) {
+			m->active = 0;
+			m->vx = m->wz = 0;
+		}
+		/* under the lock, so a stop is never overtaken by a late setpoint */
+		m->send(m->vx, m->wz, m->user);
+	}
+	pthread_mutex_unlock(&m->lock);
+	return NULL;
+}
+
+int motion_init(struct motion_exec *m, int rate_hz, double acc_lin, double acc_ang,
+		motion_send_cb send, void *user)
+{
+	pthread_condattr_t attr;
+
+	memset(m, 0, sizeof(*m));
+	m->rate_hz = rate_hz > 0 ? rate_hz : 20;
+	m->acc_lin = acc_lin;
+	m->acc_ang = acc_ang;
+	m->send = send;
+	m->user = user;
+	lat_init(&m->jitter, "motion tick jitter");
+
+	pthread_mutex_init(&m->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&m->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if (pthread_create(&m->thread, NULL, motion_proc, m)) {
+		pthread_cond_destroy(&m->cond);
+		pthread_mutex_destroy(&m->lock);
+		return -1;
+	}
+	return 0;
+}
+
+void motion_destroy(struct motion_exec *m)
+{
+	pthread_mutex_lock(&m->lock);
+	m->quit = 1;
+	pthread_cond_signal(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+	pthread_join(m->thread, NULL);
+	pthread_cond_destroy(&m->cond);
+	pthread_mutex_destroy(&m->lock);
+}
+
+void motion_start(struct motion_exec *m, const struct motion_goal *goal)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	pthread_mutex_lock(&m->lock);
+	if (m->active)
+		m->preempted++;
+	m->goal = *goal;
+	m->start_ms = ts_ms(&now);
+	m->travelled = 0;
+	m->active = 1;
+	m->goals++;
+	pthread_cond_signal(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+}
+
+void motion_stop(struct motion_exec *m)
+{
+	pthread_mutex_lock(&m->lock);
+	if (m->active)
+		m->preempted++;
+	m->active = 0;
+	m->vx = m->wz = 0;
+	m->send(0, 0, m->user);
+	pthread_cond_signal(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+}
+
+int motion_active(struct motion_exec *m)
+{
+	int active;
+
+	pthread_mutex_lock(&m->lock);
+	active = m->active;
+	pthread_mutex_unlock(&m->lock);
+	return active;
+}
+
+void motion_report(struct motion_exec *m)
+{
+	pthread_mutex_lock(&m->lock);
+	printf("[motion] %dHz, %lu ticks, %lu overruns, %u goals, %u preempted\n",
+		m->rate_hz, m->ticks, m->overruns, m->goals, m->preempted);
+	lat_report(&m->jitter);
+	pthread_mutex_unlock(&m->lock);
+}
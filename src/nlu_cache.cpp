@@ -0,0 +1,264 @@
+/*
+@file
+@brief cache of cloud NLU answers, see nlu_cache.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "nlu_cache.h"
+#include "text_norm.h"
+#include "content_hash.h"
+
+#define NC_MAGIC	0x43554c4e	/* "NLUC" */
+#define NC_VERSION	1
+
+struct kind_rule {
+	const char *word;
+	int kind;
+};
+
+/* on normalized text, the first match decides */
+static const struct kind_rule kind_rules[] = {
+	{ "时间", NC_LIVE }, { "几点", NC_LIVE }, { "天气", NC_LIVE },
+	{ "气温", NC_LIVE }, { "温度", NC_LIVE }, { "下雨", NC_LIVE },
+	{ "今天", NC_LIVE }, { "明天", NC_LIVE }, { "昨天", NC_LIVE },
+	{ "现在", NC_LIVE }, { "日期", NC_LIVE }, { "几号", NC_LIVE },
+	{ "星期", NC_LIVE }, { "新闻", NC_LIVE }, { "股票", NC_LIVE },
+	{ "名字", NC_IDENTITY }, { "叫什么", NC_IDENTITY }, { "你是谁", NC_IDENTITY },
+	{ "几岁", NC_IDENTITY }, { "多大", NC_IDENTITY }, { "谁做的", NC_IDENTITY },
+	{ "谁发明", NC_IDENTITY }, { "你会什么", NC_IDENTITY },
+	{ "笑话", NC_JOKE }, { "故事", NC_JOKE }, { "段子", NC_JOKE },
+	{ "谜语", NC_JOKE }, { "绕口令", NC_JOKE },
+};
+
+static const char *kind_names[NC_KINDS] = { "live", "identity", "joke", "other" };
+
+static void clear(struct nlu_cache *c, int nslots)
+{
+	memset(c->hdr, 0, c->map_len);
+	c->hdr->magic = NC_MAGIC;
+	c->hdr->version = NC_VERSION;
+	c->hdr->entry_size = sizeof(struct nc_entry);
+	c->hdr->nslots = nslots;
+}
+
+static int layout_ok(const struct nc_header *h, int nslots)
+{
+	return h->magic == NC_MAGIC && h->version == NC_VERSION
+		&& h->entry_size == sizeof(struct nc_entry) && h->nslots == (unsigned int)nslots;
+}
+
+/* a slot torn by a crash while it was written is dropped */
+static void check_slots(struct nlu_cache *c)
+{
+	unsigned int i, dropped = 0, kept = 0;
+
+	for (i = 0; i < c->hdr->nslots; i++) {
+		struct nc_entry *e = &c->slots[i];
+		if (!e->hash)
+			continue;
+		if (e->key[NC_KEY_LEN - 1] || e->answer[NC_ANSWER_LEN - 1]
+			|| e->kind <= NC_LIVE || e->kind >= NC_KINDS
+			|| e->hash != fnv1a64(e->key, strlen(e->key), FNV1A64_INIT)) {
+			e->hash = 0;
+			dropped++;
+		} else {
+			kept++;
+		}
+	}
+	printf("[nlu cache] %u answers loaded, %u damaged dropped\n", kept, dropped);
+}
+
+int nc_init(struct nlu_cache *c, const char *path, int nslots,
+		long ttl_identity_s, long ttl_joke_s, long ttl_other_s)
+{
+	struct stat st;
+	void *p = MAP_FAILED;
+
+	memset(c, 0, sizeof(*c));
+	c->fd = -1;
+	c->ttl_s[NC_LIVE] = 0;
+	c->ttl_s[NC_IDENTITY] = ttl_identity_s;
+	c->ttl_s[NC_JOKE] = ttl_joke_s;
+	c->ttl_s[NC_OTHER] = ttl_other_s;
+	lat_init(&c->lookup, "nlu cache lookup");
+	lat_init(&c->saved, "nlu cache saved");
+	if (nslots <= 0)
+		nslots = NC_DEFAULT_SLOTS;
+	c->map_len = sizeof(struct nc_header) + (size_t)nslots * sizeof(struct nc_entry);
+
+	if (path && path[0]) {
+		c->fd = open(path, O_RDWR | O_CREAT, 0644);
+		if (c->fd < 0)
+			printf("[nlu cache] cannot open %s, kept in memory\n", path);
+	}
+	if (c->fd >= 0) {
+		if (fstat(c->fd, &st) || ((size_t)st.st_size != c->map_len
+			&& ftruncate(c->fd, c->map_len))) {
+			printf("[nlu cache] cannot size %s, kept in memory\n", path);
+			close(c->fd);
+			c->fd = -1;
+		} else {
+			p = mmap(NULL, c->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+			if (p == MAP_FAILED) {
+				close(c->fd);
+				c->fd = -1;
+			}
+		}
+	}
+	if (p == MAP_FAILED)
+		p = mmap(NULL, c->map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return -1;
+
+	c->hdr = (struct nc_header *)p;
+	c->slots = (struct nc_entry *)(c->hdr + 1);
+	if (!layout_ok(c->hdr, nslots)) {
+		if (c->fd >= 0 && c->hdr->magic)
+			printf("[nlu cache] %s has another layout, cleared\n", path);
+		clear(c, nslots);
+	} else {
+		check_slots(c);
+	}
+	return 0;
+}
+
+void nc_close(struct nlu_cache *c)
+{
+	if (!c->hdr)
+		return;
+	munmap(c->hdr, c->map_len);
+	if (c->fd >= 0)
+		close(c->fd);
+	c->hdr = NULL;
+	c->slots = NULL;
+	c->fd = -1;
+}
+
+size_t nc_key(const char *question, char *key, size_t size)
+{
+	size_t n = tn_normalize(question, strlen(question), key, size, NULL, NULL);
+
+	/* room left for at least one more character, or it was cut */
+	if (n + 4 >= size) {
+		key[0] = '\0';
+		return 0;
+	}
+	return n;
+}
+
+int nc_kind_of(const char *key)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(kind_rules) / sizeof(kind_rules[0]); i++) {
+		if (strstr(key, kind_rules[i].word))
+			return kind_rules[i].kind;
+	}
+	return NC_OTHER;
+}
+
+static struct nc_entry *find(struct nlu_cache *c, unsigned long long hash, const char *key)
+{
+	unsigned int i;
+
+	for (i = 0; i < c->hdr->nslots; i++) {
+		struct nc_entry *e = &c->slots[i];
+		if (e->hash == hash && !strcmp(e->key, key))
+			return e;
+	}
+	return NULL;
+}
+
+int nc_lookup(struct nlu_cache *c, const char *key, char *answer, size_t size)
+{
+	double t0 = lat_now_ms();
+	struct nc_entry *e;
+	unsigned long long hash;
+
+	if (!key[0] || c->ttl_s[nc_kind_of(key)] <= 0) {
+		c->live++;
+		return 0;
+	}
+	hash = fnv1a64(key, strlen(key), FNV1A64_INIT);
+	e = find(c, hash, key);
+	if (e && e->expires <= (long long)time(NULL)) {
+		e->hash = 0;
+		e = NULL;
+	}
+	if (!e) {
+		c->misses++;
+		lat_add(&c->lookup, lat_now_ms() - t0);
+		return 0;
+	}
+
+	e->used = ++c->hdr->tick;
+	strncpy(answer, e->answer, size - 1);
+	answer[size - 1] = '\0';
+	c->hits++;
+	lat_add(&c->lookup, lat_now_ms() - t0);
+	lat_add(&c->saved, e->fetch_ms);
+	return 1;
+}
+
+void nc_store(struct nlu_cache *c, const char *key, const char *answer, double fetch_ms)
+{
+	int kind = nc_kind_of(key);
+	long long now = time(NULL);
+	struct nc_entry *e, *lru = NULL;
+	unsigned long long hash;
+	unsigned int i;
+
+	if (!key[0] || c->ttl_s[kind] <= 0 || strlen(answer) >= NC_ANSWER_LEN)
+		return;
+	hash = fnv1a64(key, strlen(key), FNV1A64_INIT);
+	e = find(c, hash, key);
+	/* a free or expired slot, else the least recently used */
+	for (i = 0; !e && i < c->hdr->nslots; i++) {
+		struct nc_entry *s = &c->slots[i];
+		if (!s->hash || s->expires <= now)
+			e = s;
+		else if (!lru || s->used < lru->used)
+			lru = s;
+	}
+	if (!e) {
+		e = lru;
+		c->evictions++;
+	}
+
+	/* the hash goes last, a torn slot is found by check_slots */
+	e->hash = 0;
+	e->expires = now + c->ttl_s[kind];
+	e->used = ++c->hdr->tick;
+	e->fetch_ms = fetch_ms;
+	e->kind = kind;
+	strcpy(e->key, key);
+	strcpy(e->answer, answer);
+	e->hash = hash;
+	c->stores++;
+}
+
+void nc_report(const struct nlu_cache *c)
+{
+	unsigned long n = c->hits + c->misses;
+	unsigned int i, used = 0;
+
+	for (i = 0; i < c->hdr->nslots; i++) {
+		if (c->slots[i].hash)
+			used++;
+	}
+	printf("[nlu cache] %lu lookups, %lu hits (%.0f%%), %lu not cacheable, "
+		"%lu stored, %lu evicted, %u/%u slots%s\n",
+		n, c->hits, n ? 100.0 * c->hits / n : 0.0, c->live, c->stores,
+		c->evictions, used, c->hdr->nslots, c->fd < 0 ? " (memory only)" : "");
+	printf("[nlu cache] ttl %s %lds, %s %lds, %s %lds\n",
+		kind_names[NC_IDENTITY], c->ttl_s[NC_IDENTITY], kind_names[NC_JOKE],
+		c->ttl_s[NC_JOKE], kind_names[NC_OTHER], c->ttl_s[NC_OTHER]);
+	lat_report(&c->lookup);
+	lat_report(&c->saved);
+}
@@ -0,0 +1,860 @@
+/*
+@file
+@brief fuzzy phrase matching by sound, see pinyin_match.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pinyin_match.h"
+#include "text_norm.h"
+
+#define NEAR_COST	1
+#define OTHER_COST	2
+#define UNKNOWN_SYL	0x100000	/* + code point, no pinyin */
+
+/* toneless syllables, ids are the index + 1 */
+static const char *const syllables[] = {
+	"a", "ai", "an", "ba", "bai", "ban", "bang", "bao", "bei", "ben",
+	"bi", "bian", "biao", "bie", "bing", "bo", "bu", "cai", "can",
+	"ce", "chang", "chao", "che", "chen", "cheng", "chi", "chu",
+	"chuan", "chuang", "chui", "ci", "cong", "cuo", "da", "dai", "dan",
+	"dang", "dao", "de", "deng", "di", "dian", "diao", "ding", "dong",
+	"dou", "du", "duan", "dui", "duo", "e", "er", "fa", "fan", "fang",
+	"fei", "fen", "feng", "fu", "gai", "gan", "gang", "gao", "ge",
+	"gei", "gen", "geng", "gong", "gou", "gu", "gua", "guan", "guang",
+	"gui", "guo", "ha", "hai", "han", "hao", "he", "hen", "hou", "hu",
+	"hua", "huan", "hui", "huo", "ji", "jia", "jian", "jiang", "jiao",
+	"jie", "jin", "jing", "jiu", "ju", "kai", "kan", "kao", "ke",
+	"kuai", "la", "lai", "le", "li", "lian", "liang", "ling", "liu",
+	"lu", "ma", "mai", "man", "mei", "men", "ming", "na", "ne", "neng",
+	"ni", "nian", "o", "pa", "pao", "ping", "qi", "qian", "qie",
+	"qing", "qu", "ran", "rang", "ren", "ri", "san", "shang", "shao",
+	"she", "shen", "sheng", "shi", "shou", "shu", "shui", "shuo", "si",
+	"song", "ta", "tai", "tian", "ting", "tou", "tu", "tui", "wa",
+	"wan", "wei", "wo", "wu", "xi", "xia", "xian", "xiang", "xiao",
+	"xie", "xin", "xing", "xu", "xun", "yao", "ye", "yi", "you", "yu",
+	"zai", "zao", "zen", "zhang", "zhao", "zhe", "zhen", "zheng",
+	"zhi", "zhong", "zhuan", "zi", "zong", "zou", "zuo",
+};
+
+/* characters of the commands, the objects and what the recognizer
+ * tends to hear instead, in code point order */
+static const struct { unsigned short cp; unsigned short syl; } hanzi[] = {
+	{ 0x4e00, 173 },	/* 一 yi */
+	{ 0x4e03, 127 },	/* 七 qi */
+	{ 0x4e07, 157 },	/* 万 wan */
+	{ 0x4e09, 136 },	/* 三 san */
+	{ 0x4e0a, 137 },	/* 上 shang */
+	{ 0x4e0b, 162 },	/* 下 xia */
+	{ 0x4e0d,  17 },	/* 不 bu */
+	{ 0x4e1c,  45 },	/* 东 dong */
+	{ 0x4e24, 108 },	/* 两 liang */
+	{ 0x4e2a,  64 },	/* 个 ge */
+	{ 0x4e2d, 185 },	/* 中 zhong */
+	{ 0x4e3a, 158 },	/* 为 wei */
+	{ 0x4e3e,  97 },	/* 举 ju */
+	{ 0x4e4b, 184 },	/* 之 zhi */
+	{ 0x4e58,  25 },	/* 乘 cheng */
+	{ 0x4e5d,  96 },	/* 九 jiu */
+	{ 0x4e5f, 172 },	/* 也 ye */
+	{ 0x4e66, 144 },	/* 书 shu */
+	{ 0x4e70, 113 },	/* 买 mai */
+	{ 0x4e86, 105 },	/* 了 le */
+	{ 0x4e8b, 142 },	/* 事 shi */
+	{ 0x4e8c,  52 },	/* 二 er */
+	{ 0x4e94, 160 },	/* 五 wu */
+	{ 0x4eba, 134 },	/* 人 ren */
+	{ 0x4ec0, 140 },	/* 什 shen */
+	{ 0x4eca,  94 },	/* 今 jin */
+	{ 0x4ece,  32 },	/* 从 cong */
+	{ 0x4ed6, 149 },	/* 他 ta */
+	{ 0x4ee3,  35 },	/* 代 dai */
+	{ 0x4ee5, 173 },	/* 以 yi */
+	{ 0x4eec, 116 },	/* 们 men */
+	{ 0x4ef6,  90 },	/* 件 jian */
+	{ 0x4efb, 134 },	/* 任 ren */
+	{ 0x4f1a,  86 },	/* 会 hui */
+	{ 0x4f20,  28 },	/* 传 chuan */
+	{ 0x4f2f,  16 },	/* 伯 bo */
+	{ 0x4f34,   6 },	/* 伴 ban */
+	{ 0x4f46,  36 },	/* 但 dan */
+	{ 0x4f4d, 158 },	/* 位 wei */
+	{ 0x4f4e,  41 },	/* 低 di */
+	{ 0x4f5c, 190 },	/* 作 zuo */
+	{ 0x4f60, 121 },	/* 你 ni */
+	{ 0x4f7f, 142 },	/* 使 shi */
+	{ 0x4fa7,  20 },	/* 侧 ce */
+	{ 0x4fbf,  12 },	/* 便 bian */
+	{ 0x4fdd,   8 },	/* 保 bao */
+	{ 0x500d,   9 },	/* 倍 bei */
+	{ 0x5012,  38 },	/* 倒 dao */
+	{ 0x5019,  82 },	/* 候 hou */
+	{ 0x505a, 190 },	/* 做 zuo */
+	{ 0x505c, 152 },	/* 停 ting */
+	{ 0x50cf, 164 },	/* 像 xiang */
+	{ 0x513f,  52 },	/* 儿 er */
+	{ 0x5148, 163 },	/* 先 xian */
+	{ 0x5149,  73 },	/* 光 guang */
+	{ 0x516b,   4 },	/* 八 ba */
+	{ 0x516c,  68 },	/* 公 gong */
+	{ 0x516d, 110 },	/* 六 liu */
+	{ 0x5173,  72 },	/* 关 guan */
+	{ 0x5175,  15 },	/* 兵 bing */
+	{ 0x5176, 127 },	/* 其 qi */
+	{ 0x5177,  97 },	/* 具 ju */
+	{ 0x518d, 176 },	/* 再 zai */
+	{ 0x51ac,  45 },	/* 冬 dong */
+	{ 0x51b0,  15 },	/* 冰 bing */
+	{ 0x51e0,  88 },	/* 几 ji */
+	{ 0x51ef,  98 },	/* 凯 kai */
+	{ 0x51fa,  27 },	/* 出 chu */
+	{ 0x5200,  38 },	/* 刀 dao */
+	{ 0x5206,  57 },	/* 分 fen */
+	{ 0x5207, 129 },	/* 切 qie */
+	{ 0x521a,  62 },	/* 刚 gang */
+	{ 0x521d,  27 },	/* 初 chu */
+	{ 0x522b,  14 },	/* 别 bie */
+	{ 0x5230,  38 },	/* 到 dao */
+	{ 0x524d, 128 },	/* 前 qian */
+	{ 0x5267,  97 },	/* 剧 ju */
+	{ 0x529e,   6 },	/* 办 ban */
+	{ 0x52a0,  89 },	/* 加 jia */
+	{ 0x52a8,  45 },	/* 动 dong */
+	{ 0x5305,   8 },	/* 包 bao */
+	{ 0x5317,   9 },	/* 北 bei */
+	{ 0x533b, 173 },	/* 医 yi */
+	{ 0x5341, 142 },	/* 十 shi */
+	{ 0x534a,   6 },	/* 半 ban */
+	{ 0x5355,  36 },	/* 单 dan */
+	{ 0x535a,  16 },	/* 博 bo */
+	{ 0x5382,  21 },	/* 厂 chang */
+	{ 0x539a,  82 },	/* 厚 hou */
+	{ 0x53bb, 131 },	/* 去 qu */
+	{ 0x53c2,  19 },	/* 参 can */
+	{ 0x53c8, 174 },	/* 又 you */
+	{ 0x53cd,  54 },	/* 反 fan */
+	{ 0x53d1,  53 },	/* 发 fa */
+	{ 0x53d6, 131 },	/* 取 qu */
+	{ 0x53d7, 143 },	/* 受 shou */
+	{ 0x53d8,  12 },	/* 变 bian */
+	{ 0x53e4,  70 },	/* 古 gu */
+	{ 0x53e5,  97 },	/* 句 ju */
+	{ 0x53ea, 184 },	/* 只 zhi */
+	{ 0x53eb,  92 },	/* 叫 jiao */
+	{ 0x53ef, 101 },	/* 可 ke */
+	{ 0x53f3, 174 },	/* 右 you */
+	{ 0x53f7,  79 },	/* 号 hao */
+	{ 0x5403,  26 },	/* 吃 chi */
+	{ 0x540d, 117 },	/* 名 ming */
+	{ 0x540e,  82 },	/* 后 hou */
+	{ 0x5411, 164 },	/* 向 xiang */
+	{ 0x5417, 112 },	/* 吗 ma */
+	{ 0x5427,   4 },	/* 吧 ba */
+	{ 0x542c, 152 },	/* 听 ting */
+	{ 0x5435,  22 },	/* 吵 chao */
+	{ 0x5439,  30 },	/* 吹 chui */
+	{ 0x544a,  63 },	/* 告 gao */
+	{ 0x5462, 119 },	/* 呢 ne */
+	{ 0x548c,  80 },	/* 和 he */
+	{ 0x54c0,   2 },	/* 哀 ai */
+	{ 0x54c7, 156 },	/* 哇 wa */
+	{ 0x54c8,  76 },	/* 哈 ha */
+	{ 0x54e5,  64 },	/* 哥 ge */
+	{ 0x54e6, 123 },	/* 哦 o */
+	{ 0x54ea, 118 },	/* 哪 na */
+	{ 0x5531,  21 },	/* 唱 chang */
+	{ 0x554a,   1 },	/* 啊 a */
+	{ 0x558a,  78 },	/* 喊 han */
+	{ 0x559c, 161 },	/* 喜 xi */
+	{ 0x559d,  80 },	/* 喝 he */
+	{ 0x5668, 127 },	/* 器 qi */
+	{ 0x56db, 147 },	/* 四 si */
+	{ 0x56de,  86 },	/* 回 hui */
+	{ 0x56fd,  75 },	/* 国 guo */
+	{ 0x56fe, 154 },	/* 图 tu */
+	{ 0x571f, 154 },	/* 土 tu */
+	{ 0x5728, 176 },	/* 在 zai */
+	{ 0x5730,  41 },	/* 地 di */
+	{ 0x573a,  21 },	/* 场 chang */
+	{ 0x5750, 190 },	/* 坐 zuo */
+	{ 0x57ce,  25 },	/* 城 cheng */
+	{ 0x57fa,  88 },	/* 基 ji */
+	{ 0x58c1,  11 },	/* 壁 bi */
+	{ 0x58f0, 141 },	/* 声 sheng */
+	{ 0x5904,  27 },	/* 处 chu */
+	{ 0x5907,   9 },	/* 备 bei */
+	{ 0x590d,  59 },	/* 复 fu */
+	{ 0x591a,  50 },	/* 多 duo */
+	{ 0x591f,  69 },	/* 够 gou */
+	{ 0x5927,  34 },	/* 大 da */
+	{ 0x5929, 151 },	/* 天 tian */
+	{ 0x592a, 150 },	/* 太 tai */
+	{ 0x5934, 153 },	/* 头 tou */
+	{ 0x594f, 189 },	/* 奏 zou */
+	{ 0x5954,  10 },	/* 奔 ben */
+	{ 0x5979, 149 },	/* 她 ta */
+	{ 0x597d,  79 },	/* 好 hao */
+	{ 0x5988, 112 },	/* 妈 ma */
+	{ 0x59cb, 142 },	/* 始 shi */
+	{ 0x59d0,  93 },	/* 姐 jie */
+	{ 0x5b50, 187 },	/* 子 zi */
+	{ 0x5b57, 187 },	/* 字 zi */
+	{ 0x5b69,  77 },	/* 孩 hai */
+	{ 0x5b83, 149 },	/* 它 ta */
+	{ 0x5b89,   3 },	/* 安 an */
+	{ 0x5b8c, 157 },	/* 完 wan */
+	{ 0x5b97, 188 },	/* 宗 zong */
+	{ 0x5b9a,  44 },	/* 定 ding */
+	{ 0x5b9d,   8 },	/* 宝 bao */
+	{ 0x5bb6,  89 },	/* 家 jia */
+	{ 0x5bf9,  49 },	/* 对 dui */
+	{ 0x5bfb, 170 },	/* 寻 xun */
+	{ 0x5c06,  91 },	/* 将 jiang */
+	{ 0x5c0f, 165 },	/* 小 xiao */
+	{ 0x5c11, 138 },	/* 少 shao */
+	{ 0x5c31,  96 },	/* 就 jiu */
+	{ 0x5c3a,  26 },	/* 尺 chi */
+	{ 0x5cb8,   3 },	/* 岸 an */
+	{ 0x5de5,  68 },	/* 工 gong */
+	{ 0x5de6, 190 },	/* 左 zuo */
+	{ 0x5df2, 173 },	/* 已 yi */
+	{ 0x5df4,   4 },	/* 巴 ba */
+	{ 0x5e01,  11 },	/* 币 bi */
+	{ 0x5e03,  17 },	/* 布 bu */
+	{ 0x5e26,  35 },	/* 带 dai */
+	{ 0x5e2e,   7 },	/* 帮 bang */
+	{ 0x5e38,  21 },	/* 常 chang */
+	{ 0x5e72,  61 },	/* 干 gan */
+	{ 0x5e73, 126 },	/* 平 ping */
+	{ 0x5e74, 122 },	/* 年 nian */
+	{ 0x5e76,  15 },	/* 并 bing */
+	{ 0x5e8a,  29 },	/* 床 chuang */
+	{ 0x5e95,  41 },	/* 底 di */
+	{ 0x5e97,  42 },	/* 店 dian */
+	{ 0x5ea6,  47 },	/* 度 du */
+	{ 0x5ead, 152 },	/* 庭 ting */
+	{ 0x5efa,  90 },	/* 建 jian */
+	{ 0x5f00,  98 },	/* 开 kai */
+	{ 0x5f1f,  41 },	/* 弟 di */
+	{ 0x5f20, 179 },	/* 张 zhang */
+	{ 0x5f53,  37 },	/* 当 dang */
+	{ 0x5f69,  18 },	/* 彩 cai */
+	{ 0x5f7b,  23 },	/* 彻 che */
+	{ 0x5f85,  35 },	/* 待 dai */
+	{ 0x5f88,  81 },	/* 很 hen */
+	{ 0x5f97,  39 },	/* 得 de */
+	{ 0x5faa, 170 },	/* 循 xun */
+	{ 0x5fb7,  39 },	/* 德 de */
+	{ 0x5fc5,  11 },	/* 必 bi */
+	{ 0x5feb, 102 },	/* 快 kuai */
+	{ 0x600e, 178 },	/* 怎 zen */
+	{ 0x6015, 124 },	/* 怕 pa */
+	{ 0x6025,  88 },	/* 急 ji */
+	{ 0x603b, 188 },	/* 总 zong */
+	{ 0x60b2,   9 },	/* 悲 bei */
+	{ 0x60f3, 164 },	/* 想 xiang */
+	{ 0x610f, 173 },	/* 意 yi */
+	{ 0x611f,  61 },	/* 感 gan */
+	{ 0x6162, 114 },	/* 慢 man */
+	{ 0x61c2,  45 },	/* 懂 dong */
+	{ 0x6210,  25 },	/* 成 cheng */
+	{ 0x6211, 159 },	/* 我 wo */
+	{ 0x6216,  87 },	/* 或 huo */
+	{ 0x623f,  55 },	/* 房 fang */
+	{ 0x624b, 143 },	/* 手 shou */
+	{ 0x624d,  18 },	/* 才 cai */
+	{ 0x6253,  34 },	/* 打 da */
+	{ 0x627e, 180 },	/* 找 zhao */
+	{ 0x628a,   4 },	/* 把 ba */
+	{ 0x6295, 153 },	/* 投 tou */
+	{ 0x62a4,  83 },	/* 护 hu */
+	{ 0x62a5,   8 },	/* 报 bao */
+	{ 0x62b1,   8 },	/* 抱 bao */
+	{ 0x62c5,  36 },	/* 担 dan */
+	{ 0x62c9, 103 },	/* 拉 la */
+	{ 0x62d4,   4 },	/* 拔 ba */
+	{ 0x62dc,   5 },	/* 拜 bai */
+	{ 0x62ff, 118 },	/* 拿 na */
+	{ 0x6301,  26 },	/* 持 chi */
+	{ 0x6302,  71 },	/* 挂 gua */
+	{ 0x6307, 184 },	/* 指 zhi */
+	{ 0x6309,   3 },	/* 按 an */
+	{ 0x6321,  37 },	/* 挡 dang */
+	{ 0x6325,  86 },	/* 挥 hui */
+	{ 0x6328,   2 },	/* 挨 ai */
+	{ 0x6362,  85 },	/* 换 huan */
+	{ 0x6389,  43 },	/* 掉 diao */
+	{ 0x63a5,  93 },	/* 接 jie */
+	{ 0x63a8, 155 },	/* 推 tui */
+	{ 0x63aa,  33 },	/* 措 cuo */
+	{ 0x642c,   6 },	/* 搬 ban */
+	{ 0x6446,   5 },	/* 摆 bai */
+	{ 0x64ad,  16 },	/* 播 bo */
+	{ 0x6536, 143 },	/* 收 shou */
+	{ 0x653e,  55 },	/* 放 fang */
+	{ 0x6545,  70 },	/* 故 gu */
+	{ 0x6570, 144 },	/* 数 shu */
+	{ 0x6597,  46 },	/* 斗 dou */
+	{ 0x65b0, 167 },	/* 新 xin */
+	{ 0x65b9,  55 },	/* 方 fang */
+	{ 0x65e0, 160 },	/* 无 wu */
+	{ 0x65e5, 135 },	/* 日 ri */
+	{ 0x65e7,  96 },	/* 旧 jiu */
+	{ 0x65e9, 177 },	/* 早 zao */
+	{ 0x65f6, 142 },	/* 时 shi */
+	{ 0x660e, 117 },	/* 明 ming */
+	{ 0x661f, 168 },	/* 星 xing */
+	{ 0x662f, 142 },	/* 是 shi */
+	{ 0x663e, 163 },	/* 显 xian */
+	{ 0x665a, 157 },	/* 晚 wan */
+	{ 0x6668,  24 },	/* 晨 chen */
+	{ 0x6697,   3 },	/* 暗 an */
+	{ 0x66f4,  67 },	/* 更 geng */
+	{ 0x6709, 174 },	/* 有 you */
+	{ 0x670d,  59 },	/* 服 fu */
+	{ 0x671d,  22 },	/* 朝 chao */
+	{ 0x671f, 127 },	/* 期 qi */
+	{ 0x672c,  10 },	/* 本 ben */
+	{ 0x6735,  50 },	/* 朵 duo */
+	{ 0x673a,  88 },	/* 机 ji */
+	{ 0x675f, 144 },	/* 束 shu */
+	{ 0x6765, 104 },	/* 来 lai */
+	{ 0x676f,   9 },	/* 杯 bei */
+	{ 0x677f,   6 },	/* 板 ban */
+	{ 0x6784,  69 },	/* 构 gou */
+	{ 0x6795, 182 },	/* 枕 zhen */
+	{ 0x67cf,   5 },	/* 柏 bai */
+	{ 0x6807,  13 },	/* 标 biao */
+	{ 0x6811, 144 },	/* 树 shu */
+	{ 0x6839,  66 },	/* 根 gen */
+	{ 0x68d2,   7 },	/* 棒 bang */
+	{ 0x6905, 173 },	/* 椅 yi */
+	{ 0x6b21,  31 },	/* 次 ci */
+	{ 0x6b4c,  64 },	/* 歌 ge */
+	{ 0x6b62, 184 },	/* 止 zhi */
+	{ 0x6b63, 183 },	/* 正 zheng */
+	{ 0x6b64,  31 },	/* 此 ci */
+	{ 0x6b65,  17 },	/* 步 bu */
+	{ 0x6b8b,  19 },	/* 残 can */
+	{ 0x6bb5,  48 },	/* 段 duan */
+	{ 0x6bd4,  11 },	/* 比 bi */
+	{ 0x6c14, 127 },	/* 气 qi */
+	{ 0x6c34, 145 },	/* 水 shui */
+	{ 0x6c89,  24 },	/* 沉 chen */
+	{ 0x6ca1, 115 },	/* 没 mei */
+	{ 0x6cd5,  53 },	/* 法 fa */
+	{ 0x6ce2,  16 },	/* 波 bo */
+	{ 0x6ce5, 121 },	/* 泥 ni */
+	{ 0x6d4b,  20 },	/* 测 ce */
+	{ 0x6d77,  77 },	/* 海 hai */
+	{ 0x706f,  40 },	/* 灯 deng */
+	{ 0x7070,  86 },	/* 灰 hui */
+	{ 0x70b9,  42 },	/* 点 dian */
+	{ 0x7136, 132 },	/* 然 ran */
+	{ 0x7167, 180 },	/* 照 zhao */
+	{ 0x7231,   2 },	/* 爱 ai */
+	{ 0x7238,   4 },	/* 爸 ba */
+	{ 0x72d7,  69 },	/* 狗 gou */
+	{ 0x72ec,  47 },	/* 独 du */
+	{ 0x731c,  18 },	/* 猜 cai */
+	{ 0x7334,  82 },	/* 猴 hou */
+	{ 0x73a9, 157 },	/* 玩 wan */
+	{ 0x73b0, 163 },	/* 现 xian */
+	{ 0x73ed,   6 },	/* 班 ban */
+	{ 0x74f6, 126 },	/* 瓶 ping */
+	{ 0x7531, 174 },	/* 由 you */
+	{ 0x7535,  42 },	/* 电 dian */
+	{ 0x753b,  84 },	/* 画 hua */
+	{ 0x75c5,  15 },	/* 病 bing */
+	{ 0x767b,  40 },	/* 登 deng */
+	{ 0x767d,   5 },	/* 白 bai */
+	{ 0x767e,   5 },	/* 百 bai */
+	{ 0x7684,  39 },	/* 的 de */
+	{ 0x76f8, 164 },	/* 相 xiang */
+	{ 0x770b,  99 },	/* 看 kan */
+	{ 0x771f, 182 },	/* 真 zhen */
+	{ 0x7761, 145 },	/* 睡 shui */
+	{ 0x77e5, 184 },	/* 知 zhi */
+	{ 0x77ed,  48 },	/* 短 duan */
+	{ 0x77ee,   2 },	/* 矮 ai */
+	{ 0x793a, 142 },	/* 示 shi */
+	{ 0x79bb, 106 },	/* 离 li */
+	{ 0x79f0,  25 },	/* 称 cheng */
+	{ 0x7a0b,  25 },	/* 程 cheng */
+	{ 0x7a7f,  28 },	/* 穿 chuan */
+	{ 0x7a81, 154 },	/* 突 tu */
+	{ 0x7a97,  29 },	/* 窗 chuang */
+	{ 0x7ae0, 179 },	/* 章 zhang */
+	{ 0x7b11, 165 },	/* 笑 xiao */
+	{ 0x7b14,  11 },	/* 笔 bi */
+	{ 0x7b28,  10 },	/* 笨 ben */
+	{ 0x7b2c,  41 },	/* 第 di */
+	{ 0x7b49,  40 },	/* 等 deng */
+	{ 0x7b54,  34 },	/* 答 da */
+	{ 0x7b56,  20 },	/* 策 ce */
+	{ 0x7b7e, 128 },	/* 签 qian */
+	{ 0x7ba1,  72 },	/* 管 guan */
+	{ 0x7d2b, 187 },	/* 紫 zi */
+	{ 0x7ea7,  88 },	/* 级 ji */
+	{ 0x7eb5, 188 },	/* 纵 zong */
+	{ 0x7ecf,  95 },	/* 经 jing */
+	{ 0x7ed1,   7 },	/* 绑 bang */
+	{ 0x7ed3,  93 },	/* 结 jie */
+	{ 0x7ed9,  65 },	/* 给 gei */
+	{ 0x7f16,  12 },	/* 编 bian */
+	{ 0x7ffb,  54 },	/* 翻 fan */
+	{ 0x800c,  52 },	/* 而 er */
+	{ 0x8033,  52 },	/* 耳 er */
+	{ 0x806a,  32 },	/* 聪 cong */
+	{ 0x80cc,   9 },	/* 背 bei */
+	{ 0x80fd, 120 },	/* 能 neng */
+	{ 0x8138, 107 },	/* 脸 lian */
+	{ 0x817f, 155 },	/* 腿 tui */
+	{ 0x81ea, 187 },	/* 自 zi */
+	{ 0x822c,   6 },	/* 般 ban */
+	{ 0x8239,  28 },	/* 船 chuan */
+	{ 0x8282,  93 },	/* 节 jie */
+	{ 0x83dc,  18 },	/* 菜 cai */
+	{ 0x8584,   8 },	/* 薄 bao */
+	{ 0x86cb,  36 },	/* 蛋 dan */
+	{ 0x884c, 168 },	/* 行 xing */
+	{ 0x8863, 173 },	/* 衣 yi */
+	{ 0x8865,  17 },	/* 补 bu */
+	{ 0x8868,  13 },	/* 表 biao */
+	{ 0x888b,  35 },	/* 袋 dai */
+	{ 0x88ab,   9 },	/* 被 bei */
+	{ 0x8981, 171 },	/* 要 yao */
+	{ 0x89c1,  90 },	/* 见 jian */
+	{ 0x89c2,  72 },	/* 观 guan */
+	{ 0x89e6,  27 },	/* 触 chu */
+	{ 0x8ba4, 134 },	/* 认 ren */
+	{ 0x8ba9, 133 },	/* 让 rang */
+	{ 0x8bb0,  88 },	/* 记 ji */
+	{ 0x8bb2,  91 },	/* 讲 jiang */
+	{ 0x8bbe, 139 },	/* 设 she */
+	{ 0x8bc4, 126 },	/* 评 ping */
+	{ 0x8bcd,  31 },	/* 词 ci */
+	{ 0x8bdd,  84 },	/* 话 hua */
+	{ 0x8be2, 170 },	/* 询 xun */
+	{ 0x8be5,  60 },	/* 该 gai */
+	{ 0x8bed, 175 },	/* 语 yu */
+	{ 0x8bf4, 146 },	/* 说 shuo */
+	{ 0x8bf7, 130 },	/* 请 qing */
+	{ 0x8bfb,  47 },	/* 读 du */
+	{ 0x8c01, 145 },	/* 谁 shui */
+	{ 0x8c22, 166 },	/* 谢 xie */
+	{ 0x8c61, 164 },	/* 象 xiang */
+	{ 0x8d1d,   9 },	/* 贝 bei */
+	{ 0x8d25,   5 },	/* 败 bai */
+	{ 0x8d2d,  69 },	/* 购 gou */
+	{ 0x8d35,  74 },	/* 贵 gui */
+	{ 0x8d5a, 186 },	/* 赚 zhuan */
+	{ 0x8d70, 189 },	/* 走 zou */
+	{ 0x8d77, 127 },	/* 起 qi */
+	{ 0x8d85,  22 },	/* 超 chao */
+	{ 0x8dd1, 125 },	/* 跑 pao */
+	{ 0x8ddf,  66 },	/* 跟 gen */
+	{ 0x8def, 111 },	/* 路 lu */
+	{ 0x8e2a, 188 },	/* 踪 zong */
+	{ 0x8eb2,  50 },	/* 躲 duo */
+	{ 0x8f66,  23 },	/* 车 che */
+	{ 0x8f6c, 186 },	/* 转 zhuan */
+	{ 0x8f88,   9 },	/* 辈 bei */
+	{ 0x8f9e,  31 },	/* 辞 ci */
+	{ 0x8fb9,  12 },	/* 边 bian */
+	{ 0x8fbe,  34 },	/* 达 da */
+	{ 0x8fc7,  75 },	/* 过 guo */
+	{ 0x8fd1,  94 },	/* 近 jin */
+	{ 0x8fd8,  77 },	/* 还 hai */
+	{ 0x8fd9, 181 },	/* 这 zhe */
+	{ 0x8fdb,  94 },	/* 进 jin */
+	{ 0x8fdf,  26 },	/* 迟 chi */
+	{ 0x9000, 155 },	/* 退 tui */
+	{ 0x9001, 148 },	/* 送 song */
+	{ 0x9014, 154 },	/* 途 tu */
+	{ 0x903c,  11 },	/* 逼 bi */
+	{ 0x904d,  12 },	/* 遍 bian */
+	{ 0x9053,  38 },	/* 道 dao */
+	{ 0x907f,  11 },	/* 避 bi */
+	{ 0x90a3, 118 },	/* 那 na */
+	{ 0x90e8,  17 },	/* 部 bu */
+	{ 0x90fd,  46 },	/* 都 dou */
+	{ 0x91c7,  18 },	/* 采 cai */
+	{ 0x91cc, 106 },	/* 里 li */
+	{ 0x91d1,  94 },	/* 金 jin */
+	{ 0x9488, 182 },	/* 针 zhen */
+	{ 0x94b1, 128 },	/* 钱 qian */
+	{ 0x9519,  33 },	/* 错 cuo */
+	{ 0x9547, 182 },	/* 镇 zhen */
+	{ 0x957f,  21 },	/* 长 chang */
+	{ 0x95e8, 116 },	/* 门 men */
+	{ 0x95ed,  11 },	/* 闭 bi */
+	{ 0x95f4,  90 },	/* 间 jian */
+	{ 0x961f,  49 },	/* 队 dui */
+	{ 0x963f,   1 },	/* 阿 a */
+	{ 0x9648,  24 },	/* 陈 chen */
+	{ 0x9664,  27 },	/* 除 chu */
+	{ 0x96f6, 109 },	/* 零 ling */
+	{ 0x9700, 169 },	/* 需 xu */
+	{ 0x9738,   4 },	/* 霸 ba */
+	{ 0x9759,  95 },	/* 静 jing */
+	{ 0x975e,  56 },	/* 非 fei */
+	{ 0x9760, 100 },	/* 靠 kao */
+	{ 0x9876,  44 },	/* 顶 ding */
+	{ 0x989d,  51 },	/* 额 e */
+	{ 0x98ce,  58 },	/* 风 feng */
+	{ 0x98de,  56 },	/* 飞 fei */
+	{ 0x9910,  19 },	/* 餐 can */
+	{ 0x996d,  54 },	/* 饭 fan */
+	{ 0x9971,   8 },	/* 饱 bao */
+	{ 0x997c,  15 },	/* 饼 bing */
+	{ 0x997f,  51 },	/* 饿 e */
+	{ 0x9986,  72 },	/* 馆 guan */
+	{ 0x9996, 143 },	/* 首 shou */
+	{ 0x9ad8,  63 },	/* 高 gao */
+	{ 0x9e21,  88 },	/* 鸡 ji */
+	{ 0x9f3b,  11 },	/* 鼻 bi */
+};
+
+#define NUM_SYLLABLES	(sizeof(syllables) / sizeof(syllables[0]))
+#define NUM_HANZI	(sizeof(hanzi) / sizeof(hanzi[0]))
+
+/* 0..9 after tn_normalize */
+static const char *const digits[10] = {
+	"ling", "yi", "er", "san", "si", "wu", "liu", "qi", "ba", "jiu"
+};
+
+/* syllables that sound alike share a near id */
+static unsigned short near_id[NUM_SYLLABLES + 1];
+static int near_ready = 0;
+
+static int syllable_id(const char *s)
+{
+	int lo = 0, hi = NUM_SYLLABLES - 1;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		int c = strcmp(syllables[mid], s);
+		if (c == 0)
+			return mid + 1;
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return 0;
+}
+
+/* zh ch sh -> z c s, n -> l, -ng -> -n */
+static void near_key(const char *s, char *key)
+{
+	size_t n;
+
+	if ((s[0] == 'z' || s[0] == 'c' || s[0] == 's') && s[1] == 'h') {
+		key[0] = s[0];
+		strcpy(key + 1, s + 2);
+	} else if (s[0] == 'n') {
+		key[0] = 'l';
+		strcpy(key + 1, s + 1);
+	} else {
+		strcpy(key, s);
+	}
+	n = strlen(key);
+	if (n > 2 && key[n - 2] == 'n' && key[n - 1] == 'g')
+		key[n - 1] = '\0';
+}
+
+static void init_near()
+{
+	char keys[NUM_SYLLABLES][8];
+	unsigned int i, j;
+
+	for (i = 0; i < NUM_SYLLABLES; i++) {
+		near_key(syllables[i], keys[i]);
+		near_id[i + 1] = i + 1;
+		for (j = 0; j < i; j++) {
+			if (!strcmp(keys[i], keys[j])) {
+				near_id[i + 1] = near_id[j + 1];
+				break;
+			}
+		}
+	}
+	near_ready = 1;
+}
+
+static inline int sub_cost(unsigned int a, unsigned int b)
+{
+	if (a == b)
+		return 0;
+	if (a <= NUM_SYLLABLES && b <= NUM_SYLLABLES && near_id[a] == near_id[b])
+		return NEAR_COST;
+	return OTHER_COST;
+}
+
+static unsigned int hanzi_syllable(unsigned int cp)
+{
+	int lo = 0, hi = NUM_HANZI - 1;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (hanzi[mid].cp == cp)
+			return hanzi[mid].syl;
+		if (hanzi[mid].cp < cp)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return UNKNOWN_SYL + cp;
+}
+
+int pm_syllables(const char *text, size_t len, unsigned int *out, int max)
+{
+	char buf[PM_MAX_TEXT * 4 + 1];
+	const unsigned char *p, *end;
+	int n = 0;
+
+	len = tn_normalize(text, len, buf, sizeof(buf), NULL, NULL);
+	p = (const unsigned char *)buf;
+	end = p + len;
+	while (p < end && n < max) {
+		unsigned int cp = *p;
+		int i, k = 1;
+
+		/* tn_normalize leaves valid UTF-8 */
+		if (cp >= 0xf0) {
+			k = 4;
+			cp &= 0x07;
+		} else if (cp >= 0xe0) {
+			k = 3;
+			cp &= 0x0f;
+		} else if (cp >= 0xc0) {
+			k = 2;
+			cp &= 0x1f;
+		}
+		for (i = 1; i < k && p + i < end; i++)
+			cp = cp << 6 | (p[i] & 0x3f);
+		p += k;
+
+		if (cp >= '0' && cp <= '9')
+			out[n++] = syllable_id(digits[cp - '0']);
+		else if (cp < 0x80)
+			out[n++] = UNKNOWN_SYL + cp;
+		else
+			out[n++] = hanzi_syllable(cp);
+	}
+	return n;
+}
+
+size_t pm_spell(const unsigned int *syl, int n, char *out, size_t size)
+{
+	size_t len = 0;
+	int i, w;
+
+	if (size == 0)
+		return 0;
+	out[0] = '\0';
+	for (i = 0; i < n; i++) {
+		if (syl[i] >= 1 && syl[i] <= NUM_SYLLABLES)
+			w = snprintf(out + len, size - len, "%s%s", i ? " " : "", syllables[syl[i] - 1]);
+		else
+			w = snprintf(out + len, size - len, "%s?", i ? " " : "");
+		if (w < 0 || (size_t)w >= size - len)
+			break;
+		len += w;
+	}
+	return len;
+}
+
+int pm_init(struct pm_index *idx, int max_phrases)
+{
+	memset(idx, 0, sizeof(*idx));
+	if (!near_ready)
+		init_near();
+	idx->max_nodes = max_phrases * PM_MAX_SYL + 1;
+	idx->nodes = (struct pm_node *)malloc(idx->max_nodes * sizeof(idx->nodes[0]));
+	idx->phrases = (struct pm_phrase *)malloc(max_phrases * sizeof(idx->phrases[0]));
+	if (!idx->nodes || !idx->phrases) {
+		pm_destroy(idx);
+		return -1;
+	}
+	idx->max_phrases = max_phrases;
+	idx->nodes[0].syl = 0;
+	idx->nodes[0].child = idx->nodes[0].next = idx->nodes[0].phrase = -1;
+	idx->nodes[0].max_cost = 0;
+	idx->nnodes = 1;
+	lat_init(&idx->lat, "pinyin search");
+	return 0;
+}
+
+void pm_destroy(struct pm_index *idx)
+{
+	free(idx->nodes);
+	free(idx->phrases);
+	idx->nodes = NULL;
+	idx->phrases = NULL;
+	idx->nnodes = idx->nphrases = 0;
+}
+
+int pm_add(struct pm_index *idx, const char *text, int value)
+{
+	unsigned int syl[PM_MAX_SYL];
+	struct pm_phrase *ph;
+	int n, i, node = 0;
+
+	n = pm_syllables(text, strlen(text), syl, PM_MAX_SYL);
+	if (n == 0 || idx->nnodes + n > idx->max_nodes)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		int c = idx->nodes[node].child;
+		if (idx->nodes[node].max_cost < n / 2)
+			idx->nodes[node].max_cost = n / 2;
+		while (c >= 0 && idx->nodes[c].syl != syl[i])
+			c = idx->nodes[c].next;
+		if (c < 0) {
+			c = idx->nnodes++;
+			idx->nodes[c].syl = syl[i];
+			idx->nodes[c].child = -1;
+			idx->nodes[c].phrase = -1;
+			idx->nodes[c].max_cost = 0;
+			idx->nodes[c].next = idx->nodes[node].child;
+			idx->nodes[node].child = c;
+		}
+		node = c;
+	}
+
+	if (idx->nodes[node].phrase >= 0) {
+		ph = &idx->phrases[idx->nodes[node].phrase];
+	} else {
+		if (idx->nphrases >= idx->max_phrases)
+			return -1;
+		idx->nodes[node].phrase = idx->nphrases;
+		ph = &idx->phrases[idx->nphrases++];
+	}
+	strncpy(ph->text, text, sizeof(ph->text) - 1);
+	ph->text[sizeof(ph->text) - 1] = '\0';
+	ph->value = value;
+	ph->nsyl = n;
+	if (idx->nodes[node].max_cost < n / 2)
+		idx->nodes[node].max_cost = n / 2;
+	return idx->nodes[node].phrase;
+}
+
+struct search {
+	const struct pm_index *idx;
+	const unsigned int *text;
+	int n;
+	int rows[PM_MAX_SYL + 1][PM_MAX_TEXT + 1];
+	unsigned char heard[NUM_SYLLABLES + 1];	/* near ids in the text */
+	int best;		/* phrase, -1 none */
+	int best_cost;
+};
+
+/* score of cost over n syllables */
+static int score_of(int cost, int nsyl)
+{
+	return 100 - cost * 100 / (nsyl * OTHER_COST);
+}
+
+/* a syllable the text has nothing like */
+static int unheard(const struct search *s, unsigned int syl)
+{
+	int j;
+
+	if (syl <= NUM_SYLLABLES)
+		return !s->heard[near_id[syl]];
+	for (j = 0; j < s->n; j++) {
+		if (s->text[j] == syl)
+			return 0;
+	}
+	return 1;
+}
+
+static void walk(struct search *s, int node, int depth, int prev_low)
+{
+	const struct pm_node *nd;
+	int c, j;
+
+	for (c = s->idx->nodes[node].child; c >= 0; c = nd->next) {
+		const int *prev = s->rows[depth];
+		int *row = s->rows[depth + 1];
+		int low;
+
+		nd = &s->idx->nodes[c];
+		/* every cell of the row would cost OTHER_COST more than the
+		 * cheapest of the last one */
+		if (prev_low + OTHER_COST > nd->max_cost && unheard(s, nd->syl))
+			continue;
+		/* row[j]: phrase up to here against text ending at j */
+		row[0] = prev[0] + OTHER_COST;
+		low = row[0];
+		for (j = 1; j <= s->n; j++) {
+			int v = prev[j - 1] + sub_cost(nd->syl, s->text[j - 1]);
+			if (prev[j] + OTHER_COST < v)
+				v = prev[j] + OTHER_COST;
+			if (row[j - 1] + OTHER_COST < v)
+				v = row[j - 1] + OTHER_COST;
+			row[j] = v;
+			if (v < low)
+				low = v;
+		}
+
+		if (nd->phrase >= 0) {
+			const struct pm_phrase *ph = &s->idx->phrases[nd->phrase];
+			if (low <= ph->nsyl / 2 && (s->best < 0
+				|| score_of(low, ph->nsyl) > score_of(s->best_cost, s->idx->phrases[s->best].nsyl)
+				|| (score_of(low, ph->nsyl) == score_of(s->best_cost, s->idx->phrases[s->best].nsyl)
+					&& ph->nsyl > s->idx->phrases[s->best].nsyl))) {
+				s->best = nd->phrase;
+				s->best_cost = low;
+			}
+		}
+		/* no phrase below can get cheaper than low */
+		if (low <= nd->max_cost && nd->child >= 0 && depth + 1 < PM_MAX_SYL)
+			walk(s, c, depth + 1, low);
+	}
+}
+
+int pm_search(struct pm_index *idx, const char *text, size_t len, struct pm_match *m)
+{
+	unsigned int syl[PM_MAX_TEXT];
+	struct search s;
+	double t0 = lat_now_ms();
+	int j;
+
+	s.idx = idx;
+	s.text = syl;
+	s.n = pm_syllables(text, len, syl, PM_MAX_TEXT);
+	s.best = -1;
+	s.best_cost = 0;
+	/* free start: the phrase may begin anywhere in the text */
+	for (j = 0; j <= s.n; j++)
+		s.rows[0][j] = 0;
+	memset(s.heard, 0, sizeof(s.heard));
+	for (j = 0; j < s.n; j++) {
+		if (syl[j] <= NUM_SYLLABLES)
+			s.heard[near_id[syl[j]]] = 1;
+	}
+	if (s.n > 0)
+		walk(&s, 0, 0, 0);
+
+	idx->searches++;
+	lat_add(&idx->lat, lat_now_ms() - t0);
+	if (s.best < 0)
+		return 0;
+	idx->hits++;
+	m->phrase = s.best;
+	m->value = idx->phrases[s.best].value;
+	m->text = idx->phrases[s.best].text;
+	m->cost = s.best_cost;
+	m->score = score_of(s.best_cost, idx->phrases[s.best].nsyl);
+	return 1;
+}
+
+void pm_report(const struct pm_index *idx)
+{
+	printf("[pinyin] %d phrases, %d nodes, %lu searches, %lu hits\n",
+		idx->nphrases, idx->nnodes, idx->searches, idx->hits);
+	lat_report(&idx->lat);
+}
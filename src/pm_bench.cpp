@@ -0,0 +1,189 @@
+/*
+@file
+@brief pinyin matching on a corpus of results with homophone errors, one
+	"<result>\t<expected phrase or ->" per line. Counts the results the
+	exact match gets right, then exact + pinyin, and what pinyin gets
+	wrong. The command table and the default objects are padded with
+	random phrases up to <phrases> to time the search on a large index.
+
+	pm_bench <corpus.txt> [commands.txt=/etc/commands.txt] [phrases=2000] [loops=200]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pinyin_match.h"
+#include "text_norm.h"
+#include "latency_stats.h"
+
+#define MAX_LINES	1024
+#define LINE_LEN	512
+#define PREFIX		"机器人"
+
+static const char *const objects[] = {
+	"瓶子", "背包", "玩具", "水杯", "枕头", "椅子", "显示器"
+};
+
+/* filler phrases are drawn from these */
+static const char pool[] =
+	"爱安八白半包报杯北本比边表别病不才菜长唱车成吃出穿次从错大打带单当到道得灯等"
+	"地点电定动东都读对多饿二发饭方放飞分风服该感高告个给跟更工公狗够古故关光贵国"
+	"过还海好号喝和很后话画换回会或机几家见讲叫接姐今进近经静九就句开看靠可快来了"
+	"里路吗买慢没门们名明拿那呢能你年跑瓶平七起气前钱请去让人日三上少谁什声十时是"
+	"收手书水说四送他太天听停头图推腿外完玩晚为位我五喜下先现想向小笑写新星行要也"
+	"一以椅意又有右语在再早怎张找照这真正只中转子字走左做坐";
+
+static char text[MAX_LINES][LINE_LEN];
+static char expect[MAX_LINES][PM_PHRASE_LEN];
+static int nlines;
+static char phrases[4096][PM_PHRASE_LEN];
+static char norm_phrases[4096][PM_PHRASE_LEN];
+static int nreal;
+
+static int read_corpus(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[LINE_LEN];
+	char *tab;
+
+	if (!f)
+		return -1;
+	while (nlines < MAX_LINES && fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		tab = strchr(line, '\t');
+		if (!tab)
+			continue;
+		*tab = '\0';
+		strcpy(text[nlines], line);
+		strncpy(expect[nlines], tab + 1, PM_PHRASE_LEN - 1);
+		nlines++;
+	}
+	fclose(f);
+	return nlines;
+}
+
+static void add_phrase(struct pm_index *idx, const char *s)
+{
+	if (nreal >= 4096 || pm_add(idx, s, nreal) < 0)
+		return;
+	strcpy(phrases[nreal], s);
+	tn_normalize(s, strlen(s), norm_phrases[nreal], PM_PHRASE_LEN, NULL, NULL);
+	nreal++;
+}
+
+static int read_commands(struct pm_index *idx, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[256], cmd[PM_PHRASE_LEN];
+	unsigned int i;
+
+	if (!f)
+		return -1;
+	for (i = 0; i < sizeof(objects) / sizeof(objects[0]); i++) {
+		snprintf(cmd, sizeof(cmd), "寻找%s", objects[i]);
+		add_phrase(idx, cmd);
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%63[^-]-", cmd) == 1)
+			add_phrase(idx, cmd);
+	}
+	fclose(f);
+	return nreal;
+}
+
+/* random phrases of 3..6 characters from the pool */
+static void pad(struct pm_index *idx, int total)
+{
+	int nchars = (sizeof(pool) - 1) / 3;
+	char s[PM_PHRASE_LEN];
+	int k, len;
+
+	srand(42);
+	while (idx->nphrases < total) {
+		len = 3 + rand() % 4;
+		for (k = 0; k < len; k++)
+			memcpy(s + k * 3, pool + (rand() % nchars) * 3, 3);
+		s[len * 3] = '\0';
+		if (pm_add(idx, s, -1) < 0)
+			break;
+	}
+}
+
+/* the exact match of xf_asr: the first phrase of the table in the text */
+static int exact(const char *norm)
+{
+	int i;
+
+	for (i = 0; i < nreal; i++) {
+		if (strstr(norm, norm_phrases[i]))
+			return i;
+	}
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *cmd_path = argc > 2 ? argv[2] : "/etc/commands.txt";
+	int total = argc > 3 ? atoi(argv[3]) : 2000;
+	int loops = argc > 4 ? atoi(argv[4]) : 200;
+	struct pm_index idx;
+	struct pm_match m;
+	struct latency_stats lat;
+	char norm[LINE_LEN];
+	int ok_exact = 0, ok_fuzzy = 0, wrong = 0, targets = 0;
+	int i, l;
+
+	if (argc < 2) {
+		printf("usage: %s <corpus.txt> [commands.txt] [phrases] [loops]\n", argv[0]);
+		return -1;
+	}
+	if (pm_init(&idx, total > 64 ? total : 64) || read_corpus(argv[1]) <= 0
+		|| read_commands(&idx, cmd_path) <= 0) {
+		printf("cannot read %s or %s\n", argv[1], cmd_path);
+		return -1;
+	}
+
+	for (i = 0; i < nlines; i++) {
+		const char *want = strcmp(expect[i], "-") ? expect[i] : NULL;
+		const char *got;
+		int e;
+
+		tn_normalize(text[i], strlen(text[i]), norm, sizeof(norm), PREFIX, NULL);
+		e = exact(norm);
+		targets += want != NULL;
+		if (e >= 0) {
+			got = phrases[e];
+			ok_exact += want && !strcmp(got, want);
+		} else if (pm_search(&idx, norm, strlen(norm), &m)) {
+			got = m.text;
+		} else {
+			got = NULL;
+		}
+		if (want ? got && !strcmp(got, want) : !got) {
+			ok_fuzzy += want != NULL;
+		} else {
+			if (got)
+				wrong++;
+			printf("[%s] want %s, got %s\n", text[i], want ? want : "-", got ? got : "-");
+		}
+	}
+	printf("%d results, %d with a command: exact %d, exact + pinyin %d, wrong %d\n",
+		nlines, targets, ok_exact, ok_fuzzy, wrong);
+
+	pad(&idx, total);
+	lat_init(&lat, "pinyin search per result");
+	for (l = 0; l < loops; l++) {
+		for (i = 0; i < nlines; i++) {
+			double t0;
+			tn_normalize(text[i], strlen(text[i]), norm, sizeof(norm), PREFIX, NULL);
+			t0 = lat_now_ms();
+			pm_search(&idx, norm, strlen(norm), &m);
+			lat_add(&lat, lat_now_ms() - t0);
+		}
+	}
+	printf("%d phrases, %d trie nodes: %.2f us mean per search\n",
+		idx.nphrases, idx.nnodes, lat_mean(&lat) * 1000);
+	lat_report(&lat);
+	pm_destroy(&idx);
+	return 0;
+}
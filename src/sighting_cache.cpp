@@ -0,0 +1,99 @@
+/*
+@file
+@brief recent object detections, see sighting_cache.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "sighting_cache.h"
+
+void sight_init(struct sighting_cache *c, double ttl_ms)
+{
+	memset(c, 0, sizeof(*c));
+	c->ttl_ms = ttl_ms;
+	lat_init(&c->search, "object search (detection pass)");
+	lat_init(&c->saved, "object search saved by cache");
+}
+
+static struct sighting *find(struct sighting_cache *c, const char *name)
+{
+	int i;
+
+	for (i = 0; i < c->count; i++) {
+		if (!strcmp(c->items[i].name, name))
+			return &c->items[i];
+	}
+	return NULL;
+}
+
+static void forget(struct sighting_cache *c, struct sighting *s)
+{
+	*s = c->items[--c->count];
+}
+
+int sight_lookup(struct sighting_cache *c, const char *name, struct sighting *out)
+{
+	struct sighting *s = find(c, name);
+
+	if (s && lat_now_ms() - s->t_ms > c->ttl_ms) {
+		forget(c, s);
+		s = NULL;
+	}
+	if (!s) {
+		c->misses++;
+		return 0;
+	}
+
+	c->hits++;
+	lat_add(&c->saved, s->search_ms);
+	*out = *s;
+	return 1;
+}
+
+void sight_store(struct sighting_cache *c, const char *name, int found,
+		float x, float y, float z, double search_ms)
+{
+	struct sighting *s = find(c, name);
+	int i, oldest = 0;
+
+	lat_add(&c->search, search_ms);
+	if (!found) {
+		if (s)
+			forget(c, s);
+		return;
+	}
+	if (strlen(name) >= SIGHT_NAME_LEN)
+		return;
+
+	if (!s && c->count < SIGHT_MAX)
+		s = &c->items[c->count++];
+	if (!s) {
+		/* full: the oldest sighting goes */
+		for (i = 1; i < c->count; i++) {
+			if (c->items[i].t_ms < c->items[oldest].t_ms)
+				oldest = i;
+		}
+		s = &c->items[oldest];
+	}
+	strcpy(s->name, name);
+	s->x = x;
+	s->y = y;
+	s->z = z;
+	s->t_ms = lat_now_ms();
+	s->search_ms = search_ms;
+}
+
+void sight_clear(struct sighting_cache *c)
+{
+	c->count = 0;
+}
+
+void sight_report(const struct sighting_cache *c)
+{
+	unsigned long n = c->hits + c->misses;
+
+	printf("[sight] %lu lookups, %lu hits (%.0f%%), %d kept, ttl %.0fms\n",
+		n, c->hits, n ? 100.0 * c->hits / n : 0.0, c->count, c->ttl_ms);
+	lat_report(&c->search);
+	lat_report(&c->saved);
+}
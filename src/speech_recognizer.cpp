@@ -63,7 +63,7 @@ static void end_sr_on_error(struct speech_rec *sr, int errcode)
 	
 	if (sr->session_id) {
 		if (sr->notif.on_speech_end)
-			sr->notif.on_speech_end(errcode);
+			sr->notif.on_speech_end(sr->notif.user, errcode);
 
 		QISRSessionEnd(sr->session_id, "err");
 		sr->session_id = NULL;
@@ -82,24 +82,76 @@ static void end_sr_on_vad(struct speech_rec *sr)
 	while(sr->rec_stat != MSP_REC_STATUS_COMPLETE ){
 		rslt = QISRGetResult(sr->session_id, &sr->rec_stat, 0, &errcode);
 		if (rslt && sr->notif.on_result)
-			sr->notif.on_result(rslt, sr->rec_stat == MSP_REC_STATUS_COMPLETE ? 1 : 0);
+			sr->notif.on_result(sr->notif.user, rslt, sr->rec_stat == MSP_REC_STATUS_COMPLETE ? 1 : 0);
 
 		Sleep(100); /* for cpu occupy, should sleep here */
 	}
 
 	if (sr->session_id) {
 		if (sr->notif.on_speech_end)
-			sr->notif.on_speech_end(END_REASON_VAD_DETECT);
+			sr->notif.on_speech_end(sr->notif.user, END_REASON_VAD_DETECT);
 		QISRSessionEnd(sr->session_id, "VAD Normal");
 		sr->session_id = NULL;
 	}
 	sr->state = SR_STATE_INIT;
 }
 
+/* the result is already known locally, so nothing is fetched from the cloud */
+static void end_sr_on_cancel(struct speech_rec *sr)
+{
+	if (sr->aud_src == SR_MIC)
+		stop_record(sr->recorder);
+
+	if (sr->session_id) {
+		if (sr->notif.on_speech_end)
+			sr->notif.on_speech_end(sr->notif.user, END_REASON_CANCELED);
+		QISRSessionEnd(sr->session_id, "local cancel");
+		sr->session_id = NULL;
+	}
+	sr->state = SR_STATE_INIT;
+}
+
+/* the end of speech was seen locally before the cloud VAD: close the audio
+ * stream now and collect the result */
+static void end_sr_on_local_eos(struct speech_rec *sr)
+{
+	int errcode;
+	const char *rslt;
+
+	if (sr->aud_src == SR_MIC)
+		stop_record(sr->recorder);
+
+	errcode = QISRAudioWrite(sr->session_id, NULL, 0, MSP_AUDIO_SAMPLE_LAST, &sr->ep_stat, &sr->rec_stat);
+	if (errcode) {
+		end_sr_on_error(sr, errcode);
+		return;
+	}
+
+	while (sr->rec_stat != MSP_REC_STATUS_COMPLETE) {
+		rslt = QISRGetResult(sr->session_id, &sr->rec_stat, 0, &errcode);
+		if (MSP_SUCCESS != errcode) {
+			end_sr_on_error(sr, errcode);
+			return;
+		}
+		if (rslt && sr->notif.on_result)
+			sr->notif.on_result(sr->notif.user, rslt, sr->rec_stat == MSP_REC_STATUS_COMPLETE ? 1 : 0);
+		Sleep(10);
+	}
+
+	if (sr->session_id) {
+		if (sr->notif.on_speech_end)
+			sr->notif.on_speech_end(sr->notif.user, END_REASON_LOCAL_EOS);
+		QISRSessionEnd(sr->session_id, "local eos");
+		sr->session_id = NULL;
+	}
+	sr->state = SR_STATE_INIT;
+}
+
 /* the record call back */
 static void iat_cb(char *data, unsigned long len, void *user_para)
 {
 	int errcode;
+	int action = SR_AUDIO_CONTINUE;
 	struct speech_rec *sr;
 
 	if(len == 0 || data == NULL)
@@ -111,12 +163,23 @@ static void iat_cb(char *data, unsigned long len, void *user_para)
 		return;
 	if (sr->state < SR_STATE_STARTED)
 		return; /* ignore the data if error/vad happened */
-	
+
+	if (sr->notif.on_audio)
+		action = sr->notif.on_audio(sr->notif.user, data, len);
+	if (action == SR_AUDIO_CANCEL) {
+		end_sr_on_cancel(sr);
+		return;
+	}
+
 	errcode = sr_write_audio_data(sr, data, len);
 	if (errcode) {
 		end_sr_on_error(sr, errcode);
 		return;
 	}
+
+	/* the cloud VAD may have ended the session with this buffer already */
+	if (action == SR_AUDIO_FINISH && sr->state >= SR_STATE_STARTED)
+		end_sr_on_local_eos(sr);
 }
 
 static char * skip_space(char *s)
@@ -230,9 +293,8 @@ int sr_init(struct speech_rec * sr, const char * session_begin_params,
 			get_default_input_dev(), notify);
 }
 
-int sr_start_listening(struct speech_rec *sr)
+int sr_prepare(struct speech_rec *sr)
 {
-	int ret;
 	const char*		session_id = NULL;
 	int				errcode = MSP_SUCCESS;
 
@@ -240,14 +302,35 @@ int sr_start_listening(struct speech_rec *sr)
 		sr_dbg("already STARTED.\n");
 		return -E_SR_ALREADY;
 	}
+	if (sr->session_id)
+		return 0;
 
-	session_id = QISRSessionBegin(NULL, sr->session_begin_params, &errcode); //дҪ﷨һΪNULL
+	session_id = QISRSessionBegin(sr->grammar_list, sr->session_begin_params, &errcode); //дҪ﷨һΪNULL
 	if (MSP_SUCCESS != errcode)
 	{
 		sr_dbg("\nQISRSessionBegin failed! error code:%d\n", errcode);
 		return errcode;
 	}
 	sr->session_id = session_id;
+	return 0;
+}
+
+int sr_start_listening(struct speech_rec *sr)
+{
+	int ret;
+	const char*		session_id = NULL;
+	int				errcode = MSP_SUCCESS;
+
+	if (sr->state >= SR_STATE_STARTED) {
+		sr_dbg("already STARTED.\n");
+		return -E_SR_ALREADY;
+	}
+
+	/* a session opened by sr_prepare is used as is */
+	errcode = sr_prepare(sr);
+	if (errcode)
+		return errcode;
+	session_id = sr->session_id;
 	sr->ep_stat = MSP_EP_LOOKING_FOR_SPEECH;
 	sr->rec_stat = MSP_REC_STATUS_SUCCESS;
 	sr->audio_status = MSP_AUDIO_SAMPLE_FIRST;
@@ -265,7 +348,7 @@ int sr_start_listening(struct speech_rec *sr)
 	sr->state = SR_STATE_STARTED;
 
 	if (sr->notif.on_speech_begin)
-		sr->notif.on_speech_begin();
+		sr->notif.on_speech_begin(sr->notif.user);
 
 	return 0;
 }
@@ -306,6 +389,7 @@ int sr_stop_listening(struct speech_rec *sr)
 	if (ret != 0) {
 		sr_dbg("write LAST_SAMPLE failed: %d\n", ret);
 		QISRSessionEnd(sr->session_id, "write err");
+		sr->session_id = NULL;
 		return ret;
 	}
 
@@ -317,7 +401,7 @@ int sr_stop_listening(struct speech_rec *sr)
 			return ret;
 		}
 		if (NULL != rslt && sr->notif.on_result)
-			sr->notif.on_result(rslt, sr->rec_stat == MSP_REC_STATUS_COMPLETE ? 1 : 0);
+			sr->notif.on_result(sr->notif.user, rslt, sr->rec_stat == MSP_REC_STATUS_COMPLETE ? 1 : 0);
 		Sleep(100);
 	}
 
@@ -350,7 +434,7 @@ int sr_write_audio_data(struct speech_rec *sr, char *data, unsigned int len)
 			return ret;
 		}
 		if (NULL != rslt && sr->notif.on_result)
-			sr->notif.on_result(rslt, sr->rec_stat == MSP_REC_STATUS_COMPLETE ? 1 : 0);
+			sr->notif.on_result(sr->notif.user, rslt, sr->rec_stat == MSP_REC_STATUS_COMPLETE ? 1 : 0);
 	}
 
 	if (MSP_EP_AFTER_SPEECH == sr->ep_stat)
@@ -359,8 +443,32 @@ int sr_write_audio_data(struct speech_rec *sr, char *data, unsigned int len)
 	return 0;
 }
 
+int sr_set_grammar(struct speech_rec *sr, const char *grammar_list)
+{
+	if (!sr)
+		return -E_SR_INVAL;
+
+	if (sr->grammar_list) {
+		SR_MFREE(sr->grammar_list);
+		sr->grammar_list = NULL;
+	}
+	if (grammar_list) {
+		sr->grammar_list = (char*)SR_MALLOC(strlen(grammar_list) + 1);
+		if (sr->grammar_list == NULL)
+			return -E_SR_NOMEM;
+		strcpy(sr->grammar_list, grammar_list);
+	}
+	return 0;
+}
+
 void sr_uninit(struct speech_rec * sr)
 {
+	/* prepared, never started */
+	if (sr->session_id && sr->state < SR_STATE_STARTED) {
+		QISRSessionEnd(sr->session_id, "unused");
+		sr->session_id = NULL;
+	}
+
 	if (sr->recorder) {
 		if(!is_record_stopped(sr->recorder))
 			stop_record(sr->recorder);
@@ -373,4 +481,9 @@ void sr_uninit(struct speech_rec * sr)
 		SR_MFREE(sr->session_begin_params);
 		sr->session_begin_params = NULL;
 	}
+
+	if (sr->grammar_list) {
+		SR_MFREE(sr->grammar_list);
+		sr->grammar_list = NULL;
+	}
 }
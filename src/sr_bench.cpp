@@ -0,0 +1,115 @@
+/*
+@file
+@brief recognition throughput against the number of concurrent sessions.
+	The same 16k mono wav is streamed by 1..N sessions at once, each
+	session repeating it <loops> times.
+
+	sr_bench <utterance.wav> [max_sessions=4] [loops=3] [realtime=1]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "msp_cmn.h"
+#include "msp_errors.h"
+#include "sr_manager.h"
+
+static const char *login_params = "appid = 58e631a9, work_dir = .";
+static const char *session_params =
+	"sub = iat, domain = iat, language = zh_cn, "
+	"accent = mandarin, sample_rate = 16000, "
+	"result_type = json, result_encoding = utf8";
+
+/* data chunk of a 16 bit pcm wav, NULL if anything else */
+static short *read_wav(const char *path, size_t *samples)
+{
+	FILE *f = fopen(path, "rb");
+	unsigned char hdr[12], chunk[8];
+	unsigned int size;
+	short *pcm = NULL;
+
+	if (!f)
+		return NULL;
+	if (fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4))
+		goto DONE;
+	while (fread(chunk, 1, 8, f) == 8) {
+		size = chunk[4] | chunk[5] << 8 | chunk[6] << 16 | (unsigned int)chunk[7] << 24;
+		if (memcmp(chunk, "data", 4)) {
+			fseek(f, size + (size & 1), SEEK_CUR);
+			continue;
+		}
+		pcm = (short *)malloc(size);
+		if (pcm && fread(pcm, 1, size, f) == size) {
+			*samples = size / sizeof(short);
+		} else {
+			free(pcm);
+			pcm = NULL;
+		}
+		break;
+	}
+DONE:
+	fclose(f);
+	return pcm;
+}
+
+static void on_utterance(struct sr_session *s, const char *text, void *)
+{
+	printf("  session %d: [%s]\n", s->id, text);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct sr_manager mgr;
+	struct latency_stats lat;
+	unsigned int utterances, errors;
+	double audio_ms, t0, wall_ms;
+	size_t samples = 0;
+	short *pcm;
+	int max_sessions = argc > 2 ? atoi(argv[2]) : 4;
+	int loops = argc > 3 ? atoi(argv[3]) : 3;
+	int realtime = argc > 4 ? atoi(argv[4]) : 1;
+	int n, i, ret;
+
+	if (argc < 2) {
+		printf("usage: %s utterance.wav [max_sessions] [loops] [realtime]\n", argv[0]);
+		return 1;
+	}
+	if (max_sessions < 1 || max_sessions > SR_MAX_SESSIONS)
+		max_sessions = SR_MAX_SESSIONS;
+	pcm = read_wav(argv[1], &samples);
+	if (!pcm || samples == 0) {
+		printf("cannot read %s\n", argv[1]);
+		return 1;
+	}
+
+	ret = MSPLogin(NULL, NULL, login_params);
+	if (MSP_SUCCESS != ret) {
+		printf("MSPLogin failed %d\n", ret);
+		free(pcm);
+		return 1;
+	}
+
+	printf("%.1fs utterance, %d loops per session, %s\n",
+		samples / (double)SR_MGR_SAMPLE_RATE, loops, realtime ? "realtime" : "as fast as possible");
+	printf("sessions  utt  err  utt/s  audio/wall  p50ms  p95ms\n");
+	for (n = 1; n <= max_sessions; n++) {
+		sr_mgr_init(&mgr, session_params, n == 1 ? on_utterance : NULL, NULL);
+		for (i = 0; i < n; i++)
+			sr_mgr_add_stream(&mgr, pcm, samples, realtime);
+
+		t0 = lat_now_ms();
+		sr_mgr_start(&mgr, loops);
+		sr_mgr_join(&mgr);
+		wall_ms = lat_now_ms() - t0;
+
+		lat_init(&lat, "result");
+		sr_mgr_stats(&mgr, &lat, &utterances, &errors, &audio_ms);
+		printf("%8d %4u %4u %6.2f %11.2f %6.0f %6.0f\n", n, utterances, errors,
+			utterances * 1000.0 / wall_ms, audio_ms / wall_ms,
+			lat_percentile(&lat, 50), lat_percentile(&lat, 95));
+	}
+
+	MSPLogout();
+	free(pcm);
+	return 0;
+}
@@ -0,0 +1,245 @@
+/*
+@file
+@brief concurrent recognition sessions, see sr_manager.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "msp_errors.h"
+#include "sr_manager.h"
+
+#define MGR_DBGON 0
+#if MGR_DBGON == 1
+#	define mgr_dbg printf
+#else
+#	define mgr_dbg(...)
+#endif
+
+#define STREAM_CHUNK_MS		100
+
+static void on_result(void *user, const char *result, char)
+{
+	struct sr_session *s = (struct sr_session *)user;
+	struct iat_fragment frag;
+	size_t n;
+
+	if (!result)
+		return;
+	if (s->json) {
+		if (iat_parse_fragment(result, strlen(result), &frag) == 0)
+			iat_hyp_apply(&s->hyp, &frag);
+		return;
+	}
+
+	n = strlen(result);
+	if (s->hyp.text_len + n >= sizeof(s->hyp.text))
+		n = sizeof(s->hyp.text) - 1 - s->hyp.text_len;
+	memcpy(s->hyp.text + s->hyp.text_len, result, n);
+	s->hyp.text_len += n;
+	s->hyp.text[s->hyp.text_len] = '\0';
+}
+
+static void on_speech_begin(void *user)
+{
+	struct sr_session *s = (struct sr_session *)user;
+
+	iat_hyp_reset(&s->hyp);
+	s->speech_end = 0;
+	s->end_reason = 0;
+}
+
+static void on_speech_end(void *user, int reason)
+{
+	struct sr_session *s = (struct sr_session *)user;
+
+	s->end_reason = reason;
+	if (reason != END_REASON_VAD_DETECT && reason != END_REASON_LOCAL_EOS)
+		s->errors++;
+	s->last_audio_ms = lat_now_ms();
+	s->speech_end = 1;
+}
+
+static void mgr_init_session(struct sr_manager *mgr, struct sr_session *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->id = mgr->count;
+	s->mgr = mgr;
+	s->json = strstr(mgr->params, "json") != NULL;
+	lat_init(&s->lat, "session");
+}
+
+void sr_mgr_init(struct sr_manager *mgr, const char *params, sr_utterance_cb cb, void *user)
+{
+	memset(mgr, 0, sizeof(*mgr));
+	strncpy(mgr->params, params, sizeof(mgr->params) - 1);
+	mgr->on_utterance = cb;
+	mgr->user = user;
+}
+
+int sr_mgr_add_mic(struct sr_manager *mgr, record_dev_id devid)
+{
+	struct sr_session *s;
+
+	if (mgr->count >= SR_MAX_SESSIONS)
+		return -1;
+	s = &mgr->sessions[mgr->count];
+	mgr_init_session(mgr, s);
+	s->src = SR_MIC;
+	s->devid = devid;
+	return mgr->count++;
+}
+
+int sr_mgr_add_stream(struct sr_manager *mgr, const short *pcm, size_t samples, int realtime)
+{
+	struct sr_session *s;
+
+	if (mgr->count >= SR_MAX_SESSIONS)
+		return -1;
+	s = &mgr->sessions[mgr->count];
+	mgr_init_session(mgr, s);
+	s->src = SR_USER;
+	s->pcm = pcm;
+	s->samples = samples;
+	s->realtime = realtime;
+	return mgr->count++;
+}
+
+/* one utterance from the microphone, until the VAD or sr_mgr_stop ends it */
+static int run_mic(struct sr_session *s)
+{
+	int ret;
+
+	ret = sr_start_listening(&s->rec);
+	if (ret)
+		return ret;
+	while (!s->speech_end && !s->mgr->stop)
+		usleep(10 * 1000);
+	if (!s->speech_end)
+		s->last_audio_ms = lat_now_ms();
+	return sr_stop_listening(&s->rec);
+}
+
+/* the whole buffer as one utterance */
+static int run_stream(struct sr_session *s)
+{
+	size_t chunk = SR_MGR_SAMPLE_RATE * STREAM_CHUNK_MS / 1000;
+	size_t off, n;
+	int ret;
+
+	ret = sr_start_listening(&s->rec);
+	if (ret)
+		return ret;
+	/* the session ends itself once its VAD sees the end of speech */
+	for (off = 0; off < s->samples && s->rec.session_id && !s->mgr->stop; off += n) {
+		n = s->samples - off < chunk ? s->samples - off : chunk;
+		ret = sr_write_audio_data(&s->rec, (char *)(s->pcm + off), n * sizeof(short));
+		if (ret)
+			return ret;
+		if (s->realtime)
+			usleep(STREAM_CHUNK_MS * 1000);
+	}
+	if (!s->speech_end)
+		s->last_audio_ms = lat_now_ms();
+	s->audio_ms += off * 1000.0 / SR_MGR_SAMPLE_RATE;
+	return sr_stop_listening(&s->rec);
+}
+
+static void *session_proc(void *arg)
+{
+	struct sr_session *s = (struct sr_session *)arg;
+	struct sr_manager *mgr = s->mgr;
+	struct speech_rec_notifier notifier = {
+		on_result,
+		on_speech_begin,
+		on_speech_end,
+		NULL,
+		s
+	};
+	double t0;
+	int n = 0;
+	int ret;
+
+	ret = sr_init_ex(&s->rec, mgr->params, s->src, s->devid, &notifier);
+	if (ret) {
+		printf("session %d: init failed %d\n", s->id, ret);
+		s->errors++;
+		return NULL;
+	}
+
+	while (!mgr->stop && (mgr->loops == 0 || n < mgr->loops)) {
+		t0 = lat_now_ms();
+		ret = s->src == SR_MIC ? run_mic(s) : run_stream(s);
+		n++;
+		if (ret) {
+			mgr_dbg("session %d: utterance failed %d\n", s->id, ret);
+			s->errors++;
+			continue;
+		}
+		if (s->src == SR_MIC)
+			s->audio_ms += s->last_audio_ms - t0;
+		lat_add(&s->lat, lat_now_ms() - s->last_audio_ms);
+		s->utterances++;
+		if (mgr->on_utterance)
+			mgr->on_utterance(s, s->hyp.text, mgr->user);
+	}
+
+	sr_uninit(&s->rec);
+	return NULL;
+}
+
+int sr_mgr_start(struct sr_manager *mgr, int loops)
+{
+	int i, started = 0;
+
+	mgr->loops = loops;
+	mgr->stop = 0;
+	for (i = 0; i < mgr->count; i++) {
+		struct sr_session *s = &mgr->sessions[i];
+		s->running = pthread_create(&s->thread, NULL, session_proc, s) == 0;
+		if (s->running)
+			started++;
+		else
+			printf("session %d: no thread\n", i);
+	}
+	return started;
+}
+
+void sr_mgr_join(struct sr_manager *mgr)
+{
+	int i;
+
+	for (i = 0; i < mgr->count; i++) {
+		if (mgr->sessions[i].running) {
+			pthread_join(mgr->sessions[i].thread, NULL);
+			mgr->sessions[i].running = 0;
+		}
+	}
+}
+
+void sr_mgr_stop(struct sr_manager *mgr)
+{
+	mgr->stop = 1;
+	sr_mgr_join(mgr);
+}
+
+void sr_mgr_stats(const struct sr_manager *mgr, struct latency_stats *lat,
+		unsigned int *utterances, unsigned int *errors, double *audio_ms)
+{
+	int i;
+	unsigned int j, n;
+
+	*utterances = 0;
+	*errors = 0;
+	*audio_ms = 0;
+	for (i = 0; i < mgr->count; i++) {
+		const struct sr_session *s = &mgr->sessions[i];
+		*utterances += s->utterances;
+		*errors += s->errors;
+		*audio_ms += s->audio_ms;
+		n = s->lat.count < LAT_MAX_SAMPLES ? s->lat.count : LAT_MAX_SAMPLES;
+		for (j = 0; j < n; j++)
+			lat_add(lat, s->lat.samples[j]);
+	}
+}
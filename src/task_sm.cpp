@@ -0,0 +1,264 @@
+/*
+@file
+@brief task state machine, see task_sm.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "task_sm.h"
+
+#define SM_DBGON 0
+#if SM_DBGON == 1
+#	define sm_dbg printf
+#else
+#	define sm_dbg(...)
+#endif
+
+/* the commands of /etc/commands.txt on a plain robot. specific rows
+ * before the ANY rows of the same event */
+static constexpr struct sm_transition builtin_rows[] = {
+	/* src		event			dst		action		pub	via */
+	{SM_ANY,	SM_EV_STOP,		SM_IDLE,	SM_ACT_PUBLISH,	-1,	SM_NONE},
+	{SM_IDLE,	SM_EV_PF_START,		SM_PF,		SM_ACT_PUBLISH,	-1,	SM_NONE},
+	{SM_PF,		SM_EV_PF_STOP,		SM_IDLE,	SM_ACT_PUBLISH,	2,	SM_NONE},
+	{SM_IDLE,	SM_EV_VSLAM_START,	SM_VSLAM,	SM_ACT_PUBLISH,	-1,	SM_NONE},
+	{SM_VSLAM,	SM_EV_VSLAM_STOP,	SM_IDLE,	SM_ACT_PUBLISH,	-1,	SM_NONE},
+	{SM_VSLAM,	SM_EV_BYE,		SM_IDLE,	SM_ACT_LOCK,	4,	SM_NONE},
+	{SM_PF,		SM_EV_BYE,		SM_IDLE,	SM_ACT_LOCK,	2,	SM_NONE},
+	{SM_ANY,	SM_EV_BYE,		SM_IDLE,	SM_ACT_LOCK,	-1,	SM_NONE},
+	{SM_ANY,	SM_EV_ARM,		SM_SAME,	SM_ACT_PUBLISH,	6,	SM_NONE},
+	{SM_HAND_OPEN,	SM_EV_HAND_OPEN,	SM_REJECT,	SM_ACT_NONE,	-1,	SM_NONE},
+	{SM_ANY,	SM_EV_HAND_OPEN,	SM_HAND_OPEN,	SM_ACT_PUBLISH,	-1,	SM_NONE},
+	{SM_HAND_OPEN,	SM_EV_HAND_CLOSE,	SM_HAND_CLOSE,	SM_ACT_PUBLISH,	-1,	SM_NONE},
+	{SM_ANY,	SM_EV_FIND,		SM_SAME,	SM_ACT_FIND,	-1,	SM_OR},
+	{SM_PF,		SM_EV_MOVE,		SM_REJECT,	SM_ACT_NONE,	-1,	SM_NONE},
+	{SM_VSLAM,	SM_EV_MOVE,		SM_REJECT,	SM_ACT_NONE,	-1,	SM_NONE},
+	{SM_ANY,	SM_EV_MOVE,		SM_IDLE,	SM_ACT_MOVE,	-1,	SM_NONE},
+	{SM_ANY,	SM_EV_TASK_DONE,	SM_IDLE,	SM_ACT_NONE,	-1,	SM_NONE},
+};
+#define BUILTIN_ROWS	((int)(sizeof(builtin_rows) / sizeof(builtin_rows[0])))
+static_assert(BUILTIN_ROWS <= SM_MAX_ROWS, "built-in table too large");
+
+/* first row for (s, e) from row i on, -1 if none */
+static constexpr int match_row(const struct sm_transition *rows, int n, int i, int s, int e)
+{
+	return i >= n ? -1
+		: rows[i].event == e && (rows[i].src == s || rows[i].src == SM_ANY) ? i
+		: match_row(rows, n, i + 1, s, e);
+}
+
+/* the built-in table as a dense array, computed by the compiler */
+struct sm_cells {
+	signed char c[SM_NSTATES * SM_NEVENTS];
+};
+template<int... I> struct cell_seq {};
+template<int N, int... I> struct make_cells : make_cells<N - 1, N - 1, I...> {};
+template<int... I> struct make_cells<0, I...> { typedef cell_seq<I...> type; };
+
+template<int... I>
+static constexpr struct sm_cells compile_builtin(cell_seq<I...>)
+{
+	return sm_cells{{ (signed char)match_row(builtin_rows, BUILTIN_ROWS, 0,
+		I / SM_NEVENTS, I % SM_NEVENTS)... }};
+}
+static constexpr struct sm_cells builtin_cells =
+	compile_builtin(make_cells<SM_NSTATES * SM_NEVENTS>::type());
+static_assert(builtin_cells.c[SM_IDLE * SM_NEVENTS + SM_EV_PF_START] == 1,
+	"PF starts from IDLE");
+
+static const char *state_names[] = {
+	"IDLE", "PF", "VSLAM", "FR", "MOVING", "OR", "HAND_OPEN", "HAND_CLOSE",
+	"ANY", "SAME", "REJECT", "NONE"
+};
+static const char *event_names[SM_NEVENTS] = {
+	"STOP", "PF_START", "PF_STOP", "VSLAM_START", "VSLAM_STOP", "BYE",
+	"ARM", "HAND_OPEN", "HAND_CLOSE", "FIND", "MOVE", "TASK_DONE"
+};
+static const char *action_names[SM_NACTIONS] = {
+	"NONE", "PUBLISH", "LOCK", "FIND", "MOVE"
+};
+static const char *time_names[SM_NSTATES] = {
+	"time in IDLE", "time in PF", "time in VSLAM", "time in FR",
+	"time in MOVING", "time in OR", "time in HAND_OPEN", "time in HAND_CLOSE"
+};
+
+const char *sm_state_name(int state)
+{
+	if (state < 0 || state > SM_NONE)
+		return "?";
+	return state_names[state];
+}
+
+const char *sm_event_name(int event)
+{
+	if (event < 0 || event >= SM_NEVENTS)
+		return "?";
+	return event_names[event];
+}
+
+void sm_init(struct task_sm *sm)
+{
+	int s;
+
+	memset(sm, 0, sizeof(*sm));
+	memcpy(sm->rows, builtin_rows, sizeof(builtin_rows));
+	sm->nrows = BUILTIN_ROWS;
+	memcpy(sm->cell, builtin_cells.c, sizeof(sm->cell));
+	for (s = 0; s < SM_NSTATES; s++)
+		lat_init(&sm->time_in[s], time_names[s]);
+	sm->state = SM_IDLE;
+	sm->entered_ms = lat_now_ms();
+}
+
+static int lookup_name(const char *const *names, int count, const char *name)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (!strcmp(names[i], name))
+			return i;
+	}
+	return -1;
+}
+
+int sm_load_profile(struct task_sm *sm, const char *path)
+{
+	struct sm_transition rows[SM_MAX_ROWS];
+	char line[256];
+	char src[32], ev[32], dst[32], act[32], via[32];
+	int nrows = 0, lineno = 0;
+	int pub, n, s, e;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		sm_dbg("sm: no profile %s, built-in table\n", path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		struct sm_transition *t = &rows[nrows];
+
+		lineno++;
+		line[strcspn(line, "#\r\n")] = '\0';
+		pub = -1;
+		strcpy(via, "NONE");
+		n = sscanf(line, "%31s %31s %31s %31s %d %31s", src, ev, dst, act, &pub, via);
+		if (n <= 0)
+			continue;
+		if (n < 4 || nrows >= SM_MAX_ROWS)
+			goto bad;
+		t->src = lookup_name(state_names, SM_NONE + 1, src);
+		t->event = lookup_name(event_names, SM_NEVENTS, ev);
+		t->dst = lookup_name(state_names, SM_NONE + 1, dst);
+		t->action = lookup_name(action_names, SM_NACTIONS, act);
+		t->pub_code = pub;
+		t->via = lookup_name(state_names, SM_NONE + 1, via);
+		if (t->src < 0 || t->src > SM_ANY || t->event < 0 || t->action < 0
+			|| t->dst < 0 || t->dst == SM_ANY || t->dst == SM_NONE
+			|| t->via < 0 || (t->via >= SM_NSTATES && t->via != SM_NONE))
+			goto bad;
+		nrows++;
+	}
+	fclose(f);
+
+	memcpy(sm->rows, rows, nrows * sizeof(rows[0]));
+	sm->nrows = nrows;
+	for (s = 0; s < SM_NSTATES; s++) {
+		for (e = 0; e < SM_NEVENTS; e++)
+			sm->cell[s][e] = match_row(sm->rows, nrows, 0, s, e);
+	}
+	sm_dbg("sm: %d rows from %s\n", nrows, path);
+	return 0;
+
+bad:
+	printf("sm: %s:%d bad row, built-in table\n", path, lineno);
+	fclose(f);
+	return -1;
+}
+
+const struct sm_transition *sm_peek(const struct task_sm *sm, int state, int event)
+{
+	int i;
+
+	if (state < 0 || state >= SM_NSTATES || event < 0 || event >= SM_NEVENTS)
+		return NULL;
+	i = sm->cell[state][event];
+	if (i < 0 || sm->rows[i].dst == SM_REJECT)
+		return NULL;
+	return &sm->rows[i];
+}
+
+const struct sm_transition *sm_lookup(struct task_sm *sm, int event)
+{
+	const struct sm_transition *t = NULL;
+	int i;
+
+	if (event < 0 || event >= SM_NEVENTS)
+		return NULL;
+	i = sm->cell[sm->state][event];
+	if (i >= 0)
+		t = &sm->rows[i];
+	if (!t || t->dst == SM_REJECT) {
+		sm->rejected[sm->state][event]++;
+		sm_dbg("sm: %s refused in %s after %.0fms (%u times)\n", event_names[event],
+			state_names[sm->state], lat_now_ms() - sm->entered_ms,
+			sm->rejected[sm->state][event]);
+		return NULL;
+	}
+	return t;
+}
+
+static void enter(struct task_sm *sm, int state, int event)
+{
+	double now = lat_now_ms();
+
+	(void)event;	// only in the trace
+	if (state == sm->state)
+		return;
+	lat_add(&sm->time_in[sm->state], now - sm->entered_ms);
+	sm_dbg("sm: %s -> %s on %s after %.0fms\n", state_names[sm->state],
+		state_names[state], event_names[event], now - sm->entered_ms);
+	sm->state = state;
+	sm->entered_ms = now;
+}
+
+void sm_begin(struct task_sm *sm, const struct sm_transition *t)
+{
+	if (t->via != SM_NONE) {
+		sm->via_ms = lat_now_ms();
+		sm_dbg("sm: %s via %s\n", event_names[t->event], state_names[t->via]);
+	}
+}
+
+void sm_finish(struct task_sm *sm, const struct sm_transition *t)
+{
+	/* the state before stays entered, the via state is a detour */
+	if (t->via != SM_NONE && sm->via_ms > 0) {
+		lat_add(&sm->time_in[t->via], lat_now_ms() - sm->via_ms);
+		lat_report(&sm->time_in[t->via]);
+		sm->via_ms = 0;
+	}
+	if (t->dst != SM_SAME) {
+		int from = sm->state;
+		enter(sm, t->dst, t->event);
+		if (from != sm->state && from != SM_IDLE)
+			lat_report(&sm->time_in[from]);
+	}
+}
+
+void sm_report(const struct task_sm *sm)
+{
+	int s, e;
+
+	printf("[sm] in %s for %.0fms, %d rows\n", state_names[sm->state],
+		lat_now_ms() - sm->entered_ms, sm->nrows);
+	for (s = 0; s < SM_NSTATES; s++) {
+		if (sm->time_in[s].count)
+			lat_report(&sm->time_in[s]);
+		for (e = 0; e < SM_NEVENTS; e++) {
+			if (sm->rejected[s][e])
+				printf("[sm] %s refused in %s %u times\n", event_names[e],
+					state_names[s], sm->rejected[s][e]);
+		}
+	}
+}
@@ -0,0 +1,218 @@
+/*
+@file
+@brief UTF-8 normalizer for command matching, see text_norm.h
+*/
+
+#include <string.h>
+#include "text_norm.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* what an ASCII byte becomes: 0 drop, else the byte to write */
+static inline char ascii_fold(unsigned char c)
+{
+	if (c >= 'a' && c <= 'z')
+		return c;
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A' + 'a';
+	if (c >= '0' && c <= '9')
+		return c;
+	return 0;	/* controls, space, punctuation */
+}
+
+/* Chinese digits, in code point order */
+static const struct { unsigned int cp; char digit; } cn_digits[] = {
+	{ 0x3007, '0' },	/* 〇 */
+	{ 0x4e00, '1' },	/* 一 */
+	{ 0x4e03, '7' },	/* 七 */
+	{ 0x4e09, '3' },	/* 三 */
+	{ 0x4e24, '2' },	/* 两 */
+	{ 0x4e5d, '9' },	/* 九 */
+	{ 0x4e8c, '2' },	/* 二 */
+	{ 0x4e94, '5' },	/* 五 */
+	{ 0x516b, '8' },	/* 八 */
+	{ 0x516d, '6' },	/* 六 */
+	{ 0x56db, '4' },	/* 四 */
+	{ 0x5e7a, '1' },	/* 幺 */
+	{ 0x96f6, '0' },	/* 零 */
+};
+
+static char cn_digit(unsigned int cp)
+{
+	int lo = 0, hi = sizeof(cn_digits) / sizeof(cn_digits[0]) - 1;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (cn_digits[mid].cp == cp)
+			return cn_digits[mid].digit;
+		if (cn_digits[mid].cp < cp)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return 0;
+}
+
+/* punctuation, symbols and spaces outside ASCII */
+static int is_punct(unsigned int cp)
+{
+	return (cp >= 0x00a0 && cp <= 0x00bf)		/* nbsp, « · » ... */
+		|| cp == 0x00d7 || cp == 0x00f7
+		|| (cp >= 0x2000 && cp <= 0x206f)	/* general punctuation — … “” */
+		|| (cp >= 0x2190 && cp <= 0x21ff)	/* arrows */
+		|| (cp >= 0x2460 && cp <= 0x27bf)	/* enclosed, shapes, dingbats */
+		|| (cp >= 0x3000 && cp <= 0x3003)	/* ideographic space 、。〃 */
+		|| (cp >= 0x3008 && cp <= 0x3020)	/* 〈〉《》「」【】〔〕 ... */
+		|| cp == 0x30fb				/* ・ */
+		|| (cp >= 0xfe10 && cp <= 0xfe1f)	/* vertical forms */
+		|| (cp >= 0xfe30 && cp <= 0xfe6f)	/* compatibility, small forms */
+		|| (cp >= 0xff5f && cp <= 0xff65)	/* half-width punctuation */
+		|| cp == 0xfeff;			/* bom */
+}
+
+/* decode one character at p, returns its length, 0 if malformed */
+static size_t decode(const unsigned char *p, const unsigned char *end, unsigned int *cp)
+{
+	size_t n, i;
+	unsigned int c = p[0];
+
+	if (c < 0xc2)
+		return 0;	/* continuation byte or overlong lead */
+	if (c < 0xe0) {
+		n = 2;
+		c &= 0x1f;
+	} else if (c < 0xf0) {
+		n = 3;
+		c &= 0x0f;
+	} else if (c < 0xf5) {
+		n = 4;
+		c &= 0x07;
+	} else {
+		return 0;
+	}
+	if ((size_t)(end - p) < n)
+		return 0;
+	for (i = 1; i < n; i++) {
+		if ((p[i] & 0xc0) != 0x80)
+			return 0;
+		c = c << 6 | (p[i] & 0x3f);
+	}
+	/* overlong, surrogates, past U+10FFFF */
+	if ((n == 3 && c < 0x800) || (n == 4 && (c < 0x10000 || c > 0x10ffff))
+		|| (c >= 0xd800 && c <= 0xdfff))
+		return 0;
+	*cp = c;
+	return n;
+}
+
+struct writer {
+	char *out;
+	size_t n;
+	size_t room;		/* size - 1 */
+	const char *prefix;
+	size_t plen;
+	struct tn_stats *st;
+};
+
+static int put(struct writer *w, const char *p, size_t n)
+{
+	if (w->n + n > w->room)
+		return -1;
+	memcpy(w->out + w->n, p, n);
+	w->n += n;
+	/* the prefix is removed as soon as it is complete, whatever was
+	 * dropped from between its characters */
+	if (w->plen && w->n >= w->plen && p[n - 1] == w->prefix[w->plen - 1]
+		&& !memcmp(w->out + w->n - w->plen, w->prefix, w->plen)) {
+		w->n -= w->plen;
+		w->st->prefixes++;
+	}
+	return 0;
+}
+
+static int put_ascii(struct writer *w, unsigned char c)
+{
+	char m = ascii_fold(c);
+
+	if (!m) {
+		w->st->dropped++;
+		return 0;
+	}
+	return put(w, &m, 1);
+}
+
+size_t tn_normalize(const char *in, size_t len, char *out, size_t size,
+		const char *prefix, struct tn_stats *st)
+{
+	const unsigned char *p = (const unsigned char *)in;
+	const unsigned char *end = p + len;
+	struct tn_stats spare;
+	struct writer w;
+	unsigned int cp;
+	size_t n;
+	char d;
+
+	if (size == 0)
+		return 0;
+	if (!st)
+		st = &spare;
+	memset(st, 0, sizeof(*st));
+	w.out = out;
+	w.n = 0;
+	w.room = size - 1;
+	w.prefix = prefix;
+	w.plen = prefix ? strlen(prefix) : 0;
+	w.st = st;
+
+	while (p < end) {
+#if defined(__SSE2__)
+		/* sixteen ASCII bytes at once need no decoding */
+		while (end - p >= 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)p);
+			int i;
+
+			if (_mm_movemask_epi8(v))
+				break;
+			for (i = 0; i < 16; i++) {
+				if (put_ascii(&w, p[i]))
+					goto DONE;
+			}
+			p += 16;
+		}
+		if (p >= end)
+			break;
+#endif
+		if (*p < 0x80) {
+			if (put_ascii(&w, *p))
+				goto DONE;
+			p++;
+			continue;
+		}
+
+		n = decode(p, end, &cp);
+		if (n == 0) {
+			st->invalid++;
+			p++;
+			continue;
+		}
+
+		if (cp >= 0xff01 && cp <= 0xff5e) {
+			/* full-width ASCII */
+			if (put_ascii(&w, cp - 0xfee0))
+				goto DONE;
+		} else if (is_punct(cp)) {
+			st->dropped++;
+		} else if ((d = cn_digit(cp)) != 0) {
+			if (put(&w, &d, 1))
+				goto DONE;
+		} else if (put(&w, (const char *)p, n)) {
+			goto DONE;
+		}
+		p += n;
+	}
+
+DONE:
+	out[w.n] = '\0';
+	return w.n;
+}
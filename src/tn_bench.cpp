@@ -0,0 +1,139 @@
+/*
+@file
+@brief cost of tn_normalize and the commands it recovers on a corpus of
+	recognizer results, one per line. A result counts as matched if it
+	is addressed to the robot and holds a command of the table, raw as
+	xf_asr used to match it and normalized.
+
+	tn_bench <results.txt> [commands.txt=/etc/commands.txt] [loops=2000]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "text_norm.h"
+#include "latency_stats.h"
+
+#define MAX_LINES	4096
+#define MAX_COMMANDS	255
+#define LINE_LEN	1024
+#define PREFIX		"机器人"
+
+static char lines[MAX_LINES][LINE_LEN];
+static int nlines;
+static char commands[MAX_COMMANDS][256];
+static char norm_commands[MAX_COMMANDS][256];
+static int ncommands;
+
+static int read_lines(const char *path, char (*out)[LINE_LEN], int max)
+{
+	FILE *f = fopen(path, "r");
+	int n = 0;
+
+	if (!f)
+		return -1;
+	while (n < max && fgets(out[n], LINE_LEN, f)) {
+		out[n][strcspn(out[n], "\r\n")] = '\0';
+		if (out[n][0])
+			n++;
+	}
+	fclose(f);
+	return n;
+}
+
+static int read_commands(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[256];
+
+	if (!f)
+		return -1;
+	while (ncommands < MAX_COMMANDS && fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%255[^-]-", commands[ncommands]) != 1)
+			continue;
+		tn_normalize(commands[ncommands], strlen(commands[ncommands]),
+			norm_commands[ncommands], sizeof(norm_commands[0]), NULL, NULL);
+		ncommands++;
+	}
+	fclose(f);
+	return ncommands;
+}
+
+static int match_raw(const char *text)
+{
+	int i;
+
+	if (!strstr(text, PREFIX))
+		return -1;
+	for (i = 0; i < ncommands; i++) {
+		if (strstr(text, commands[i]))
+			return i;
+	}
+	return -1;
+}
+
+static int match_norm(const char *text)
+{
+	char buf[LINE_LEN];
+	struct tn_stats st;
+	int i;
+
+	tn_normalize(text, strlen(text), buf, sizeof(buf), PREFIX, &st);
+	if (st.prefixes == 0)
+		return -1;
+	for (i = 0; i < ncommands; i++) {
+		if (strstr(buf, norm_commands[i]))
+			return i;
+	}
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *cmd_path = argc > 2 ? argv[2] : "/etc/commands.txt";
+	int loops = argc > 3 ? atoi(argv[3]) : 2000;
+	struct latency_stats lat;
+	char buf[LINE_LEN];
+	size_t bytes = 0, sink = 0;
+	int raw = 0, norm = 0;
+	double t0, ms;
+	int i, l;
+
+	if (argc < 2) {
+		printf("usage: %s <results.txt> [commands.txt] [loops]\n", argv[0]);
+		return -1;
+	}
+	nlines = read_lines(argv[1], lines, MAX_LINES);
+	if (nlines <= 0 || read_commands(cmd_path) <= 0) {
+		printf("cannot read %s or %s\n", argv[1], cmd_path);
+		return -1;
+	}
+
+	for (i = 0; i < nlines; i++) {
+		int r = match_raw(lines[i]);
+		int n = match_norm(lines[i]);
+
+		raw += r >= 0;
+		norm += n >= 0;
+		tn_normalize(lines[i], strlen(lines[i]), buf, sizeof(buf), PREFIX, NULL);
+		if (r != n)
+			printf("[%s] -> [%s] raw %s, normalized %s\n", lines[i], buf,
+				r >= 0 ? commands[r] : "-", n >= 0 ? commands[n] : "-");
+		bytes += strlen(lines[i]);
+	}
+	printf("%d results, %d commands: %d matched raw, %d normalized\n",
+		nlines, ncommands, raw, norm);
+
+	lat_init(&lat, "tn_normalize per pass over the corpus");
+	for (l = 0; l < loops; l++) {
+		t0 = lat_now_ms();
+		for (i = 0; i < nlines; i++)
+			sink += tn_normalize(lines[i], strlen(lines[i]), buf, sizeof(buf), PREFIX, NULL);
+		lat_add(&lat, lat_now_ms() - t0);
+	}
+	ms = lat_mean(&lat);
+	printf("%.1f ns per result, %.1f MB/s (%zu)\n",
+		ms * 1e6 / nlines, bytes / ms / 1000.0, sink % 10);
+	lat_report(&lat);
+	return 0;
+}
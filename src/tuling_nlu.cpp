@@ -5,102 +5,188 @@
 #include <ros/ros.h>
 #include <std_msgs/String.h>
 #include <sstream>
-#include <jsoncpp/json/json.h>
 #include <curl/curl.h>
 #include <exception>
-#include "voice_system/TTSService.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <atomic>
+#include "voice_system/TTSRequest.h"
+#include "http_client.h"
+#include "nlu_cache.h"
+#include "json_writer.h"
+#include "json_scan.h"
+#include "answer_queue.h"
 
 using namespace std;
-static string result;
-int flag = 0;
 
-int writer(char *data, size_t size, size_t nmemb, string *writerdata)
+// one connection to tuling for the life of the node, see http_client.h
+static struct http_client g_http;
+static ros::Publisher pub_tts;
+// answers asked before, see nlu_cache.h
+static struct nlu_cache g_cache;
+// the latest question, older answers are not spoken. guards g_cache too
+static pthread_mutex_t question_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int latest_id;
+static char latest_key[NC_KEY_LEN];
+// the request body, its buffer is kept between questions
+static struct json_writer g_request;
+// answers reach tts from one thread, one queue per thread that has them
+static struct answer_queue answers_http;	// http client thread
+static struct answer_queue answers_cache;	// ros thread, cache hits
+static sem_t answers_ready;
+static std::atomic<bool> dispatch_quit(false);
+
+#define TULING_KEY		"7086890091eb41bf9f39242a78f0eed3"
+#define TULING_CODE_TEXT	100000
+#define TULING_TEXT_LEN		4096
+
+static const char *const answer_keys[] = { "code", "text" };
+
+// only code and text are read, straight from the response buffer
+int parseJsonResponse(const char *json, size_t len, long *code, char *text, size_t size)
 {
-    if (writerdata == NULL)
-    {
+    struct json_span root = json_root(json, len);
+    struct json_span vals[2];
+
+    if (root.len == 0 || json_pick(root, answer_keys, vals, 2) == 0 || vals[0].len == 0) {
+       cout << "Failed to parse the response data !" << endl;
        return -1;
     }
-    int len = size*nmemb;
-    writerdata->append(data, len);
+    *code = json_to_long(vals[0]);
+    json_copy_string(vals[1], text, size);
+    printf("response code: %ld\n", *code);
+    printf("response text: %s\n", text);
 
-    return len;
+    return 0;
 }
 
-int parseJsonResponse(string input)
+static void deliver_answer(unsigned int id, const char *text)
 {
-    Json::Value root;
-    Json::Reader reader;
-    bool parsedone = reader.parse(input, root);
+	voice_system::TTSRequest req;
 
-    if(!parsedone) {
-       cout << "Failed to parse the response data !" << endl;
-       return -1;
-    }
-    const Json::Value code = root["code"];
-    const Json::Value text = root["text"];
+	req.id = id;
+	req.source = "tuling";
+	req.text = text;
+	req.priority = voice_system::TTSRequest::PRIORITY_CHAT;
+	pub_tts.publish(req);
+}
 
-    result = text.asString();
-    flag = 1;
-    cout << "response code: " << code << endl;
-    cout << "response text: " << code << endl;
+static void queue_answer(struct answer_queue *q, unsigned int id, const char *text)
+{
+	if (aq_push(q, id, text)) {
+		printf("ERROR! Answer %u dropped, the dispatcher is behind\n", id);
+		return;
+	}
+	sem_post(&answers_ready);
+}
 
-    return 0;
+// hands each answer to tts as soon as it is queued
+static void *dispatchProc(void *)
+{
+	static struct aq_item item;
+	struct answer_queue *q;
+
+	for (;;) {
+		if (sem_wait(&answers_ready)) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (dispatch_quit)
+			break;
+		q = &answers_http;
+		if (!aq_pop(q, &item)) {
+			q = &answers_cache;
+			if (!aq_pop(q, &item))
+				continue;
+		}
+		deliver_answer(item.id, item.text);
+		aq_report(q);
+	}
+	return NULL;
 }
 
-int HttpPostRequest(string input)
+// on the http client thread, as soon as the answer is in
+static void answerCallback(unsigned int id, int err, const string &body,
+		const struct http_timing *t, void *)
 {
-     string buffer;
-
-     std::string strJson = "{";
-     strJson += "\"key\" : \"7086890091eb41bf9f39242a78f0eed3\",";
-     strJson += "\"info\" : ";
-     strJson += "\"";
-     strJson += input;
-     strJson += "\"";
-     strJson += "}";
-
-     cout<< "post json string: " << strJson <<endl;
-     try {
-        CURL *pcurl = NULL;
-	CURLcode res;
-	curl_global_init(CURL_GLOBAL_ALL);
+	char text[TULING_TEXT_LEN];
+	long code = 0;
+	bool stale;
 
-	pcurl = curl_easy_init();
-        if (NULL != pcurl) {
-	   //set url timeout
-	   curl_easy_setopt(pcurl, CURLOPT_TIMEOUT, 8);
-          // set url that is about to receive the POST request 
-	   curl_easy_setopt(pcurl, CURLOPT_URL, "http://www.tuling123.com/openapi/api");
-	   // set curl http header
-	   curl_slist *plist = curl_slist_append(NULL, "Content-Type:application/json; charset=utf-8");
-	   curl_easy_setopt(pcurl, CURLOPT_HTTPHEADER, plist);
-	
-	   curl_easy_setopt(pcurl, CURLOPT_POSTFIELDS, strJson.c_str());
+	if (err)
+		return;
+	printf("tuling %u: %ld in %.1fms: queued %.1f dns %.1f connect %.1f first byte %.1f%s\n",
+		id, t->status, t->total_ms, t->queued_ms, t->dns_ms, t->connect_ms, t->ttfb_ms,
+		t->reused ? " (kept connection)" : "");
+	http_report(&g_http);
 
-	   curl_easy_setopt(pcurl, CURLOPT_WRITEFUNCTION, writer);  
-           curl_easy_setopt(pcurl, CURLOPT_WRITEDATA, &buffer);
+	if (body.empty()) {
+		printf("ERROR! The tuling server response NULL\n");
+		return;
+	}
+	if (parseJsonResponse(body.data(), body.size(), &code, text, sizeof(text)))
+		return;
 
-	   res = curl_easy_perform(pcurl);
+	pthread_mutex_lock(&question_lock);
+	stale = id < latest_id;
+	// errors (out of requests, bad key) are not answers worth keeping
+	if (id == latest_id && code == TULING_CODE_TEXT && text[0])
+		nc_store(&g_cache, latest_key, text, t->queued_ms + t->total_ms);
+	pthread_mutex_unlock(&question_lock);
 
-	   if (res != CURLE_OK) {
-	      printf("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-	   
-	   }
-	   curl_easy_cleanup(pcurl);
+	if (stale) {
+		printf("answer %u came after a newer question, dropped\n", id);
+		return;
 	}
-        
-	curl_global_cleanup();
+	queue_answer(&answers_http, id, text);
+}
+
+int HttpPostRequest(const string &input)
+{
+     unsigned int id;
+     char key[NC_KEY_LEN];
+     char answer[NC_ANSWER_LEN];
+
+     nc_key(input.c_str(), key, sizeof(key));
+     pthread_mutex_lock(&question_lock);
+     if (nc_lookup(&g_cache, key, answer, sizeof(answer))) {
+        // asked before: older questions still out are stale all the same
+        id = latest_id = http_supersede(&g_http);
+        nc_report(&g_cache);
+        pthread_mutex_unlock(&question_lock);
+        printf("question %u answered from the cache\n", id);
+        queue_answer(&answers_cache, id, answer);
+        return 0;
      }
-     catch (std::exception &ex) {
-        printf("curl exception %s!!", ex.what());     
+     pthread_mutex_unlock(&question_lock);
+
+     jw_reset(&g_request);
+     jw_begin_object(&g_request);
+     jw_member_string(&g_request, "key", TULING_KEY);
+     jw_member_string(&g_request, "info", input.c_str());
+     jw_end_object(&g_request);
+     if (g_request.err) {
+        printf("ERROR! Cannot build the tuling request\n");
+        return -1;
      }
 
-     if (buffer.empty()) {
-        printf("ERROR! The tuling server response NULL\n");
-     
-     } else {
-       parseJsonResponse(buffer); 
+     printf("post json string: %s\n", g_request.buf);
+     // a new question makes the answers still on their way stale
+     pthread_mutex_lock(&question_lock);
+     id = http_submit(&g_http, g_request.buf, g_request.len, true);
+     if (id) {
+        latest_id = id;
+        strcpy(latest_key, key);
+     }
+     nc_report(&g_cache);
+     pthread_mutex_unlock(&question_lock);
+     if (id == 0) {
+        printf("ERROR! Too many questions waiting for tuling\n");
+        return -1;
      }
+     printf("question %u posted\n", id);
 
      return 0;
 }
@@ -117,36 +203,57 @@ int main(int argc, char* argv[])
 	ros::init(argc, argv, "tuling_nlu_node");
 	
 	ros::NodeHandle n;
-	voice_system::TTSService srv;
-	ros::ServiceClient client = n.serviceClient<voice_system::TTSService>("tts_service");
+	ros::NodeHandle pn("~");
+	std::string url, cache_file;
+	pthread_t dispatch_thread;
+	int connect_ms, total_ms, dns_cache_s;
+	int cache_slots, ttl_identity_s, ttl_joke_s, ttl_other_s;
+
+	pn.param<std::string>("tuling_url", url, "http://www.tuling123.com/openapi/api");
+	pn.param("connect_timeout_ms", connect_ms, 2000);
+	pn.param("total_timeout_ms", total_ms, 8000);
+	pn.param("dns_cache_s", dns_cache_s, 600);
+	pn.param<std::string>("cache_file", cache_file, "/tmp/tuling_answers.cache");
+	pn.param("cache_slots", cache_slots, NC_DEFAULT_SLOTS);
+	pn.param("cache_ttl_identity_s", ttl_identity_s, 7 * 24 * 3600);
+	pn.param("cache_ttl_joke_s", ttl_joke_s, 300);
+	pn.param("cache_ttl_s", ttl_other_s, 3600);
+	if (nc_init(&g_cache, cache_file.c_str(), cache_slots, ttl_identity_s, ttl_joke_s, ttl_other_s)) {
+		ROS_ERROR("cannot set up the answer cache");
+		return -1;
+	}
+	jw_init(&g_request);
+	// answers are chit-chat, command prompts may cut them off
+	pub_tts = n.advertise<voice_system::TTSRequest>("/voice/tts_request", 10);
+	aq_init(&answers_http, "tuling answer wait");
+	aq_init(&answers_cache, "cached answer wait");
+	sem_init(&answers_ready, 0, 0);
+	if (pthread_create(&dispatch_thread, NULL, dispatchProc, NULL)) {
+		ROS_ERROR("cannot start the answer dispatcher");
+		return -1;
+	}
+	curl_global_init(CURL_GLOBAL_ALL);
+	if (http_init(&g_http, url.c_str(), connect_ms, total_ms, dns_cache_s, answerCallback, NULL)) {
+		ROS_ERROR("cannot set up the http client");
+		return -1;
+	}
+	// the first question should not pay for dns and tcp
+	http_preconnect(&g_http);
 
 	// published from ASR
 	ros::Subscriber sub = n.subscribe("/voice/tuling_nlu_topic", 5, nlpCallback);
 
-    // publish to tts and play it
-	//ros::Publisher pub = n.advertise<std_msgs::String>("/voice/xf_tts_topic", 10);
-	ros::Rate loop_rate(10);
-
-	while (ros::ok())
-	{
-		if (flag)
-		{ 
-			std_msgs::String msg;	
-			msg.data = result;
-			//pub.publish(msg); // play the result using TTS
-			srv.request.target = result;
-			if (client.call(srv)) {
-				ROS_INFO("Tuling call service okay");
-			} else {
-				ROS_INFO("Tuling call service fail");
-			}
-
-			flag =0;
-		}
-		ros::spinOnce();
-		loop_rate.sleep();
-	 }
+	// questions are posted here, answers are published by the dispatcher
+	ros::spin();
 
+	http_cleanup(&g_http);
+	curl_global_cleanup();
+	dispatch_quit = true;
+	sem_post(&answers_ready);
+	pthread_join(dispatch_thread, NULL);
+	sem_destroy(&answers_ready);
+	nc_close(&g_cache);
+	jw_free(&g_request);
 	return 0;
 }
 
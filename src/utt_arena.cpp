@@ -0,0 +1,149 @@
+/*
+@file
+@brief utterance arena and string builder, see utt_arena.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utt_arena.h"
+
+int arena_init(struct utt_arena *a, size_t size)
+{
+	memset(a, 0, sizeof(*a));
+	a->base = (char *)malloc(size);
+	if (!a->base)
+		return -1;
+	a->size = size;
+	a->heap_allocs = 1;
+	return 0;
+}
+
+void arena_destroy(struct utt_arena *a)
+{
+	free(a->base);
+	a->base = NULL;
+	a->size = 0;
+	a->used = 0;
+}
+
+void *arena_alloc(struct utt_arena *a, size_t n)
+{
+	size_t off = (a->used + 7) & ~(size_t)7;
+	void *p;
+
+	a->allocs++;
+	if (!a->base || n > a->size || off > a->size - n) {
+		a->overflows++;
+		return NULL;
+	}
+	p = a->base + off;
+	a->used = off + n;
+	if (a->used > a->peak)
+		a->peak = a->used;
+	return p;
+}
+
+void arena_reset(struct utt_arena *a)
+{
+	a->used = 0;
+	a->resets++;
+}
+
+void arena_report(const struct utt_arena *a)
+{
+	printf("[arena] heap allocs=%lu allocs=%lu resets=%lu peak=%zu/%zu overflows=%lu\n",
+		a->heap_allocs, a->allocs, a->resets, a->peak, a->size, a->overflows);
+}
+
+const char *sv_find(struct str_view hay, const char *needle, size_t nlen)
+{
+	const char *p, *end;
+
+	if (nlen == 0)
+		return hay.p;
+	if (nlen > hay.len)
+		return NULL;
+	end = hay.p + hay.len - nlen;
+	for (p = hay.p; p <= end; p++) {
+		p = (const char *)memchr(p, needle[0], end - p + 1);
+		if (!p)
+			return NULL;
+		if (memcmp(p, needle, nlen) == 0)
+			return p;
+	}
+	return NULL;
+}
+
+int sb_init(struct str_builder *sb, struct utt_arena *a, size_t cap)
+{
+	char *buf = (char *)arena_alloc(a, cap);
+
+	if (!buf) {
+		memset(sb, 0, sizeof(*sb));
+		return -1;
+	}
+	sb_init_buf(sb, buf, cap);
+	return 0;
+}
+
+void sb_init_buf(struct str_builder *sb, char *buf, size_t cap)
+{
+	sb->buf = buf;
+	sb->cap = cap;
+	sb->truncated = 0;
+	sb_clear(sb);
+}
+
+void sb_clear(struct str_builder *sb)
+{
+	sb->len = 0;
+	if (sb->cap)
+		sb->buf[0] = '\0';
+}
+
+size_t sb_append(struct str_builder *sb, const char *p, size_t n)
+{
+	if (sb->cap == 0)
+		return 0;
+	if (n > sb->cap - 1 - sb->len) {
+		n = sb->cap - 1 - sb->len;
+		sb->truncated++;
+	}
+	memcpy(sb->buf + sb->len, p, n);
+	sb->len += n;
+	sb->buf[sb->len] = '\0';
+	return sb->len;
+}
+
+size_t sb_set(struct str_builder *sb, const char *p, size_t n)
+{
+	sb_clear(sb);
+	return sb_append(sb, p, n);
+}
+
+int sb_remove_all(struct str_builder *sb, const char *t, size_t tlen)
+{
+	struct str_view rest = { sb->buf, sb->len };
+	const char *hit;
+	size_t out = 0;
+	int removed = 0;
+
+	if (tlen == 0)
+		return 0;
+	/* copy the kept parts down over the removed ones, left to right */
+	while ((hit = sv_find(rest, t, tlen)) != NULL) {
+		size_t keep = hit - rest.p;
+		memmove(sb->buf + out, rest.p, keep);
+		out += keep;
+		rest.len -= keep + tlen;
+		rest.p = hit + tlen;
+		removed++;
+	}
+	if (removed) {
+		memmove(sb->buf + out, rest.p, rest.len);
+		sb->len = out + rest.len;
+		sb->buf[sb->len] = '\0';
+	}
+	return removed;
+}
@@ -7,6 +7,9 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <atomic>
 #include <ros/ros.h>
 #include <ros/console.h>
 #include <ros/assert.h>
@@ -23,120 +26,27 @@
 #include "msp_cmn.h"
 #include "msp_errors.h"
 #include "speech_recognizer.h"
-#include "voice_system/TTSService.h"
+#include "local_kws.h"
+#include "latency_stats.h"
+#include "iat_result.h"
+#include "asr_grammar.h"
+#include "asr_lexicon.h"
+#include "endpointer.h"
+#include "utt_arena.h"
+#include "event_queue.h"
+#include "sighting_cache.h"
+#include "task_sm.h"
+#include "motion_exec.h"
+#include "cmd_queue.h"
+#include "text_norm.h"
+#include "pinyin_match.h"
+#include "intent_model.h"
+#include "local_skill.h"
+#include "voice_system/TTSRequest.h"
+#include "voice_system/TTSStatus.h"
 #include "demo_od/ObjectDetect.h"
 
 
-enum state_codes { entry, foo, bar, end, fail_code};
-enum ret_codes { ok, fail, repeat};
-
-#define EXIT_STATE end
-#define ENTRY_STATE entry
-#define FOO_STATE foo
-#define BAR_STATE bar
-
-#define CODE_OK  ok
-#define CODE_FAIL fail
-#define CODE_REPEAT repeat
-
-struct transition {
-    enum state_codes src_state;
-    enum ret_codes   ret_code;
-    enum state_codes dst_state;
-};
-/* transitions from end state aren't needed */
-struct transition state_transitions[] = {
-    {entry, ok,     foo},
-    {entry, fail,   end},
-    {foo,   ok,     bar},
-    {foo,   fail,   end},
-    {foo,   repeat, foo},
-    {bar,   ok,     end},
-    {bar,   fail,   end},
-    {bar,   repeat, foo}};
-
-typedef enum ret_codes FUNC(void);
-
-static enum ret_codes entry_state(void)
-{
-    printf("+%s\n", __func__);
-    return CODE_OK;
-}
-static enum ret_codes foo_state(void)
-{
-    printf("+%s\n", __func__);
-    return CODE_OK;
-}
-static enum ret_codes bar_state(void)
-{
-    printf("+%s\n", __func__);
-    return CODE_OK;
-}
-static enum ret_codes exit_state(void)
-{
-    printf("+%s\n", __func__);
-}
-
-/* array and enum below must be in sync! */
-FUNC *state[] = {entry_state, foo_state, bar_state, exit_state};
-
-char *includeStr(char s[], char t[]) {
-    int i,j,k;
-    for(i = 0; s[i]; ++i) {
-        if(s[i] == t[0]) {
-            k = i + 1;
-            for(j = 1; t[j] == s[k] && s[k] && t[j]; ++k,++j);
-            if(t[j] == '\0') return s + i;
-        }
-    }
-    return 0;
-}
- 
-void delStr(char s[], char t[]) {
-    char *p;
-    while(p = includeStr(s,t))
-        strcpy(p,p + strlen(t));
-}
-
-// return dst_state
-static enum state_codes lookup_transitions(enum state_codes cur_state, enum ret_codes rc) 
-{
-    int i, len;
-    printf("%s %d-%d\n", __func__, cur_state, rc);
-    len = sizeof(state_transitions) / sizeof(state_transitions[0]);
-
-    for (i = 0; i < len; i++) {
-        if ((state_transitions[i].src_state == cur_state) 
-            && (state_transitions[i].ret_code == rc)) {
-            return state_transitions[i].dst_state;
-        }
-    }
-
-    return fail_code;
-}
-
-int test_sm() {
-    enum state_codes cur_state = ENTRY_STATE;
-    enum ret_codes rc = CODE_OK;
-    enum ret_codes (* state_fun)(void);
-
-    for (;;) {
-        printf("cur_state=%d rc=%d\n", cur_state, rc);
-        state_fun = state[cur_state];
-        rc = state_fun();
-        if (EXIT_STATE == cur_state)
-            break;
-        cur_state = lookup_transitions(cur_state, rc);
-		if (cur_state == fail_code) {
-			printf("lookup fail!\n");
-			break;
-		}
-    }
-
-    return EXIT_SUCCESS;
-}
-
-
 // local test
 //#define OFFLINE_TEST
 
@@ -147,37 +57,207 @@ int test_sm() {
 #define SYS_UNAUTH		0
 #define SYS_AUTH		1
 
-// robot current status
-#define CURRENT_IDLE   0
-#define CURRENT_PF   	1
-#define CURRENT_VSLAM   2
-#define CURRENT_FR   	3
-#define CURRENT_MOVING 	4
-#define CURRENT_OR 		5
-#define CURRENT_HAND_OPEN 		6
-#define CURRENT_HAND_CLOSE 		7
-
-#define CURRENT_PF_ERROR 50
-#define CURRENT_VSLAM_ERROR 51
-#define CURRENT_OR_ERROR 52
-#define CURRENT_ARM_ERROR 53
-
 using namespace std;
 //static string result;
 
-static int voice_manual_code = -1;
+// the dispatcher (main thread) owns the robot state and acts on events:
+// ROS callbacks run on an AsyncSpinner and only post them, the microphone
+// runs on the listening thread, one turn at a time
+enum {
+	EV_FACE_AUTH,		// value: SYS_AUTH or not
+	EV_MANUAL_CODE,		// codes queued in g_manual
+	EV_TTS_PLAYING,		// value: 1 playing
+	EV_TTS_DONE,		// value: final TTSStatus of one of our prompts
+	EV_TASK_RESULT,		// value: result of the running task
+	EV_OBJECT_NAME,		// text: "中文名-english name"
+	EV_SPECULATIVE,		// value: command code of a stable partial
+	EV_UTTERANCE,		// value: asr_flag, data: struct heard, the turn is over
+	EV_COUNT
+};
+static const char *ev_names[EV_COUNT] = {
+	"event->reaction face auth",
+	"event->reaction manual code",
+	"event->reaction tts playing",
+	"event->reaction tts done",
+	"event->reaction task result",
+	"event->reaction object name",
+	"event->reaction speculative",
+	"event->reaction utterance",
+};
+static struct event_queue g_events;
+static struct latency_stats lat_event[EV_COUNT];	// post -> dispatched
+#define EVENT_REPORT_EVERY	200	// events of a type between reports
+static pthread_t listen_thread;
+static sem_t listen_sem;		// one post per listening turn
+static std::atomic<bool> listen_running(true);
+static bool listen_turn = false;	// dispatcher: a turn is out, g_text is not ours
+#define MAX_DEFERRED_NAMES	16
+static char deferred_names[MAX_DEFERRED_NAMES][EVQ_TEXT_LEN];
+static int num_deferred_names = 0;
+
+// /voice/control codes, see cmd_queue.h. stops are never dropped, a
+// burst of moves from the teleop panel runs the last one and none that
+// was queued before a stop. marked 1 if the fast lane published them
+static struct cmd_queue g_manual;
+#define MANUAL_RULES	"0:cancel,2:never,4:never,21:never,101-999:latest"
+
+// dispatcher only
 // sys status -1=undef, 0=sys unlock, 1=sys locked
 static int sys_locked = -1;
-static bool speech_end = false;
-static bool playing = false;
-static int asr_flag = 0;
+// set by the recognizer and the callbacks, polled by the listening thread
+static std::atomic<bool> speech_end(false);
+static std::atomic<bool> playing(false);
+static std::atomic<int> asr_flag(0);
+// text of the current utterance, g_result always points at g_text.buf
+#define UTT_ARENA_SIZE	(4 * BUFFER_SIZE)
+#define ROBOT_PREFIX	"机器人"
+#define ROBOT_PREFIX_LEN	(sizeof(ROBOT_PREFIX) - 1)
+static struct utt_arena g_arena;
+static struct str_builder g_text;
 static char *g_result = NULL;
-static unsigned int g_buffersize = BUFFER_SIZE;
-static int current_sm = CURRENT_IDLE;
+// robot current status, see task_sm.h
+static struct task_sm g_sm;
+
+// safety fast lane: stops go out from the thread that heard them, before
+// the dispatcher gets to the utterance. the dispatcher then only updates
+// the task state. mirrors of its state for the other threads
+static const int fast_codes[] = { 0, 2, 21, 4, 600, 601 };
+static std::atomic<int> fast_sent(-1);		// of the utterance, until the next one
+static std::atomic<int> fast_state(SM_IDLE);
+static std::atomic<bool> fast_armed(false);	// unlocked
+static struct latency_stats lat_fast;		// speech end -> published
+static unsigned int fast_early = 0;		// published before the speech ended
+static double fr_start_ms = 0;			// FR starts once the tasks stopped
+
+// moves are streamed at a fixed rate by the motion executor, see motion_exec.h
+static struct motion_exec g_motion;
+static double move_duration_ms = 2000;		// goal of a move without distance
+static double move_distance = 0.5;		// m, 0: by duration
+static double turn_angle = 1.57;		// rad, 0: by duration
+
+/* login params, please do keep the appid correct 58d77a1a*/
+static const char* login_params = "appid = 58e631a9, work_dir = .";
+
+/*
+* See "iFlytek MSC Reference Manual"
+* json results carry wbest word candidates with scores, see iat_result.h
+*/
+static const char* session_begin_params =
+	"sub = iat, domain = iat, language = zh_cn, "
+	"accent = mandarin, sample_rate = 16000, "
+	"result_type = json, result_encoding = utf8, wbest = 3";
+/* dynamic correction, fragments may replace earlier ones */
+static const char* partial_session_begin_params =
+	"sub = iat, domain = iat, language = zh_cn, "
+	"accent = mandarin, sample_rate = 16000, "
+	"result_type = json, result_encoding = utf8, wbest = 3, dwa = wpgs";
+/* closed command grammar, the grammar id goes in as grammarList */
+static const char* grammar_session_begin_params =
+	"engine_type = cloud, sub = asr, language = zh_cn, "
+	"accent = mandarin, sample_rate = 16000, "
+	"result_type = json, result_encoding = utf8";
+
+// offline command spotter, runs beside the cloud session
+static struct kws_engine *g_kws = NULL;
+static std::atomic<int> local_code(-1);
+static bool cmd_from_local = false;
+// lat_now_ms() when the user stopped talking, recognizer side
+static std::atomic<double> speech_end_ms(0);
+// dispatcher: the same for the command going out, 0 once it did
+static double cmd_end_ms = 0;
+static struct latency_stats lat_local;
+static struct latency_stats lat_cloud;
+
+// partial results (dwa = wpgs) with speculative dispatch
+static bool partial_mode = false;
+static int spec_stable_partials = 2;
+static struct iat_hypothesis g_hyp;
+static int spec_last_code = -1;
+static int spec_run = 0;
+static std::atomic<int> spec_pending(-1);	// handed over by the recognizer thread
+static std::atomic<int> spec_dispatched(-1);	// ran early, waiting for the final result
+static double spec_dispatch_ms = 0;
+static struct latency_stats lat_spec;
+
+struct spec_rule {
+	int code;
+	int retract_code;	// undoes code if the final result disagrees, -1 none
+};
+
+// commands that do not move the robot and may run on a stable partial.
+// stopping twice is harmless, so a wrong early stop is kept, not undone
+static const struct spec_rule spec_rules[] = {
+	{0, -1},
+	{2, -1},
+	{21, -1},
+	{4, -1},
+};
+
+// closed grammar for "机器人 + command", dictation as fallback for the rest
+#define UTT_AUDIO_MAX	(16000 * 2 * 10)	// 10s of 16k 16bit
+#define CODE_FIND_OBJECT	9
+static bool grammar_mode = false;
+static char grammar_id[GRAMMAR_ID_LEN];
+static int grammar_min_score = 30;
+static bool result_from_grammar = false;
+static int g_result_sc = -1;
+
+// candidate sentences of the utterance, best first, recognizer side
+static struct iat_nbest g_nbest;
+
+// what a listening turn heard besides g_text. the listening thread fills
+// it in once the session is closed and hands it over with EV_UTTERANCE,
+// the dispatcher reads it until it hands out the next turn
+struct heard {
+	int local_code;		// from the local spotter, -1 none
+	int fast_code;		// published by the fast lane, -1 none
+	double speech_end_ms;	// lat_now_ms() when the user stopped talking, 0 unknown
+	struct iat_nbest nbest;
+};
+static struct heard g_heard;
+static int min_confidence = 30;		// below: dropped without tuling/TTS
+static unsigned int rejected_count = 0;
+
+// end of speech timeout by dialog context, learned per speaker
+#define EP_VAD_BOS_MS		5000
+#define EP_CLOUD_SLACK_MS	300	// the cloud VAD only backs up the local one
+#define EP_QUESTION_BYTES	24	// this long without a command: a question
+static struct endpointer g_ep;
+static bool adaptive_endpoint = true;
+static int ep_next_context = EP_COMMAND;
+static struct latency_stats lat_result;	// speech end -> final result
+
+// the next session is opened in the background while the last command
+// runs, the first word then lands in a session that is already open
+#define PREWARM_MAX_AGE_MS	15000	// the cloud drops sessions idle for long
+enum { PREWARM_IDLE, PREWARM_RUNNING, PREWARM_READY, PREWARM_FAILED };
+static struct speech_rec prewarm_rec;
+static pthread_t prewarm_thread;
+static bool prewarm_joined = true;	// no pre-warm thread left to join
+// written by the pre-warm thread, read by the recognizer thread
+static std::atomic<int> prewarm_state(PREWARM_IDLE);
+static char prewarm_params[512];
+static char prewarm_grammar[GRAMMAR_ID_LEN];
+static double prewarm_cost_ms = 0;	// sr_init + QISRSessionBegin
+static double prewarm_ready_ms = 0;
+static bool msp_logged_in = false;
+static struct latency_stats lat_setup_cold;	// setup paid after the prompt
+static struct latency_stats lat_setup_saved;	// setup done ahead of time
+// the utterance as heard, replayed to dictation when the grammar misses
+static char *utt_audio = NULL;
+static size_t utt_audio_len = 0;
+static bool utt_capture = false;
+
+static int search_command(struct str_view text);
+static void spec_dispatch(int code);
+static void sync_vocabulary();
 
 struct st_command {
 	char command[255];
 	unsigned int code;
+	unsigned int len;
+	char norm[255];		// command as matched, see text_norm.h
+	unsigned int norm_len;
 };
 
 struct st_object_table {
@@ -187,11 +267,85 @@ struct st_object_table {
 
 static struct st_command voice_commands[255];
 
-static struct st_object_table  objects[] = {
+// shared by the main loop and the command dispatch
+// prompts go out without waiting, the mic waits until ours were said
+#define TTS_SOURCE		"xf_asr"
+#define TTS_STATUS_TIMEOUT_MS	20000	// no xf_tts_node: listen anyway
+static ros::Publisher pub_tts;
+static unsigned int tts_next_id = 0;
+static int tts_outstanding = 0;		// dispatcher: sent, not finished
+static double tts_sent_ms = 0;
+static char tts_content[255];
+static ros::Publisher pub_text;
+static ros::Publisher pub_cmd;
+static ros::Publisher pub_robot;
+static ros::Publisher pub_arm;
+static ros::Publisher pub_tts_flush;
+static ros::Publisher pub_robot_led;
+static ros::Publisher pub_robot_sound;
+static int manual_control = -1;
+static int locked_played = 0;
+static int unlocked_played = 0;
+
+// known objects, the detector can add more at runtime (/voice/object_names)
+#define MAX_OBJECTS 64
+static struct st_object_table  objects[MAX_OBJECTS] = {
 	{"瓶子", "bottle"}, {"背包", "bag"}, 
 	{"玩具", "toys"}, {"水杯", "cup"}, {"枕头", "pillow"},
 	{"椅子", "chair"}, {"显示器", "monitor"}
 };
+static int num_objects = 7;
+
+// objects named in one request are searched at the same time, a recent
+// sighting answers without a search
+#define OD_MAX_TARGETS	8
+#define OD_SERVICE	"object_detect_wrapper"
+struct od_job {
+	int object;		// index in objects[]
+	bool cached;
+	bool called;		// the service answered
+	pthread_t thread;
+	struct sighting seen;	// name empty if not found
+	double cost_ms;
+};
+static struct sighting_cache g_sightings;
+// sighting poses are in the robot frame: moves of the base started, and
+// how many there had been when the sightings were taken
+static std::atomic<unsigned int> base_moves(0);
+static unsigned int sightings_moves = 0;
+
+// commands by sound, for what the exact match misses (寻找水备)
+#define PINYIN_MAX_PHRASES	512
+static struct pm_index g_pinyin;
+static bool pinyin_match = true;
+
+static void add_pinyin_object(const char *name)
+{
+	char phrase[PM_PHRASE_LEN];
+
+	snprintf(phrase, sizeof(phrase), "寻找%s", name);
+	if (pinyin_match && pm_add(&g_pinyin, phrase, CODE_FIND_OBJECT) < 0)
+		ROS_ERROR("%s cannot add %s", __func__, phrase);
+}
+
+// where an utterance without a command goes, see intent_model.h. without
+// a model only questions with one of the keywords go to tuling
+static struct intent_model g_intent;
+static double intent_min_conf = 0.6;
+static struct latency_stats lat_intent;
+static unsigned int intent_routes[IM_NCLASSES];
+static const char *cloud_keywords[] = {
+	"今天", "日期", "时间", "天气", "名字", "笑话", "故事"
+};
+
+// date, time, name: answered here, see local_skill.h
+static struct skill_registry g_skills;
+static std::string robot_name;
+
+// hotwords: command phrases and object names
+static struct asr_lexicon g_lexicon;
+static bool vocab_dirty = false;	// objects changed since the grammar was built
+static std::string grammar_cache;
 
 static void show_result(char *str, char is_over)
 {
@@ -215,125 +369,596 @@ static void show_result(char *str, char is_over)
 	asr_flag = 1;
 }
 
-static void on_result(const char *result, char is_last)
+// start of an utterance: everything of the last one is dropped at once,
+// nothing is freed or allocated
+static void utt_reset()
+{
+	arena_reset(&g_arena);
+	sb_init(&g_text, &g_arena, BUFFER_SIZE);
+	g_result = g_text.buf;
+}
+
+static int sm_event_of(int code);
+
+static bool fast_code(int code)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(fast_codes) / sizeof(fast_codes[0]); i++) {
+		if (fast_codes[i] == code)
+			return true;
+	}
+	return false;
+}
+
+// velocity of a motion code, zero for the rest
+static void twist_of(int code, geometry_msgs::Twist *vel)
+{
+	vel->linear.x=0.0; //forward/back
+	vel->linear.y=0.0;
+	vel->linear.z=0.0;
+	vel->angular.x=0.0;
+	vel->angular.y=0.0;
+	vel->angular.z=0.0; //left/right
+	switch (code) {
+		case 300:
+			vel->angular.z = 1.9;
+			break;
+		case 400:
+			vel->angular.z = -1.9;
+			break;
+		case 500:
+		case 501:
+			vel->linear.x = 0.3;
+			break;
+		case 600:
+		case 601:
+			vel->linear.x = -0.3;
+			break;
+		default:
+			break;
+	}
+}
+
+// setpoint of the motion executor, on its thread
+static void send_twist(double vx, double wz, void *)
+{
+	geometry_msgs::Twist vel;
+
+	twist_of(0, &vel);
+	vel.linear.x = vx;
+	vel.angular.z = wz;
+	pub_robot.publish(vel);
+}
+
+// hand a motion code to the executor, replacing what it is doing
+static void start_motion(int code)
+{
+	geometry_msgs::Twist vel;
+	struct motion_goal goal;
+
+	twist_of(code, &vel);
+	goal.vx = vel.linear.x;
+	goal.wz = vel.angular.z;
+	goal.duration_ms = move_duration_ms;
+	goal.distance = goal.vx != 0 ? move_distance : turn_angle;
+	base_moves++;
+	motion_start(&g_motion, &goal);
+}
+
+// publish a safety command now, from any thread. what is published is what
+// the task table would do in the current state. t_ms: end of speech, 0 if
+// it has not ended yet. true if it went out
+static bool fast_publish(int code, double t_ms)
+{
+	const struct sm_transition *t;
+	std_msgs::Int32 cmd_msg;
+	std_msgs::Int32 flush;
+
+	if (!fast_code(code) || !fast_armed)
+		return false;
+	t = sm_peek(&g_sm, fast_state, sm_event_of(code));
+	if (!t)
+		return false;
+
+	if (code == 0)
+		motion_stop(&g_motion);
+	else if (t->action == SM_ACT_MOVE)
+		start_motion(code);
+	if (t->action == SM_ACT_PUBLISH) {
+		cmd_msg.data = t->pub_code >= 0 ? t->pub_code : code;
+		pub_cmd.publish(cmd_msg);
+	}
+	// nothing queued for the speaker is worth more than this
+	flush.data = voice_system::TTSRequest::PRIORITY_NORMAL;
+	pub_tts_flush.publish(flush);
+
+	if (t_ms > 0) {
+		lat_add(&lat_fast, lat_now_ms() - t_ms);
+		ROS_INFO("%s code %d, worst %.1fms", __func__, code, lat_fast.max);
+		lat_report(&lat_fast);
+	} else {
+		fast_early++;
+		ROS_INFO("%s code %d before the end of speech (%u)", __func__, code, fast_early);
+	}
+	return true;
+}
+
+// the fast lane for a command heard in the utterance, once per code
+static void fast_lane(int code, double t_ms)
+{
+	if (fast_sent != code && fast_publish(code, t_ms))
+		fast_sent = code;
+}
+
+static const struct spec_rule *spec_find_rule(int code)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(spec_rules) / sizeof(spec_rules[0]); i++) {
+		if (spec_rules[i].code == code)
+			return &spec_rules[i];
+	}
+	return NULL;
+}
+
+// match every partial hypothesis, queue a command once it is stable
+static void spec_observe(const char *text)
+{
+	int code = -1;
+
+	if (strstr(text, ROBOT_PREFIX))
+		code = search_command(sv_make(text, strlen(text)));
+
+	if (code == spec_last_code) {
+		spec_run++;
+	} else {
+		spec_last_code = code;
+		spec_run = 1;
+	}
+
+	// a stop is sent on the first stable partial, moves wait for the final result
+	if (code >= 0 && spec_run >= spec_stable_partials && sm_event_of(code) != SM_EV_MOVE)
+		fast_lane(code, 0);
+
+	if (code < 0 || spec_run < spec_stable_partials || !spec_find_rule(code))
+		return;
+	if (spec_dispatched >= 0 || spec_pending >= 0)
+		return;
+
+	ROS_INFO("%s code %d stable over %d partials", __func__, code, spec_run);
+	spec_pending = code;
+}
+
+// final text addressed to the robot: a safety command goes out now, a
+// move only if the recognizer was sure enough
+static void fast_final(const char *text)
+{
+	int code;
+
+	if (!strstr(text, ROBOT_PREFIX))
+		return;
+	code = search_command(sv_make(text, strlen(text)));
+	if (!fast_code(code))
+		return;
+	if (sm_event_of(code) == SM_EV_MOVE && g_nbest.count > 0
+		&& g_nbest.cand[0].score >= 0 && g_nbest.cand[0].score < min_confidence)
+		return;
+	fast_lane(code, ep_speech_end_ms(&g_ep) > 0 ? ep_speech_end_ms(&g_ep) : lat_now_ms());
+}
+
+// the node runs one microphone, its state is file scope, the user pointer is NULL
+static void on_result(void *, const char *result, char is_last)
 {
 	printf("+%s [%s]\n", __func__, result);
 	ROS_INFO("+%s result=%p is_last=%d", __func__, result, is_last);
-	
+
 	if (result) {
-		size_t left = g_buffersize - 1 - strlen(g_result);
-		size_t size = strlen(result);
-		if (left < size) {
-			g_result = (char*)realloc(g_result, g_buffersize + BUFFER_SIZE);
-			if (g_result)
-				g_buffersize += BUFFER_SIZE;
-			else {
-				printf("mem alloc failed\n");
-				return;
-			}
+		// only called from the recognizer thread, too big for its stack
+		static struct iat_fragment frag;
+		static struct iat_nbest fnb;
+
+		if (iat_parse_fragment(result, strlen(result), &frag) == 0) {
+			iat_hyp_apply(&g_hyp, &frag);
+			iat_fragment_nbest(&frag, &fnb);
+			iat_hyp_nbest(&g_hyp, &frag, &fnb, &g_nbest);
+			if (frag.sc >= 0)
+				g_result_sc = frag.sc;
 		}
-		strncat(g_result, result, size);
+		sb_set(&g_text, g_hyp.text, g_hyp.text_len);
 		if (is_last) {
+			if (ep_speech_end_ms(&g_ep) > 0) {
+				lat_add(&lat_result, lat_now_ms() - ep_speech_end_ms(&g_ep));
+				lat_report(&lat_result);
+			}
+			fast_final(g_hyp.text);
 			show_result(g_result, is_last);
+		} else if (partial_mode) {
+			spec_observe(g_hyp.text);
+			// a command gets the short timeout, a long sentence the long one
+			if (spec_last_code >= 0)
+				ep_set_context(&g_ep, EP_COMMAND);
+			else if (g_hyp.text_len >= EP_QUESTION_BYTES)
+				ep_set_context(&g_ep, EP_QUESTION);
 		}
 	}
 }
 
-static void on_speech_begin()
+static void on_speech_begin(void *)
 {
 	ROS_INFO("+%s g_result=%p", __func__, g_result);
-	if (g_result) {
-		free(g_result);
-		g_result = NULL;
-	}
-	g_result = (char*)malloc(BUFFER_SIZE);
-	g_buffersize = BUFFER_SIZE;
-	memset(g_result, 0, g_buffersize);
+	utt_reset();
 
 	speech_end = false;
+	speech_end_ms = 0;
+	local_code = -1;
+	if (g_kws)
+		kws_reset(g_kws);
+	iat_hyp_reset(&g_hyp);
+	g_nbest.count = 0;
+	g_result_sc = -1;
+	spec_last_code = -1;
+	spec_run = 0;
+	spec_pending = -1;
+	fast_sent = -1;
 	ROS_INFO("-%s g_result=%p\n", __func__, g_result);
 }
 
-static void on_speech_end(int reason)
+static void on_speech_end(void *, int reason)
 {
 	ROS_INFO("+%s %d\n", __func__, reason);
 	if (reason == END_REASON_VAD_DETECT) {
 		ROS_INFO("Speaking done \n");
 	}
+	else if (reason == END_REASON_CANCELED) {
+		ROS_INFO("Local command %d, cloud session dropped\n", local_code.load());
+	}
+	else if (reason == END_REASON_LOCAL_EOS) {
+		ROS_INFO("Speaking done, local endpoint after %ums\n", g_ep.eos_ms);
+	}
 	else {
 		ROS_ERROR("Recognizer error: %d\n", reason);
 	}
+
+	// prefer the local endpoint, the cloud one only shows up with the result
+	if (speech_end_ms == 0) {
+		if (g_kws && kws_speech_end_ms(g_kws) > 0)
+			speech_end_ms = kws_speech_end_ms(g_kws);
+		else if (ep_speech_end_ms(&g_ep) > 0)
+			speech_end_ms = ep_speech_end_ms(&g_ep);
+		else
+			speech_end_ms = lat_now_ms();
+	}
 	speech_end = true;
 	
 	ROS_INFO("-%s %d\n", __func__, reason);
 }
 
+static int on_audio(void *, const char *data, unsigned long len)
+{
+	struct kws_result res;
+	int ep_state;
+
+	if (utt_capture && utt_audio) {
+		size_t n = len < UTT_AUDIO_MAX - utt_audio_len ? len : UTT_AUDIO_MAX - utt_audio_len;
+		memcpy(utt_audio + utt_audio_len, data, n);
+		utt_audio_len += n;
+	}
+
+	// always fed, the speech end time is measured with fixed timeouts too
+	ep_state = ep_feed(&g_ep, data, len);
+
+	// the spotter sees the buffer that ends the speech before the
+	// session is finished, its trailing window can be as short as ours
+	if (!g_kws || kws_template_count(g_kws) == 0
+		|| kws_feed(g_kws, data, len) != KWS_FIRED || local_code >= 0) {
+		if (adaptive_endpoint && ep_state == EP_END)
+			return SR_AUDIO_FINISH;
+		return SR_AUDIO_CONTINUE;
+	}
+
+	kws_get_result(g_kws, &res);
+	ROS_INFO("%s local code=%d cost=%.2f conf=%.2f", __func__,
+		res.code, res.cost, res.confidence);
+	local_code = res.code;
+	speech_end_ms = res.speech_end_ms;
+	fast_lane(res.code, res.speech_end_ms);
+	asr_flag = 1;
+	return SR_AUDIO_CANCEL;
+}
+
+static struct speech_rec_notifier mic_notifier = {
+	on_result,
+	on_speech_begin,
+	on_speech_end,
+	on_audio,
+	NULL
+};
+
+// login once, the session stays valid until the node exits
+static int msp_login()
+{
+	double t0;
+	int ret;
+
+	if (msp_logged_in)
+		return MSP_SUCCESS;
+
+	/* Login first. the 1st arg is username, the 2nd arg is password
+	 * just set them as NULL. the 3rd arg is login paramertes 
+	 * */
+	t0 = lat_now_ms();
+	ret = MSPLogin(NULL, NULL, login_params);
+	if (MSP_SUCCESS != ret) {
+		printf("MSPLogin failed , Error code %d.\n", ret);
+		return ret;
+	}
+	msp_logged_in = true;
+	ROS_INFO("%s %.1fms, no longer paid per utterance", __func__, lat_now_ms() - t0);
+	return MSP_SUCCESS;
+}
+
+static void *prewarm_proc(void *)
+{
+	double t0 = lat_now_ms();
+	int ret;
+
+	ret = msp_login();
+	if (MSP_SUCCESS == ret)
+		ret = sr_init(&prewarm_rec, prewarm_params, SR_MIC, &mic_notifier);
+	if (MSP_SUCCESS != ret) {
+		prewarm_state = PREWARM_FAILED;
+		return NULL;
+	}
+	if (prewarm_grammar[0])
+		sr_set_grammar(&prewarm_rec, prewarm_grammar);
+	ret = sr_prepare(&prewarm_rec);
+	if (ret) {
+		sr_uninit(&prewarm_rec);
+		prewarm_state = PREWARM_FAILED;
+		return NULL;
+	}
+
+	prewarm_ready_ms = lat_now_ms();
+	prewarm_cost_ms = prewarm_ready_ms - t0;
+	prewarm_state = PREWARM_READY;
+	return NULL;
+}
+
+// wait for a pre-warm in flight, MSC calls on this thread may follow
+static void prewarm_wait()
+{
+	if (prewarm_joined)
+		return;
+	pthread_join(prewarm_thread, NULL);
+	prewarm_joined = true;
+	if (prewarm_state == PREWARM_FAILED) {
+		ROS_ERROR("%s pre-warm failed, cold start", __func__);
+		prewarm_state = PREWARM_IDLE;
+	}
+}
+
+// the pre-warmed recognizer if it was opened with these settings
+static struct speech_rec *prewarm_take(const char *params, const char *grammar_list)
+{
+	bool fresh;
+
+	prewarm_wait();
+	if (prewarm_state != PREWARM_READY)
+		return NULL;
+
+	prewarm_state = PREWARM_IDLE;
+	fresh = lat_now_ms() - prewarm_ready_ms < PREWARM_MAX_AGE_MS;
+	if (!fresh || strcmp(params, prewarm_params)
+		|| strcmp(grammar_list ? grammar_list : "", prewarm_grammar)) {
+		ROS_INFO("%s stale pre-warmed session dropped", __func__);
+		sr_uninit(&prewarm_rec);
+		return NULL;
+	}
+	lat_add(&lat_setup_saved, prewarm_cost_ms);
+	lat_report(&lat_setup_saved);
+	return &prewarm_rec;
+}
+
 /* demo recognize the audio from microphone */
-static void demo_mic(const char* session_begin_params)
+static void demo_mic(const char* session_begin_params, const char* grammar_list)
 {
 	int errcode;
 	int i = 0;
+	double t0 = lat_now_ms();
 
-	struct speech_rec iat;
-
-	struct speech_rec_notifier recnotifier = {
-		on_result,
-		on_speech_begin,
-		on_speech_end
-	};
+	struct speech_rec cold;
+	struct speech_rec *iat;
 
 	ROS_INFO("+%s [%s]", __func__, session_begin_params);
 
-	errcode = sr_init(&iat, session_begin_params, SR_MIC, &recnotifier);
-	if (errcode) {
-		ROS_ERROR("speech recognizer init failed\n");
-		return;
+	iat = prewarm_take(session_begin_params, grammar_list);
+	if (!iat) {
+		iat = &cold;
+		errcode = sr_init(iat, session_begin_params, SR_MIC, &mic_notifier);
+		if (errcode) {
+			ROS_ERROR("speech recognizer init failed\n");
+			return;
+		}
+		if (grammar_list)
+			sr_set_grammar(iat, grammar_list);
 	}
-	errcode = sr_start_listening(&iat);
+	errcode = sr_start_listening(iat);
 	if (errcode) {
 		ROS_ERROR("start listen failed %d\n", errcode);
+	} else if (iat == &cold) {
+		lat_add(&lat_setup_cold, lat_now_ms() - t0);
+		lat_report(&lat_setup_cold);
 	}
 	/* wait for recording end*/
 	while(!speech_end) {
 		//printf("recflag %d\n", recflag);
-		sleep(1);
+		int code = spec_pending;
+		if (code >= 0) {
+			if (evq_push(&g_events, EV_SPECULATIVE, code, NULL) == 0)
+				spec_pending = -1;
+		}
+		usleep(10 * 1000);
 	}
-	errcode = sr_stop_listening(&iat);
+	errcode = sr_stop_listening(iat);
 	if (errcode) {
 		ROS_ERROR("stop listening failed %d\n", errcode);
 	}
 
-	sr_uninit(&iat);
+	sr_uninit(iat);
 	ROS_INFO("-%s", __func__);
 }
 	 
-#define TTS_TEXT(_text) \
+// dispatcher only. returns at once, the command runs while it is said
+static void tts_say(const char *text, int priority)
+{
+	voice_system::TTSRequest req;
+
+	req.id = ++tts_next_id;
+	req.source = TTS_SOURCE;
+	req.text = text;
+	req.priority = priority;
+	printf("TTS->[%s] id=%u prio=%d\n", text, req.id, priority);
+	pub_tts.publish(req);
+	tts_outstanding++;
+	tts_sent_ms = lat_now_ms();
+}
+
+#define TTS_TEXT(_text) tts_say(_text, voice_system::TTSRequest::PRIORITY_NORMAL)
+
+// speech end -> first command message, split by local/cloud recognition
+static void cmd_latency_mark()
+{
+	struct latency_stats *st;
+
+	if (cmd_end_ms <= 0)
+		return;
+
+	st = cmd_from_local ? &lat_local : &lat_cloud;
+	lat_add(st, lat_now_ms() - cmd_end_ms);
+	lat_report(st);
+	cmd_end_ms = 0;
+}
+
+#define PUB_CMD(_pub, _msg) \
  do { \
-	memset(tts_content, 0, sizeof(tts_content)); \
-	strcat(tts_content, _text); \
-	srv.request.target = tts_content; \
-	printf("TTS->[%s]\n", _text);\
-	if (client.call(srv)) { \
-	ROS_INFO("call TTS service okay"); \
-	} else { \
-		ROS_INFO("call TTS service fail"); \
-	} \
- } while (0) 
+	(_pub).publish(_msg); \
+	cmd_latency_mark(); \
+ } while (0)
  
+static const char* dictation_params()
+{
+	return partial_mode ? partial_session_begin_params : session_begin_params;
+}
+
+// vad settings of the coming utterance appended to the session params
+static const char* endpoint_params(const char *params)
+{
+	static char buf[512];
+
+	if (!adaptive_endpoint)
+		return params;
+	snprintf(buf, sizeof(buf), "%s, vad_bos = %d, vad_eos = %u",
+		params, EP_VAD_BOS_MS, ep_eos_ms(&g_ep, EP_QUESTION) + EP_CLOUD_SLACK_MS);
+	return buf;
+}
+
+// open the session of the next utterance while this one is acted upon
+static void prewarm_start()
+{
+	const char *params;
+
+	if (prewarm_state != PREWARM_IDLE || manual_control == 1)
+		return;
+
+	if (grammar_mode && grammar_id[0]) {
+		params = endpoint_params(grammar_session_begin_params);
+		strcpy(prewarm_grammar, grammar_id);
+	} else {
+		params = endpoint_params(dictation_params());
+		prewarm_grammar[0] = '\0';
+	}
+	strncpy(prewarm_params, params, sizeof(prewarm_params) - 1);
+	prewarm_params[sizeof(prewarm_params) - 1] = '\0';
+
+	prewarm_state = PREWARM_RUNNING;
+	if (pthread_create(&prewarm_thread, NULL, prewarm_proc, NULL)) {
+		ROS_ERROR("%s no thread", __func__);
+		prewarm_state = PREWARM_IDLE;
+		return;
+	}
+	prewarm_joined = false;
+}
+
+/* run the captured utterance through a dictation session, for what the
+ * command grammar could not cover (questions for tuling) */
+static void replay_dictation()
+{
+	struct speech_rec rec;
+	struct speech_rec_notifier notifier = {
+		on_result,
+		NULL,
+		NULL,
+		NULL,
+		NULL
+	};
+	size_t off;
+	int errcode;
+
+	ROS_INFO("+%s %zu bytes", __func__, utt_audio_len);
+	iat_hyp_reset(&g_hyp);
+	g_nbest.count = 0;
+	sb_clear(&g_text);
+	asr_flag = 0;
+
+	errcode = sr_init(&rec, dictation_params(), SR_USER, &notifier);
+	if (errcode) {
+		ROS_ERROR("dictation init failed %d\n", errcode);
+		return;
+	}
+	errcode = sr_start_listening(&rec);
+	if (errcode == 0) {
+		// the session ends itself once its VAD sees the end of speech
+		for (off = 0; off < utt_audio_len && rec.session_id; off += FRAME_LEN * 10) {
+			size_t n = utt_audio_len - off < FRAME_LEN * 10 ? utt_audio_len - off : FRAME_LEN * 10;
+			sr_write_audio_data(&rec, utt_audio + off, n);
+		}
+		sr_stop_listening(&rec);
+	}
+	sr_uninit(&rec);
+	ROS_INFO("-%s [%s]", __func__, g_result);
+}
+
+/* "机器人 + command" against the grammar, dictation if it does not fit */
+static void grammar_recognize()
+{
+	result_from_grammar = false;
+	utt_audio_len = 0;
+	utt_capture = true;
+	demo_mic(endpoint_params(grammar_session_begin_params), grammar_id);
+	utt_capture = false;
+
+	if (local_code >= 0)
+		return;
+
+	ROS_INFO("%s [%s] sc=%d", __func__, g_result, g_result_sc);
+	if (g_text.len > 0 && g_result_sc >= grammar_min_score) {
+		result_from_grammar = true;
+		return;
+	}
+	if (utt_audio_len > 0)
+		replay_dictation();
+}
+
 static void asrProcess()
 #ifdef OFFLINE_TEST
 {
-	ROS_INFO("+****%s fake g_result=%p\n", __func__, g_result);
-	if (g_result) {
-		free(g_result);
-		g_result = NULL;
-	}
-	g_result = (char*)malloc(BUFFER_SIZE);
-	g_buffersize = BUFFER_SIZE;
-	memset(g_result, 0, g_buffersize);
+	static const char fake[] = "机器人寻找玩具";
 
-	strcpy(g_result, "机器人寻找玩具");
-	//strcpy(g_result, "机器人前进");
+	ROS_INFO("+****%s fake g_result=%p\n", __func__, g_result);
+	utt_reset();
+	sb_set(&g_text, fake, sizeof(fake) - 1);
+	//sb_set(&g_text, "机器人前进", 15);
 	speech_end = false;
 	speech_end = true;
 	asr_flag = 1;
@@ -342,49 +967,43 @@ static void asrProcess()
 #else
 {
 	int ret = MSP_SUCCESS;
-	/* login params, please do keep the appid correct 58d77a1a*/
-	const char* login_params = "appid = 58e631a9, work_dir = .";
-
-	/*
-	* See "iFlytek MSC Reference Manual"
-	*/
-	const char* session_begin_params =
-		"sub = iat, domain = iat, language = zh_cn, "
-		"accent = mandarin, sample_rate = 16000, "
-		"result_type = plain, result_encoding = utf8";
 
 	ROS_INFO("+******%s g_result=%p", __func__, g_result);
 	asr_flag = 0;
-	if (g_result) {
-		free(g_result);
-		g_result = NULL;
-	}
+	sb_clear(&g_text);
 
 	// If there is anything is playing, skip the asr
 
-	ROS_INFO("playing=%d", playing);
+	ROS_INFO("playing=%d", (int)playing);
 	if (playing) {
 		ROS_INFO("playing skip ...");
 		return;
 	}
 
-	/* Login first. the 1st arg is username, the 2nd arg is password
-	 * just set them as NULL. the 3rd arg is login paramertes 
-	 * */
-	ret = MSPLogin(NULL, NULL, login_params);
-	if (MSP_SUCCESS != ret)	{
-		printf("MSPLogin failed , Error code %d.\n",ret);
-		goto exit; // login fail, exit the program
-	}
+	prewarm_wait();
+	ret = msp_login();
+	if (MSP_SUCCESS != ret)
+		goto exit; // login fail, try again next time
+
+	sync_vocabulary();
 
 	ROS_INFO("Recognizing the speech from microphone");
 
-	demo_mic(session_begin_params);
+	ep_begin(&g_ep, ep_next_context);
+	if (grammar_mode && grammar_id[0]) {
+		grammar_recognize();
+	} else {
+		result_from_grammar = false;
+		demo_mic(endpoint_params(dictation_params()), NULL);
+	}
+	ep_end(&g_ep);
+
+	// the command is dispatched next, the session for the one after opens meanwhile
+	prewarm_start();
+	arena_report(&g_arena);
 
 exit:
 	ROS_INFO("-%s g_result=%p", __func__, g_result);
-	MSPLogout(); // Logout...
-
 }
 #endif
 
@@ -401,42 +1020,60 @@ static void asrCallback(const std_msgs::Int32::ConstPtr& msg)
 }
 #endif
 
-static void manualCallback(const std_msgs::Int32::ConstPtr& msg)
+// callbacks run on the spinner thread, they only post to the dispatcher
+static void post_event(int type, int value, const char *text)
 {
-	ROS_INFO("+%s msg=%d", __func__, msg->data);
-	voice_manual_code = msg->data;	
+	if (evq_push(&g_events, type, value, text))
+		ROS_ERROR("event queue full, event %d dropped (%u)", type, g_events.dropped.load());
 }
 
-static void faceCallback(const std_msgs::Int8::ConstPtr& msg)
+static void manualCallback(const std_msgs::Int32::ConstPtr& msg)
 {
-	ROS_INFO("+%s msg=%d sys_locked=%d", __func__, msg->data, sys_locked);
+	bool sent;
 
-	if (msg->data == SYS_AUTH) {
-		sys_locked = 0;
-	} else {
-		sys_locked = 1;
+	ROS_INFO("+%s msg=%d", __func__, msg->data);
+	if (manual_control != 1)
+		return;
+	sent = fast_publish(msg->data, lat_now_ms());
+	switch (cmdq_push(&g_manual, msg->data, sent)) {
+	case 1:
+		post_event(EV_MANUAL_CODE, 0, NULL);
+		break;
+	case -1:
+		ROS_ERROR("manual queue full, code %d dropped (%u)", msg->data, g_manual.dropped.load());
+		break;
+	default:
+		break;
 	}
+}
 
-	ROS_INFO("-%s sys_locked=%d", __func__, sys_locked);
+static void faceCallback(const std_msgs::Int8::ConstPtr& msg)
+{
+	ROS_INFO("+%s msg=%d", __func__, msg->data);
+	post_event(EV_FACE_AUTH, msg->data, NULL);
 }
 
 static void ttsplayCallback(const std_msgs::Int32::ConstPtr& msg)
 {
 	ROS_INFO("+%s %d", __func__, msg->data);
-	if (msg->data == 1) {
-		playing = true;
-	} else {
-		playing = false;
-	}
+	// asrProcess checks it right away, the event wakes the dispatcher
+	playing = msg->data == 1;
+	post_event(EV_TTS_PLAYING, msg->data, NULL);
 }
 
-static void resultsCallback(const std_msgs::Int32::ConstPtr& msg)
+// only the end of our own prompts matters, the mic waits for it
+static void ttsStatusCallback(const voice_system::TTSStatus::ConstPtr& msg)
 {
-	ROS_INFO("+%s %d", __func__, msg->data);
-	
-	// TODO PF error, stop PF
-
-	current_sm = CURRENT_IDLE;
+	if (msg->source != TTS_SOURCE || msg->status == voice_system::TTSStatus::STARTED)
+		return;
+	ROS_INFO("+%s id=%u status=%d waited %.0fms", __func__, msg->id, msg->status, msg->wait_ms);
+	post_event(EV_TTS_DONE, msg->status, NULL);
+}
+
+static void resultsCallback(const std_msgs::Int32::ConstPtr& msg)
+{
+	ROS_INFO("+%s %d", __func__, msg->data);
+	post_event(EV_TASK_RESULT, msg->data, NULL);
 }
 
 static int get_control() {
@@ -488,6 +1125,9 @@ static int read_config() {
         printf("command=[%s]%zu code=%d\n", command, strlen(command), code);
         strcpy(voice_commands[len].command, command);
         voice_commands[len].code = code;
+        voice_commands[len].len = strlen(command);
+        voice_commands[len].norm_len = tn_normalize(command, strlen(command),
+            voice_commands[len].norm, sizeof(voice_commands[len].norm), NULL, NULL);
         len++;
         
         //free(line);
@@ -507,27 +1147,36 @@ static int read_config() {
 	
 }
 
-static int search_command(const char *command) {
+static int search_command(struct str_view text) {
 	int i = 0;
 	int code = -1;
-	char *found = NULL;
+	const char *found = NULL;
+	char buf[BUFFER_SIZE];
+	struct str_view norm;
 	
-	printf("+%s [%s]\n", __func__, command);
+	printf("+%s [%.*s]\n", __func__, (int)text.len, text.p);
+
+	// punctuation, spaces, full-width letters and 两/二/2 do not matter
+	norm.p = buf;
+	norm.len = tn_normalize(text.p, text.len, buf, sizeof(buf), ROBOT_PREFIX, NULL);
 
 	i = 0;
 	code = -1;
-	while (0 != strlen(voice_commands[i].command)) {
+	while (0 != voice_commands[i].len) {
 		//printf("%d=[%s]\n", i, voice_commands[i].command);
-		found = strstr((char *)command, voice_commands[i].command);
+		if (voice_commands[i].norm_len == 0)
+			found = NULL;
+		else
+			found = sv_find(norm, voice_commands[i].norm, voice_commands[i].norm_len);
 		if (found) {
-			printf("%s %d find [%s]-[%s] code=%d\n", __func__, i, command, voice_commands[i].command, voice_commands[i].code);
+			printf("%s %d find [%.*s]-[%s] code=%d\n", __func__, i, (int)text.len, text.p, voice_commands[i].command, voice_commands[i].code);
 			code = voice_commands[i].code;
 			break;
 		}
 		i++;
 	}
 
-	printf("-%s [%s] get code=%d\n", __func__, command, code);
+	printf("-%s [%.*s] get code=%d\n", __func__, (int)text.len, text.p, code);
 	return code;
 }
 
@@ -550,41 +1199,1084 @@ static int search_command_index(const int code) {
 	return -1;
 }
 
-int main(int argc, char* argv[])
+// zero velocity, the robot stops at once. a running move is dropped
+// within one control period
+static void stop_robot()
+{
+	motion_stop(&g_motion);
+	cmd_latency_mark();
+	motion_report(&g_motion);
+}
+
+// tell the user which command is going to run
+static void speak_command(int code)
+{
+	int index = search_command_index(code);
+
+	if (index < 0)
+		return;
+
+	if (code == 61) {
+		// no need to speak out
+	} else {
+		if (1 == manual_control) {
+		    memset(tts_content, 0, sizeof(tts_content));
+			// in the background, the command does not wait for it
+			sprintf(tts_content, "play /tmp/%d.wav &", code);
+			ROS_INFO("exec [%s]", tts_content);
+			system(tts_content);
+		} else {
+			memset(tts_content, 0, sizeof(tts_content));
+			sprintf(tts_content, "执行命令 %s", voice_commands[index].command);
+			TTS_TEXT(tts_content);
+		}
+	}
+}
+
+// one detection pass on its own thread. a client per thread, the
+// calls do not share a connection
+static void *od_proc(void *arg)
+{
+	struct od_job *job = (struct od_job *)arg;
+	ros::NodeHandle n;
+	ros::ServiceClient c = n.serviceClient<demo_od::ObjectDetect>(OD_SERVICE);
+	demo_od::ObjectDetect::Request od_req;
+	demo_od::ObjectDetect::Response od_resp;
+	double t0 = lat_now_ms();
+
+	od_req.target = objects[job->object].name2;
+	job->called = c.call(od_req, od_resp);
+	job->cost_ms = lat_now_ms() - t0;
+	if (job->called && od_resp.result) {
+		strncpy(job->seen.name, objects[job->object].name2, SIGHT_NAME_LEN - 1);
+		job->seen.x = od_resp.x;
+		job->seen.y = od_resp.y;
+		job->seen.z = od_resp.z;
+	}
+	return NULL;
+}
+
+// every object named in text, in table order: from the sightings if seen
+// lately, the others searched concurrently. returns the number of jobs
+static int search_objects(const char *text, struct od_job *jobs)
+{
+	double t0 = lat_now_ms();
+	unsigned int moves = base_moves;
+	int i, njobs = 0;
+
+	if (moves != sightings_moves) {
+		sight_clear(&g_sightings);
+		sightings_moves = moves;
+	}
+	for (i = 0; i < num_objects; i++) {
+		struct od_job *job = &jobs[njobs];
+
+		if (!strstr(text, objects[i].name1))
+			continue;
+		if (njobs >= OD_MAX_TARGETS) {
+			ROS_ERROR("%s more than %d objects, skip %s", __func__, OD_MAX_TARGETS, objects[i].name1);
+			continue;
+		}
+		memset(job, 0, sizeof(*job));
+		job->object = i;
+		njobs++;
+		job->cached = sight_lookup(&g_sightings, objects[i].name2, &job->seen);
+		if (job->cached)
+			continue;
+		if (pthread_create(&job->thread, NULL, od_proc, job)) {
+			ROS_ERROR("%s no thread, search %s inline", __func__, objects[i].name2);
+			od_proc(job);
+			job->thread = 0;
+		}
+	}
+
+	for (i = 0; i < njobs; i++) {
+		struct od_job *job = &jobs[i];
+
+		if (job->cached)
+			continue;
+		if (job->thread)
+			pthread_join(job->thread, NULL);
+		// a pose found while the base started moving is already off
+		if (job->called && base_moves == moves)
+			sight_store(&g_sightings, objects[job->object].name2, job->seen.name[0] != '\0',
+				job->seen.x, job->seen.y, job->seen.z, job->cost_ms);
+	}
+
+	if (njobs > 0) {
+		ROS_INFO("%s %d objects in %.1fms", __func__, njobs, lat_now_ms() - t0);
+		sight_report(&g_sightings);
+	}
+	return njobs;
+}
+
+// bye-bye: system lock and start FR, stop the running task first
+static void lock_robot(int stop_code)
+{
+	std_msgs::Int32 cmd_msg;
+
+	if (stop_code >= 0) {
+		cmd_msg.data = stop_code;
+		PUB_CMD(pub_cmd, cmd_msg);
+	}
+	sys_locked = -1;
+	asr_flag = 0;
+	locked_played = 0;
+	unlocked_played = 0;
+	sb_clear(&g_text);
+	// make sure tasks are stop, the dispatcher starts FR in a second
+	fr_start_ms = lat_now_ms() + 1000;
+}
+
+static void start_fr()
+{
+	std_msgs::Int32 cmd_msg;
+
+	fr_start_ms = 0;
+	cmd_msg.data = 5;
+	PUB_CMD(pub_cmd, cmd_msg); // start FR task
+}
+
+static void find_objects()
 {
-	char *found = NULL;
-	// OR xyz
 	std_msgs::Float32MultiArray OR_xyz;
-	// robot move 
-	geometry_msgs::Twist input_vel;
+	struct od_job jobs[OD_MAX_TARGETS];
+	int i, njobs;
+
+	njobs = search_objects(g_result, jobs);
+	// start to find object TTS
+	for (i = 0; i < njobs; i++) {
+		const struct od_job *job = &jobs[i];
+
+		ROS_INFO("%s-%s %s", objects[job->object].name1, objects[job->object].name2,
+			job->cached ? "cached" : job->called ? "searched" : "call OD service fail");
+		if (job->seen.name[0]) {
+			ROS_INFO("x,y,z=%f-%f-%f", job->seen.x, job->seen.y, job->seen.z);
+			if (1 == manual_control) {
+				system("play /tmp/found.wav");
+			} else {
+				TTS_TEXT("已找到");
+			}
+			OR_xyz.data.clear();
+			OR_xyz.data.push_back(job->seen.x);
+			OR_xyz.data.push_back(job->seen.y);
+			OR_xyz.data.push_back(job->seen.z);
+			pub_arm.publish(OR_xyz);
+		} else {
+			if (1 == manual_control) {
+				system("play /tmp/notfound.wav");
+			} else {
+				TTS_TEXT("未找到");
+			}
+		}
+	}
+}
+
+// code > 100, control commands. the executor ramps up, holds and ramps
+// down; its first setpoint goes out at once
+static void move_robot(int code)
+{
+	ROS_INFO("move %d...", code);
+	start_motion(code);
+	cmd_latency_mark();
+}
+
+// command code -> task state machine event, -1 if it is none
+static int sm_event_of(int code)
+{
+	if (code > 100)
+		return SM_EV_MOVE;
+
+	switch (code) {
+		case 0: return SM_EV_STOP;
+		case 1: return SM_EV_PF_START;
+		case 2:
+		case 21: return SM_EV_PF_STOP;
+		case 3: return SM_EV_VSLAM_START;
+		case 4: return SM_EV_VSLAM_STOP;
+		case 5:
+		case 51: return SM_EV_BYE;
+		case 6:
+		case 61: return SM_EV_ARM;
+		case 7: return SM_EV_HAND_OPEN;
+		case 8: return SM_EV_HAND_CLOSE;
+		case 9:
+		case 91:
+		case 92:
+		case 93:
+		case 94:
+		case 95: return SM_EV_FIND;
+		default: return -1;
+	}
+}
+
+// run a recognized command: start/stop tasks, move, find objects.
+// whether it may run in the current state is up to the task table.
+// sent: the fast lane published it, only the task state is left to do
+static void exec_command(int code, bool sent)
+{
+	const struct sm_transition *t;
+	std_msgs::Int32 cmd_msg;
+	int event = sm_event_of(code);
+
+	if (event < 0)
+		return;
+	t = sm_lookup(&g_sm, event);
+	if (!t) {
+		ROS_INFO("CANNOT run %d in %s", code, sm_state_name(g_sm.state));
+		return;
+	}
+
+	sm_begin(&g_sm, t);
+	switch (t->action) {
+		case SM_ACT_PUBLISH:
+			cmd_msg.data = t->pub_code >= 0 ? t->pub_code : code;
+			if (!sent)
+				PUB_CMD(pub_cmd, cmd_msg);
+			break;
+		case SM_ACT_LOCK:
+			lock_robot(t->pub_code);
+			break;
+		case SM_ACT_FIND:
+			find_objects();
+			break;
+		case SM_ACT_MOVE:
+			if (!sent)
+				move_robot(code);
+			break;
+		default:
+			break;
+	}
+	sm_finish(&g_sm, t);
+}
+
+// "寻找" + any object of the table, only the grammar produces these
+static int search_object_command(struct str_view text)
+{
+	static const char find[] = "寻找";
+	int i = 0;
+
+	if (!sv_find(text, find, sizeof(find) - 1))
+		return -1;
+	while (i < num_objects) {
+		if (sv_find(text, objects[i].name1, strlen(objects[i].name1)))
+			return CODE_FIND_OBJECT;
+		i++;
+	}
+	return -1;
+}
+
+// the table, then "寻找 <object>" which only the grammar produces
+static int match_command(struct str_view text)
+{
+	int code = search_command(text);
+
+	if (code < 0 && result_from_grammar)
+		code = search_object_command(text);
+	return code;
+}
+
+// a command that sounds like the text, g_text becomes that command so
+// speaking and object search see what was meant. -1 if none is close
+static int pinyin_command()
+{
+	struct pm_match m;
+
+	if (!pinyin_match || !pm_search(&g_pinyin, g_text.buf, g_text.len, &m))
+		return -1;
+	ROS_INFO("%s [%s] sounds like [%s] code %d score %d", __func__,
+		g_result, m.text, m.value, m.score);
+	sb_set(&g_text, m.text, strlen(m.text));
+	pm_report(&g_pinyin);
+	return m.value;
+}
+
+// best scored candidate addressed to the robot that holds a command, its
+// text without "机器人" replaces g_result. -1 if no candidate does
+static int nbest_command(const struct iat_nbest *nb)
+{
+	char buf[IAT_TEXT_LEN];
+	struct str_builder text;
+	int i, code;
+
+	sb_init_buf(&text, buf, sizeof(buf));
+	for (i = 0; i < nb->count; i++) {
+		const struct iat_candidate *c = &nb->cand[i];
+
+		if (c->score >= 0 && c->score < min_confidence)
+			continue;
+		sb_set(&text, c->text, strlen(c->text));
+		if (sb_remove_all(&text, ROBOT_PREFIX, ROBOT_PREFIX_LEN) == 0)
+			continue;
+		code = match_command(sb_view(&text));
+		if (code >= 0) {
+			ROS_INFO("%s candidate %d [%s] score %d code %d", __func__, i, c->text, c->score, code);
+			sb_set(&g_text, text.buf, text.len);
+			return code;
+		}
+	}
+	return -1;
+}
+
+// scored, but under the threshold even at its best: noise, drop it here
+static bool nbest_rejected(const struct iat_nbest *nb)
+{
+	if (nb->count == 0 || nb->cand[0].score < 0
+		|| nb->cand[0].score >= min_confidence)
+		return false;
+
+	rejected_count++;
+	ROS_INFO("reject [%s] score %d < %d, %u rejected", nb->cand[0].text,
+		nb->cand[0].score, min_confidence, rejected_count);
+	return true;
+}
+
+static void init_endpoint()
+{
+	ros::NodeHandle pn("~");
+	std::string speaker;
+	std::string dir;
+	char path[256];
+
+	pn.param("adaptive_endpoint", adaptive_endpoint, true);
+	pn.param<std::string>("speaker", speaker, "default");
+	pn.param<std::string>("endpoint_profile_dir", dir, "/tmp");
+	snprintf(path, sizeof(path), "%s/voice_endpoint_%s.prof", dir.c_str(), speaker.c_str());
+	ep_init(&g_ep, 16000, path);
+	lat_init(&lat_result, adaptive_endpoint ?
+		"speech end->result (adaptive eos)" : "speech end->result (fixed eos)");
+	ROS_INFO("%s adaptive=%d eos command/question/retry=%u/%u/%ums", __func__,
+		adaptive_endpoint, ep_eos_ms(&g_ep, EP_COMMAND),
+		ep_eos_ms(&g_ep, EP_QUESTION), ep_eos_ms(&g_ep, EP_RETRY));
+}
+
+static void init_sightings()
+{
+	ros::NodeHandle pn("~");
+	double ttl;
+
+	pn.param("sighting_ttl", ttl, 10.0);
+	sight_init(&g_sightings, ttl * 1000);
+	ROS_INFO("%s ttl %.1fs", __func__, ttl);
+}
+
+static void init_manual_queue()
+{
+	ros::NodeHandle pn("~");
+	std::string rules;
+
+	cmdq_init(&g_manual);
+	pn.param<std::string>("manual_coalesce", rules, MANUAL_RULES);
+	if (cmdq_set_rules(&g_manual, rules.c_str()) < 0) {
+		ROS_ERROR("%s bad rules \"%s\", using %s", __func__, rules.c_str(), MANUAL_RULES);
+		cmdq_set_rules(&g_manual, MANUAL_RULES);
+	}
+}
+
+static int init_motion()
+{
+	ros::NodeHandle pn("~");
+	double duration, acc_lin, acc_ang;
+	int rate;
+
+	pn.param("motion_rate", rate, 20);
+	pn.param("motion_acc_lin", acc_lin, 0.5);
+	pn.param("motion_acc_ang", acc_ang, 4.0);
+	pn.param("move_duration", duration, 2.0);
+	pn.param("move_distance", move_distance, 0.5);
+	pn.param("turn_angle", turn_angle, 1.57);
+	move_duration_ms = duration * 1000;
+	ROS_INFO("%s %dHz acc %.2f/%.2f, move %.2fm or %.1fs, turn %.2frad",
+		__func__, rate, acc_lin, acc_ang, move_distance, duration, turn_angle);
+	return motion_init(&g_motion, rate, acc_lin, acc_ang, send_twist, NULL);
+}
+
+// the task table of this robot, the built-in one without a profile
+static void init_task_sm()
+{
+	ros::NodeHandle pn("~");
+	std::string profile;
+	char path[256];
+
+	sm_init(&g_sm);
+	pn.param<std::string>("robot_profile", profile, "");
+	if (profile.empty())
+		return;
+	snprintf(path, sizeof(path), "/etc/voice_sm_%s.txt", profile.c_str());
+	if (sm_load_profile(&g_sm, path))
+		ROS_WARN("%s profile %s missing or bad, built-in task table", __func__, path);
+}
+
+// more skills register here
+static void init_skills()
+{
+	ros::NodeHandle pn("~");
+
+	pn.param<std::string>("robot_name", robot_name, "ROS机器人");
+	skill_init(&g_skills);
+	skill_register_builtin(&g_skills, robot_name.c_str());
+	ROS_INFO("%s %d skills, name %s", __func__, g_skills.count, robot_name.c_str());
+}
+
+static void init_intent()
+{
+	ros::NodeHandle pn("~");
+	std::string path;
+
+	pn.param<std::string>("intent_model", path, "/etc/voice_intent.model");
+	pn.param("intent_min_conf", intent_min_conf, 0.6);
+	lat_init(&lat_intent, "intent decision");
+	if (im_load(&g_intent, path.c_str())) {
+		ROS_INFO("%s no model %s, keywords only", __func__, path.c_str());
+		return;
+	}
+	ROS_INFO("%s %s, %u buckets, min confidence %.2f", __func__, path.c_str(),
+		g_intent.buckets, intent_min_conf);
+}
+
+// objects first: a command of the same sound replaces the object phrase
+static void init_pinyin()
+{
+	ros::NodeHandle pn("~");
+	int i;
+
+	pn.param("pinyin_match", pinyin_match, true);
+	if (!pinyin_match)
+		return;
+	if (pm_init(&g_pinyin, PINYIN_MAX_PHRASES)) {
+		ROS_ERROR("%s no memory, pinyin matching off", __func__);
+		pinyin_match = false;
+		return;
+	}
+	for (i = 0; i < num_objects; i++)
+		add_pinyin_object(objects[i].name1);
+	for (i = 0; voice_commands[i].len != 0; i++)
+		pm_add(&g_pinyin, voice_commands[i].command, voice_commands[i].code);
+	ROS_INFO("%s %d phrases", __func__, g_pinyin.nphrases);
+}
+
+static void init_nbest()
+{
+	ros::NodeHandle pn("~");
+
+	pn.param("min_confidence", min_confidence, 30);
+	g_nbest.count = 0;
+	ROS_INFO("%s min_confidence=%d", __func__, min_confidence);
+}
+
+// commands and object names into the ABNF, grammar id from cache or cloud.
+// must be logged in. keeps the old id if the build fails
+static int build_grammar()
+{
+	const char *commands[255];
+	const char *names[MAX_OBJECTS];
+	static char abnf[GRAMMAR_MAX_LEN];
+	char id[GRAMMAR_ID_LEN];
+	int ncommands = 0;
+	int nnames = 0;
+	int ret;
+
+	while (ncommands < 255 && 0 != strlen(voice_commands[ncommands].command)) {
+		commands[ncommands] = voice_commands[ncommands].command;
+		ncommands++;
+	}
+	while (nnames < num_objects) {
+		names[nnames] = objects[nnames].name1;
+		nnames++;
+	}
+	if (grammar_write_abnf(abnf, sizeof(abnf), commands, ncommands, names, nnames) < 0) {
+		ROS_ERROR("%s grammar too large", __func__);
+		return -1;
+	}
+
+	ret = grammar_load_or_build(abnf, grammar_cache.c_str(), id, sizeof(id));
+	if (ret) {
+		ROS_ERROR("%s no grammar (%d)", __func__, ret);
+		return ret;
+	}
+	strcpy(grammar_id, id);
+	return 0;
+}
+
+static void init_grammar()
+{
+	ros::NodeHandle pn("~");
+	std::string mode;
+	int ret;
+
+	pn.param<std::string>("asr_mode", mode, "dictation");
+	pn.param<std::string>("grammar_cache", grammar_cache, "/tmp/voice_grammar.cache");
+	pn.param("grammar_min_score", grammar_min_score, 30);
+	if (mode != "grammar")
+		return;
+
+	ret = msp_login();
+	if (MSP_SUCCESS == ret)
+		ret = build_grammar();
+	if (ret) {
+		ROS_ERROR("%s dictation only", __func__);
+		grammar_id[0] = '\0';
+		return;
+	}
+
+	utt_audio = (char*)malloc(UTT_AUDIO_MAX);
+	grammar_mode = utt_audio != NULL;
+	ROS_INFO("%s grammar id [%s] min score %d", __func__, grammar_id, grammar_min_score);
+}
+
+// every command phrase and object name is a hotword of the dictation
+static void init_lexicon()
+{
+	ros::NodeHandle pn("~");
+	std::string hash_file;
+	int i;
+
+	pn.param<std::string>("lexicon_hash_file", hash_file, "/tmp/voice_lexicon.hash");
+	lexicon_init(&g_lexicon, hash_file.c_str());
+	for (i = 0; i < 255 && 0 != strlen(voice_commands[i].command); i++)
+		lexicon_add(&g_lexicon, voice_commands[i].command);
+	for (i = 0; i < num_objects; i++)
+		lexicon_add(&g_lexicon, objects[i].name1);
+	ROS_INFO("%s %d hotwords, %s", __func__, g_lexicon.count,
+		lexicon_dirty(&g_lexicon) ? "upload pending" : "up to date");
+}
+
+static void objectNamesCallback(const std_msgs::String::ConstPtr& msg)
+{
+	if (msg->data.size() >= EVQ_TEXT_LEN) {
+		ROS_ERROR("%s name too long, drop %s", __func__, msg->data.c_str());
+		return;
+	}
+	post_event(EV_OBJECT_NAME, 0, msg->data.c_str());
+}
+
+// new object from the detector: "中文名-english name". dispatcher only,
+// not while a listening turn may sync the vocabulary
+static void add_object_name(const char *s)
+{
+	const char *sep = strchr(s, '-');
+	int i;
+
+	if (!sep || sep == s || sep[1] == '\0'
+		|| (size_t)(sep - s) >= sizeof(objects[0].name1)
+		|| strlen(sep + 1) >= sizeof(objects[0].name2))
+		return;
+	for (i = 0; i < num_objects; i++) {
+		if (strlen(objects[i].name1) == (size_t)(sep - s)
+			&& !strncmp(objects[i].name1, s, sep - s))
+			return;
+	}
+	if (num_objects >= MAX_OBJECTS) {
+		ROS_ERROR("%s object table full, drop %s", __func__, s);
+		return;
+	}
+
+	memcpy(objects[num_objects].name1, s, sep - s);
+	objects[num_objects].name1[sep - s] = '\0';
+	strcpy(objects[num_objects].name2, sep + 1);
+	lexicon_add(&g_lexicon, objects[num_objects].name1);
+	add_pinyin_object(objects[num_objects].name1);
+	num_objects++;
+	vocab_dirty = true;
+	ROS_INFO("%s new object %s", __func__, s);
+}
+
+// upload the hotwords and rebuild the grammar if the vocabulary changed.
+// called while logged in, both are no-ops when nothing changed
+static void sync_vocabulary()
+{
+	if (lexicon_dirty(&g_lexicon) && lexicon_sync(&g_lexicon))
+		ROS_ERROR("%s hotword upload failed, retry next session", __func__);
+	if (vocab_dirty && grammar_mode) {
+		if (build_grammar() == 0)
+			vocab_dirty = false;
+	} else {
+		vocab_dirty = false;
+	}
+}
+
+// run a stable partial command now, without TTS: the mic is still open
+static void spec_dispatch(int code)
+{
+	if (code < 0 || spec_dispatched >= 0)
+		return;
+
+	ROS_INFO("+%s speculative command %d", __func__, code);
+	spec_dispatched = code;
+	spec_dispatch_ms = lat_now_ms();
+	if (code == 0)
+		stop_robot();
+	// the mark stays: the final result must not publish it again
+	exec_command(code, fast_sent == code);
+}
+
+// final result is in: confirm or retract the early command.
+// returns true if nothing is left to do for this utterance
+static bool spec_settle(struct str_view text)
+{
+	const struct spec_rule *rule;
+	int early = spec_dispatched;
+	int code = -1;
+
+	spec_dispatched = -1;
+	if (sv_find(text, ROBOT_PREFIX, ROBOT_PREFIX_LEN))
+		code = search_command(text);
+
+	lat_add(&lat_spec, lat_now_ms() - spec_dispatch_ms);
+	lat_report(&lat_spec);
+
+	if (code == early) {
+		ROS_INFO("%s confirm %d", __func__, early);
+		speak_command(code);
+		return true;
+	}
+
+	rule = spec_find_rule(early);
+	ROS_INFO("%s retract %d, final %d", __func__, early, code);
+	if (rule && rule->retract_code >= 0)
+		exec_command(rule->retract_code, false);
+	return false;
+}
 
-	// robot led
-	kobuki_msgs::Led  robot_led;
-	kobuki_msgs::Sound  robot_sound;
+static void init_spec_dispatch()
+{
+	ros::NodeHandle pn("~");
+
+	pn.param("partial_results", partial_mode, false);
+	pn.param("spec_stable_partials", spec_stable_partials, 2);
+	lat_init(&lat_spec, "speculative lead (dispatch->final)");
+	iat_hyp_reset(&g_hyp);
+	ROS_INFO("%s partial_results=%d stable=%d", __func__, partial_mode, spec_stable_partials);
+}
+
+// compile the command list into the local spotter, one template set per code
+static void init_local_kws()
+{
+	ros::NodeHandle pn("~");
+	struct kws_config cfg;
+	std::string dir;
+	double max_cost, min_confidence;
+	int trailing_ms;
+	int i = 0;
 
-	char tts_content[255];
+	lat_init(&lat_local, "speech_end->cmd local");
+	lat_init(&lat_cloud, "speech_end->cmd cloud");
+
+	kws_default_config(&cfg);
+	pn.param<std::string>("kws_template_dir", dir, "/etc/voice_templates");
+	pn.param("kws_max_cost", max_cost, (double)cfg.max_cost);
+	pn.param("kws_min_confidence", min_confidence, (double)cfg.min_confidence);
+	pn.param("kws_trailing_ms", trailing_ms, (int)cfg.trailing_ms);
+	cfg.max_cost = max_cost;
+	cfg.min_confidence = min_confidence;
+	cfg.trailing_ms = trailing_ms;
+
+	if (kws_create(&g_kws, &cfg)) {
+		ROS_ERROR("%s create failed, cloud only", __func__);
+		g_kws = NULL;
+		return;
+	}
+
+	while (0 != strlen(voice_commands[i].command)) {
+		if (kws_load_templates(g_kws, dir.c_str(), voice_commands[i].code) == 0)
+			ROS_INFO("%s no template for [%s]-%d", __func__,
+				voice_commands[i].command, voice_commands[i].code);
+		i++;
+	}
+	ROS_INFO("-%s %d templates from %s", __func__, kws_template_count(g_kws), dir.c_str());
+}
+
+// route of g_text, IM_REJECT when the model is not sure
+static int route_intent()
+{
+	struct intent_result r;
+	double t0 = lat_now_ms();
+	unsigned int i;
+	int route = IM_REJECT;
+
+	if (g_intent.loaded) {
+		im_classify(&g_intent, g_text.buf, g_text.len, NULL, &r);
+		route = r.confidence >= intent_min_conf ? r.intent : IM_REJECT;
+		ROS_INFO("%s [%s] %s %.2f -> %s", __func__, g_result, im_name(r.intent),
+			r.confidence, im_name(route));
+	} else {
+		for (i = 0; i < sizeof(cloud_keywords) / sizeof(cloud_keywords[0]); i++) {
+			if (strstr(g_result, cloud_keywords[i])) {
+				route = IM_CLOUD;
+				break;
+			}
+		}
+	}
+	intent_routes[route]++;
+	lat_add(&lat_intent, lat_now_ms() - t0);
+	lat_report(&lat_intent);
+	ROS_INFO("%s command/local/cloud/reject %u/%u/%u/%u", __func__,
+		intent_routes[IM_COMMAND], intent_routes[IM_LOCAL],
+		intent_routes[IM_CLOUD], intent_routes[IM_REJECT]);
+	return route;
+}
+
+// answer g_text on the robot: local routes, and cloud ones when there is
+// no model to tell them apart. true if a skill answered
+static bool local_answer(int route)
+{
+	char answer[256];
+	int k;
+
+	if (route != IM_LOCAL && g_intent.loaded)
+		return false;
+	k = skill_answer(&g_skills, g_text.buf, g_text.len, answer, sizeof(answer));
+	if (k < 0)
+		return false;
+	ROS_INFO("%s [%s] %s: %s", __func__, g_result, g_skills.skills[k].name, answer);
+	lat_report(&g_skills.skills[k].lat);
+	TTS_TEXT(answer);
+	return true;
+}
+
+// act on one utterance in g_text: local code, N-best command, the command
+// table, tuling for the rest
+static void handle_utterance(const struct heard *h)
+{
+	// text for tuling, reused so its string keeps the capacity
+	static std_msgs::String msg;
 	int code = 0;
 	int index = 0;
-	int i = 0;
-	int control = 0;
-	static int locked_played = 0;
-	static int unlocked_played = 0;
-	// play back the received voice
-	std_msgs::String msg_tts;
+
+	if (spec_dispatched >= 0 && spec_settle(sb_view(&g_text)))
+		return;
+
+	cmd_end_ms = h->speech_end_ms;
+	if (h->local_code >= 0) {
+		// the local spotter was confident, skip the text matching. its
+		// templates carry the prefix, see local_kws.h
+		code = h->local_code;
+		cmd_from_local = true;
+		index = search_command_index(code);
+		if (index < 0)
+			return;
+		sb_set(&g_text, voice_commands[index].command, voice_commands[index].len);
+		printf("local voice_command=[%s] code=%d\n", g_result, code);
+		msg.data.assign(g_text.buf, g_text.len);
+		goto DISPATCH;
+	}
+	cmd_from_local = false;
+
+	if (g_text.len < 2) {
+		ROS_INFO("no voice detected g_result=%p", g_result);
+		return;
+	}
+
+	printf("voice=[%s] len=%zu state=%s\n", g_result, g_text.len, sm_state_name(g_sm.state));
+
+	if (g_text.len > 100) {
+		ROS_INFO("too many commands");
+		return;
+	}
+
+	if (g_text.len < 7) {
+		ROS_INFO("too short commands");
+		return;
+	}
+
+	if (nbest_rejected(&h->nbest))
+		return;
+
+	code = nbest_command(&h->nbest);
+	if (code >= 0) {
+		msg.data.assign(g_text.buf, g_text.len);
+		goto DISPATCH;
+	}
+
+	if (sb_remove_all(&g_text, ROBOT_PREFIX, ROBOT_PREFIX_LEN)) {
+		// messages for robot get content
+		printf("voice_command=[%s]\n", g_result);
+	} else {
+		ROS_INFO("skip ...");
+		return;
+	}
+
+	msg.data.assign(g_text.buf, g_text.len);
+
+	code = match_command(sb_view(&g_text));
+	if (code < 0)
+		code = pinyin_command();
+
+DISPATCH:
+	// code=0, stop all actions! whoever published it, the motion
+	// executor may have been handed a move since
+	if (code == 0) { // stop movement
+		stop_robot();
+	}
+
+	if (code >= 0) { // the voice is a special command
+		index = search_command_index(code);
+		ROS_INFO("command [%d] index=%d", code, index);
+		ep_next_context = EP_COMMAND;
+		speak_command(code);
+		exec_command(code, code == h->fast_code);
+	} else { // unknown code, the intent router decides
+		int route = route_intent();
+		// what the skills cannot answer goes to tuling after all
+		bool can_send = route == IM_CLOUD || route == IM_LOCAL;
+		printf("unknow code [%s]\n", g_result);
+
+		if (1 == manual_control) {
+			
+		} else {
+			if (can_send && local_answer(route)) {
+				ep_next_context = EP_QUESTION;
+				return;
+			}
+			if (can_send) {
+				TTS_TEXT("请稍等");
+				msg.data.assign(g_text.buf, g_text.len);
+				pub_text.publish(msg); // send to tuling
+				ep_next_context = EP_QUESTION;	// follow-up questions
+				return;
+			}
+			
+			{
+				TTS_TEXT("请再说一遍");
+				ep_next_context = EP_RETRY;
+			}
+		}
+	} // unknown code, send to tuling
+}
+
+// the prompt of a lock state change, once
+static void announce_lock_state()
+{
+	if (sys_locked == 1) {
+		if (locked_played == 0) {
+			locked_played = 1;
+			if (1 == manual_control) {
+				system("play /tmp/locked.wav");
+			} else {
+				tts_say("认证失败！系统被锁定", voice_system::TTSRequest::PRIORITY_URGENT);
+			}
+		}
+	} else if (sys_locked == 0) { // FR PASS
+		if (unlocked_played == 0) {
+			unlocked_played = 1;
+			if (1 == manual_control) {
+				system("play /tmp/unlocked.wav");
+			} else {
+				tts_say("认证通过！欢迎使用ROS机器人", voice_system::TTSRequest::PRIORITY_URGENT);
+			}
+		}
+	}
+}
+
+static void on_face_auth(int auth)
+{
+	ROS_INFO("+%s auth=%d sys_locked=%d", __func__, auth, sys_locked);
+	if (auth == SYS_AUTH) {
+		// unlocked: the welcome TTS plays while the session opens.
+		// a turn still out owns the pre-warm, it starts the next one itself
+		if (sys_locked != 0 && !listen_turn)
+			prewarm_start();
+		sys_locked = 0;
+	} else {
+		sys_locked = 1;
+	}
+	ROS_INFO("-%s sys_locked=%d", __func__, sys_locked);
+}
+
+// set g_result by manual_code
+static void run_manual_code(const struct cmdq_entry *e)
+{
+	struct heard h;
+	int code = e->code;
+	int index;
+
+	ROS_INFO("MANUALcode=%d", code);
+	index = search_command_index(code);
+	ROS_INFO("control=%d index=%d", code, index);
+	if (index < 0)
+		return;
+	utt_reset();
+	sb_set(&g_text, ROBOT_PREFIX, ROBOT_PREFIX_LEN);
+	sb_append(&g_text, voice_commands[index].command, voice_commands[index].len);
+	printf("NEW voice=[%s] len=%zu\n", g_result, g_text.len);
+	h.local_code = -1;
+	h.fast_code = e->mark ? code : -1;
+	h.speech_end_ms = 0;
+	h.nbest.count = 0;
+	handle_utterance(&h);
+}
+
+// everything queued from /voice/control, at once. while locked the
+// codes wait in the queue
+static void run_manual_codes()
+{
+	struct cmdq_entry codes[CMDQ_DRAIN_MAX];
+	int i, n;
+
+	if (sys_locked != 0 || manual_control != 1)
+		return;
+	while ((n = cmdq_drain(&g_manual, codes, CMDQ_DRAIN_MAX)) > 0) {
+		for (i = 0; i < n; i++)
+			run_manual_code(&codes[i]);
+		cmdq_report(&g_manual);
+	}
+}
+
+static void on_object_name(const char *name)
+{
+	if (!listen_turn) {
+		add_object_name(name);
+		return;
+	}
+	if (num_deferred_names >= MAX_DEFERRED_NAMES) {
+		ROS_ERROR("%s too many new objects, drop %s", __func__, name);
+		return;
+	}
+	strcpy(deferred_names[num_deferred_names++], name);
+}
+
+// hand the microphone to the listening thread if nothing is in the way
+static void maybe_listen()
+{
+	int i;
+
+	if (listen_turn)
+		return;
+	for (i = 0; i < num_deferred_names; i++)
+		add_object_name(deferred_names[i]);
+	num_deferred_names = 0;
+
+	if (tts_outstanding > 0 && lat_now_ms() - tts_sent_ms > TTS_STATUS_TIMEOUT_MS) {
+		ROS_ERROR("%s no word from the TTS on %d prompts, listen anyway", __func__, tts_outstanding);
+		tts_outstanding = 0;
+	}
+	if (sys_locked != 0 || manual_control == 1 || playing || tts_outstanding > 0)
+		return;
+	listen_turn = true;
+	sem_post(&listen_sem);
+}
+
+static void dispatch_event(const struct evq_event *ev)
+{
+	const struct sm_transition *t;
+
+	if (ev->type < 0 || ev->type >= EV_COUNT)
+		return;
+	lat_add(&lat_event[ev->type], lat_now_ms() - ev->t_ms);
+	if (lat_event[ev->type].count % EVENT_REPORT_EVERY == 0)
+		lat_report(&lat_event[ev->type]);
+
+	switch (ev->type) {
+	case EV_FACE_AUTH:
+		on_face_auth(ev->value);
+		break;
+	case EV_MANUAL_CODE:
+		// drained below, after the lock state is known
+		break;
+	case EV_TTS_PLAYING:
+		// playing itself is set by the callback
+		break;
+	case EV_TTS_DONE:
+		if (tts_outstanding > 0)
+			tts_outstanding--;
+		break;
+	case EV_TASK_RESULT:
+		// TODO PF error, stop PF
+		t = sm_lookup(&g_sm, SM_EV_TASK_DONE);
+		if (t)
+			sm_finish(&g_sm, t);
+		sm_report(&g_sm);
+		break;
+	case EV_OBJECT_NAME:
+		on_object_name(ev->text);
+		break;
+	case EV_SPECULATIVE:
+		spec_dispatch(ev->value);
+		break;
+	case EV_UTTERANCE:
+		listen_turn = false;
+		// dropped if the system got locked while listening
+		if (ev->value && sys_locked == 0)
+			handle_utterance((const struct heard *)ev->data);
+		break;
+	default:
+		break;
+	}
+
+	announce_lock_state();
+	run_manual_codes();
+	maybe_listen();
+	fast_state = g_sm.state;
+	fast_armed = sys_locked == 0;
+}
+
+// listening thread: one utterance per turn the dispatcher hands out.
+// g_text is ours until EV_UTTERANCE is posted
+static void *listen_proc(void *)
+{
+	kobuki_msgs::Led robot_led;
+	kobuki_msgs::Sound robot_sound;
+
+	for (;;) {
+		while (sem_wait(&listen_sem) && errno == EINTR)
+			;
+		if (!listen_running)
+			break;
+
+		// use the LED/sound for mic start
+		robot_sound.value = 1;
+		pub_robot_sound.publish(robot_sound);
+
+		robot_led.value = kobuki_msgs::Led::RED;
+		pub_robot_led.publish(robot_led);
+		asrProcess();
+		robot_led.value = kobuki_msgs::Led::BLACK;
+		pub_robot_led.publish(robot_led);
+
+		// the session is closed, the recognizer callbacks are done
+		g_heard.local_code = local_code;
+		g_heard.fast_code = fast_sent;
+		g_heard.speech_end_ms = speech_end_ms;
+		g_heard.nbest = g_nbest;
+
+		// never dropped, the dispatcher would wait for it forever
+		while (evq_push_data(&g_events, EV_UTTERANCE, asr_flag, &g_heard))
+			usleep(1000);
+	}
+	return NULL;
+}
+
+static int init_executor()
+{
+	int i;
+
+	for (i = 0; i < EV_COUNT; i++)
+		lat_init(&lat_event[i], ev_names[i]);
+	if (evq_init(&g_events) || sem_init(&listen_sem, 0, 0)) {
+		ROS_ERROR("%s no semaphore", __func__);
+		return -1;
+	}
+	if (pthread_create(&listen_thread, NULL, listen_proc, NULL)) {
+		ROS_ERROR("%s no listening thread", __func__);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	struct evq_event ev;
+	int i;
+
 	//std::cout << "asr start ..." << endl; 
     ros::init(argc, argv, "xf_asr_node");
 
 	ros::NodeHandle n;
 	
-	// OD service call 
-	ros::ServiceClient od_client = n.serviceClient<demo_od::ObjectDetect>("object_detect_wrapper");
-	demo_od::ObjectDetect od_srv;
-	demo_od::ObjectDetect::Request od_req;
-	demo_od::ObjectDetect::Response od_resp;
-
-	// TTS service call 
-	ros::ServiceClient client = n.serviceClient<voice_system::TTSService>("tts_service");
-	voice_system::TTSService srv;
+	// prompts for the TTS, and how far it got with them
+	pub_tts = n.advertise<voice_system::TTSRequest>("/voice/tts_request", 50);
+	pub_tts_flush = n.advertise<std_msgs::Int32>("/voice/tts_flush", 10);
+	ros::Subscriber sub_tts_status = n.subscribe("/voice/tts_status", 50, ttsStatusCallback);
 
 	ros::Subscriber sub_manual = n.subscribe("/voice/control", 50, manualCallback);
 		
@@ -596,30 +2288,31 @@ int main(int argc, char* argv[])
 		
 	// check if the tts/speaker is playing
     ros::Subscriber sub_ttsplay = n.subscribe("/voice/xf_tts_playing", 50, ttsplayCallback);
+
+	// object names the detector learned, extend the vocabulary
+	ros::Subscriber sub_objects = n.subscribe("/voice/object_names", 50, objectNamesCallback);
 	
 	// publish to tts, play back the received voice
 	// switch to use service API, discard the pub
 	//ros::Publisher pub_tts = n.advertise<std_msgs::String>("/voice/xf_tts_topic", 10);
 
-	ros::Publisher pub_text = n.advertise<std_msgs::String>("/voice/tuling_nlu_topic", 50);
+	pub_text = n.advertise<std_msgs::String>("/voice/tuling_nlu_topic", 50);
 
 	// command for other modules
-	ros::Publisher pub_cmd = n.advertise<std_msgs::Int32>("/voice/cmd_topic", 50);
+	pub_cmd = n.advertise<std_msgs::Int32>("/voice/cmd_topic", 50);
 
-	// control the robot move
-	ros::Publisher pub_robot = n.advertise<geometry_msgs::Twist>("/mobile_base/commands/velocity", 1000); 
+	// control the robot move. setpoints are streamed, a stale one is
+	// worse than a lost one
+	pub_robot = n.advertise<geometry_msgs::Twist>("/mobile_base/commands/velocity", 1); 
 
 	// control the LED on robot kobuki_msgs/Led
- 	ros::Publisher pub_robot_led = n.advertise<kobuki_msgs::Led>("/mobile_base/commands/led1", 10);
+ 	pub_robot_led = n.advertise<kobuki_msgs::Led>("/mobile_base/commands/led1", 10);
 	
 	// control the sound on robot
- 	ros::Publisher pub_robot_sound = n.advertise<kobuki_msgs::Sound>("/mobile_base/commands/sound", 10);
+ 	pub_robot_sound = n.advertise<kobuki_msgs::Sound>("/mobile_base/commands/sound", 10);
 	   
 	// publish for ARM
-	ros::Publisher pub_arm = n.advertise<std_msgs::Float32MultiArray>("/voice/manipulate_topic", 50);
-	int manual_control = -1;
-
-	ros::Rate loop_rate(10);
+	pub_arm = n.advertise<std_msgs::Float32MultiArray>("/voice/manipulate_topic", 50);
 
 	ROS_INFO("start listen ... argc=%d", argc);
 
@@ -631,461 +2324,75 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	if (arena_init(&g_arena, UTT_ARENA_SIZE)) {
+		ROS_ERROR("no memory for the utterance arena");
+		return -1;
+	}
+	utt_reset();
+
 	read_config();
+	init_pinyin();
+	init_intent();
+	init_skills();
+	init_task_sm();
+	init_local_kws();
+	init_spec_dispatch();
+	init_grammar();
+	init_lexicon();
+	init_nbest();
+	init_endpoint();
+	init_sightings();
+	init_manual_queue();
+	if (init_motion()) {
+		ROS_ERROR("cannot start the motion executor");
+		return -1;
+	}
+	lat_init(&lat_fast, "speech end->safety command (fast lane)");
+	lat_init(&lat_setup_cold, "session setup (cold)");
+	lat_init(&lat_setup_saved, "session setup saved by pre-warm");
+	if (init_executor())
+		return -1;
+
+	// callbacks on their own thread, blocking service calls of the
+	// dispatcher and the listening turn no longer hold them up
+	ros::AsyncSpinner spinner(1);
+	spinner.start();
+
 	//std::cout << "start listen ..." << endl;
 	while (ros::ok())
 	{
-		if (0) {
-			OR_xyz.data.clear();
-			OR_xyz.data.push_back(1);
-			OR_xyz.data.push_back(2);
-			OR_xyz.data.push_back(3);
-			pub_arm.publish(OR_xyz);
-			goto DONE;
-		}
-		
-		if (0) { // sound test
-			ROS_INFO("i=%d", i);
-			robot_sound.value = i;
-			pub_robot_sound.publish(robot_sound);
-			i++;
-			if (i > 6) i = 0; 
-			goto DONE;
-		}		
-		if (0) { // LED test
-			ROS_INFO("i=%d", i);
-			robot_led.value = i; //kobuki_msgs::Led::RED;
-			pub_robot_led.publish(robot_led);
-			i++;
-			if (i > 3) i = 0; 
-			goto DONE;
-		}
-	
-		if (0) { // od service test
-			// OD service call rosservice call /object_detect_wrapper "target: 'bottle'"
-			od_req.target = "bottle";
-			if (od_client.call(od_req, od_resp)) {
-				ROS_INFO("call OD service okay");
-			} else {
-				ROS_INFO("call OD service fail");
-			}
-			ROS_INFO("x,y,z=%f-%f-%f result=%d", od_resp.x, 
-				od_resp.y, od_resp.z, od_resp.result);
-			//continue;
-			goto DONE;
-		}
-
-		if (0) { // tts service test
-			#if 1
-				TTS_TEXT("认证失败！系统被锁定");
-			#else
-				memset(tts_content, 0, sizeof(tts_content));
-				strcat(tts_content, "认证失败！系统被锁定");
-				srv.request.target = tts_content;
-				if (client.call(srv)) {
-					ROS_INFO("call TTS service okay");
-				} else {
-					ROS_INFO("call TTS service fail");
-				}
-			#endif
-			goto DONE;
-		}
-	
-		if (g_result) {
-			free(g_result);
-			g_result = NULL;
-		}
-	
-		// listen .. 
-		if (sys_locked == 1) {
-			//ROS_INFO("sys_locked, skip voice!");
-			if (locked_played == 0) {
-				locked_played = 1;
-				if (1 == manual_control) {
-					system("play /tmp/locked.wav");
-				} else {
-					TTS_TEXT("认证失败！系统被锁定");			
-				}
-			}
-			//continue;
-		}
-		else if (sys_locked == 0) { // FR PASS
-			if (unlocked_played == 0) {
-				unlocked_played = 1;
-				if (1 == manual_control) {
-					system("play /tmp/unlocked.wav");
-				} else {
-					TTS_TEXT("认证通过！欢迎使用ROS机器人");
-				}
-			} else {
-				
-			}
-
-			if (manual_control == 1) {
-				// set g_result by manual_code;
-				if (voice_manual_code > -1) {
-					ROS_INFO("MANUALcode=%d", voice_manual_code);
-					asr_flag = 1;
-					index = search_command_index(voice_manual_code);
-					ROS_INFO("control=%d index=%d", voice_manual_code, index);
-				    g_result = (char*)realloc(g_result, strlen(voice_commands[index].command) + 10);					
-					sprintf(g_result, "机器人%s", voice_commands[index].command);
-					printf("NEW voice=[%s] len=%zu\n", g_result, strlen(g_result));
-					voice_manual_code = -1;
-				} else { // no vice input
-					asr_flag = 0;
-					if (g_result) {
-						free(g_result);
-						g_result = NULL;
-					}
-				}
-			} else {
-				// use the LED/sound for mic start
-				robot_sound.value = 1;
-				pub_robot_sound.publish(robot_sound);
-				
-				robot_led.value = kobuki_msgs::Led::RED;
-				pub_robot_led.publish(robot_led);
-				asrProcess();
-				robot_led.value = kobuki_msgs::Led::BLACK;
-				pub_robot_led.publish(robot_led);
-			}
-		} else {
-			ROS_INFO("sys_locked=%d", sys_locked);
-		}
-		
-		if (0)
-		{	// rostopic pub -v -1 /mobile_base/commands/velocity geometry_msgs/Twist -- '[0.1,0,0]' '[0,0,0]'
-			ROS_INFO("move...");
-			input_vel.linear.x=0.0; //forward/back
-			input_vel.linear.y=0.0;
-			input_vel.linear.z=0.0;
-			input_vel.angular.x=0.0;
-			input_vel.angular.y=0.0;
-			input_vel.angular.z=0.3; //left/right
-			pub_robot.publish(input_vel);
-			//continue;
-		}
-		// get voice result
-		//ROS_INFO("asr_flag=%d current_sm=%d sys_locked=%d g_result=%p", asr_flag, current_sm, sys_locked, g_result);
-		if (asr_flag) {
-			std_msgs::String msg;
-			std_msgs::Int32 cmd_msg;
-
-			if ((g_result == NULL) || (strlen(g_result) < 2)) {
-				ROS_INFO("no voice detected g_result=%p", g_result);
-				goto DONE;
-			}
-			
-			printf("voice=[%s] len=%zu current_sm=%d\n", g_result, strlen(g_result), current_sm);
-						
-			if (strlen(g_result) > 100) {
-				ROS_INFO("too many commands");
-				goto DONE;
-			}
-			
-			if (strlen(g_result) < 7) {
-				ROS_INFO("too short commands");
-				goto DONE;
-			}
-#if 0			
-			// add manual control
-			control = get_control();
-			if (control > -1) {
-				index = search_command_index(control);
-				ROS_INFO("control=%d index=%d", control, index);
-			    g_result = (char*)realloc(g_result, strlen(voice_commands[index].command) + 10);					
-				sprintf(g_result, "机器人%s", voice_commands[index].command);
-				printf("NEW voice=[%s] len=%zu\n", g_result, strlen(g_result));
-			}
-#endif
-			found = strstr(g_result, "机器人");
-			if (found) {
-				// messages for robot get content
-				delStr(g_result, "机器人");
-				printf("voice_command=[%s]\n", g_result);
-			} else {
-				ROS_INFO("skip ...");
-				goto DONE;
-			}
-
-			msg.data = g_result;
-
-			code = search_command(g_result);
+		int timeout = 500;
+
+		// the timeout only notices the shutdown, a silent TTS and the
+		// FR start, events wake up at once
+		if (fr_start_ms > 0)
+			timeout = fr_start_ms > lat_now_ms() ? (int)(fr_start_ms - lat_now_ms()) + 1 : 0;
+		if (timeout > 500)
+			timeout = 500;
+		if (evq_pop(&g_events, &ev, timeout))
+			dispatch_event(&ev);
+		else
+			maybe_listen();
+		if (fr_start_ms > 0 && lat_now_ms() >= fr_start_ms)
+			start_fr();
+	}
 
-			// code=0, stop all actions!
-			if (code == 0) { // stop movement
-				current_sm = CURRENT_IDLE;
-				input_vel.linear.x=0.0; //forward/back
-				input_vel.linear.y=0.0;
-				input_vel.linear.z=0.0;
-				input_vel.angular.x=0.0;
-				input_vel.angular.y=0.0;
-				input_vel.angular.z=0.0; //left/right
-				pub_robot.publish(input_vel);
-			}
-			
-			if (code >= 0) { // the voice is a special command
-				cmd_msg.data = code;
-				index = search_command_index(code);
-				ROS_INFO("command [%d] index=%d", code, index);
-	
-				if (code == 61) {
-					// no need to speak out
-				} else {
-					if (1 == manual_control) {
-					    memset(tts_content, 0, sizeof(tts_content));
-						sprintf(tts_content, "play /tmp/%d.wav", code);
-						ROS_INFO("exec [%s]", tts_content);
-						system(tts_content);
-					} else {
-						memset(tts_content, 0, sizeof(tts_content));
-						sprintf(tts_content, "执行命令 %s", voice_commands[index].command);
-						srv.request.target = tts_content;
-						if (client.call(srv)) {
-							ROS_INFO("call TTS service okay");
-						} else {
-							ROS_INFO("call TTS service fail");
-						}						
-					}
-				}
-
-				if (code <= 100) { // pf/vslam/or
-					switch (code) {
-						case 0:// stop command, send out in any conditions 
-							current_sm = CURRENT_IDLE;
-							pub_cmd.publish(cmd_msg);
-							break;
-						case 1: // PF command check if it is oaky to send out this command
-							if (current_sm == CURRENT_IDLE) {
-								current_sm = CURRENT_PF;
-								pub_cmd.publish(cmd_msg);			
-							}
-							break;
-						case 2: // stop PF
-						case 21:
-							if (current_sm == CURRENT_PF) {
-								current_sm = CURRENT_IDLE;
-								cmd_msg.data = 2;
-								pub_cmd.publish(cmd_msg);
-							}
-							break;
-						case 3: // start VSLAM
-							if (current_sm == CURRENT_IDLE) {
-								current_sm = CURRENT_VSLAM;
-								pub_cmd.publish(cmd_msg);
-							}
-							break;
-						case 4: // stop VSLAM
-							if (current_sm == CURRENT_VSLAM) {
-								current_sm = CURRENT_IDLE;
-								pub_cmd.publish(cmd_msg);
-							}
-							break;
-						case 5: // bye-bye system lock and start FR, and stop all other running tasks
-						case 51:
-							if (current_sm == CURRENT_VSLAM) {
-								// stop VSLAM
-								cmd_msg.data = 4;
-								pub_cmd.publish(cmd_msg);
-							}
-							if (current_sm == CURRENT_PF) {
-								// stop PF
-								cmd_msg.data = 2;
-								pub_cmd.publish(cmd_msg);	
-							}
-							current_sm = CURRENT_IDLE;
-							sys_locked = -1;
-							asr_flag = 0;
-							locked_played = 0;
-							unlocked_played = 0;
-							if (g_result) {
-								free(g_result);
-								g_result = NULL;
-							}
-							sleep(1); // make sure tasks are stop
-							cmd_msg.data = 5;
-							pub_cmd.publish(cmd_msg); // start FR task
-							break;
-						case 6: // arm move
-						case 61:
-							//if (current_sm == CURRENT_IDLE) {
-								//current_sm = CURRENT_IDLE;
-								cmd_msg.data = 6;
-								pub_cmd.publish(cmd_msg);
-							//}
-							break;
-						case 7: // open HAND
-							if (current_sm != CURRENT_HAND_OPEN) {
-								current_sm = CURRENT_HAND_OPEN;
-								pub_cmd.publish(cmd_msg);
-							}
-							break;
-						case 8: // 	close hand
-							if (current_sm == CURRENT_HAND_OPEN) {
-								current_sm = CURRENT_HAND_CLOSE;
-								pub_cmd.publish(cmd_msg);
-							}
-							break;
-						case 9:// OR
-						case 91:
-						case 92:
-						case 93:
-						case 94:
-						case 95:
-						{
-							char object_finding[255];
-							char *found_object = NULL;
-							int i = 0;
-							i = 0;
-							// start to find object TTS
-							while (strlen(objects[i].name1)) {
-								ROS_INFO("%s-%s\n", objects[i].name1, objects[i].name2);
-								printf("%s-%s\n", objects[i].name1, objects[i].name2);
-							    found_object = strstr(g_result, objects[i].name1);
-								if (found_object) {
-									ROS_INFO("start find %s", objects[i].name2);
-									od_req.target = objects[i].name2; 
-									if (od_client.call(od_req, od_resp)) {
-										ROS_INFO("call OD service okay");
-									} else {
-										ROS_INFO("call OD service fail");
-									}
-									ROS_INFO("x,y,z=%f-%f-%f result=%d", od_resp.x, 
-										od_resp.y, od_resp.z, od_resp.result);
-									//break;
-									memset(object_finding, 0, sizeof(object_finding));
-									
-									if (od_resp.result) {
-										if (1 == manual_control) {
-											system("play /tmp/found.wav");
-										} else {
-											TTS_TEXT("已找到");
-										}
-										OR_xyz.data.clear();
-										OR_xyz.data.push_back(od_resp.x);
-										OR_xyz.data.push_back(od_resp.y);
-										OR_xyz.data.push_back(od_resp.z);
-									pub_arm.publish(OR_xyz);
-									} else {
-										if (1 == manual_control) {
-											system("play /tmp/notfound.wav");
-										} else {
-											TTS_TEXT("未找到");
-										}
-									}
-								}
-								i++;
-							}
-							break;
-						}
-						default:
-							break;
-					}
-					
-				} else { // code > 100, control commands
-					if ((current_sm == CURRENT_PF)
-						|| (current_sm == CURRENT_VSLAM)) {
-							ROS_INFO("CANNOT move %d", current_sm);
-						} 
-						else {
-						ROS_INFO("move %d...", code);
-						input_vel.linear.x=0.0; //forward/back
-						input_vel.linear.y=0.0;
-						input_vel.linear.z=0.0;
-						input_vel.angular.x=0.0;
-						input_vel.angular.y=0.0;
-						input_vel.angular.z=0.0; //left/right
-						switch (code) {
-							case 300:
-								input_vel.angular.z = 1.9;
-								break;
-							case 400:
-								input_vel.angular.z = -1.9;
-								break;
-							case 500:
-							case 501:
-								input_vel.linear.x = 0.3;
-								break;
-							case 600:
-							case 601:
-								input_vel.linear.x = -0.3;
-								break;
-							default:
-								break;
-						}
-						pub_robot.publish(input_vel);
-						current_sm = CURRENT_IDLE;
-					}
-				}
-				//sleep(8);
-			} else { // unknown code, send to tuling
-				bool can_send = false;
-				printf("unknow code [%s]\n", g_result);
-				//delStr(g_result, "机器人");
-				//printf("publish to tuling [%s]\n", g_result);
-				//deleteChars(g_result, "机器人");
-				// FIXME filter
-				found = strstr(g_result, "今天"); 
-				if (found) {
-					can_send = true;
-				}
-				
-				found = strstr(g_result, "日期");
-				if (found) {
-					can_send = true;
-				}
-				
-				found = strstr(g_result, "时间");
-				if (found) {
-					can_send = true;
-				}
-				
-				found = strstr(g_result, "天气");
-				if (found) {
-					can_send = true;
-				}
-				
-				found = strstr(g_result, "名字");
-				if (found) {
-					can_send = true;
-				}
-				
-				found = strstr(g_result, "笑话");
-				if (found) {
-					can_send = true;
-				}
-				
-				found = strstr(g_result, "故事");
-				if (found) {
-					can_send = true;
-				}
-				
-				if (1 == manual_control) {
-					
-				} else {
-					if (can_send) {
-						TTS_TEXT("请稍等");
-						msg.data = g_result;
-						pub_text.publish(msg); // send to tuling
-						goto DONE;
-					}
-					
-					{
-						TTS_TEXT("请再说一遍");
-					}
-				}
-				//sleep(8);
-			} // unknown code, send to tuling
-			//speech_end = true;
-			//asr_flag =0;
-		}else {
-			//ROS_INFO("asr_flag=false");
-		}
-DONE:		
-		loop_rate.sleep();
-        ros::spinOnce();
-	 }
+	spinner.stop();
+	listen_running = false;
+	sem_post(&listen_sem);
+	pthread_join(listen_thread, NULL);
+	motion_stop(&g_motion);
+	motion_report(&g_motion);
+	motion_destroy(&g_motion);
+	for (i = 0; i < EV_COUNT; i++) {
+		if (lat_event[i].count > 0)
+			lat_report(&lat_event[i]);
+	}
 
+	prewarm_wait();
+	if (prewarm_state == PREWARM_READY)
+		sr_uninit(&prewarm_rec);
+	if (msp_logged_in)
+		MSPLogout();
 	return 0;
 }
@@ -8,6 +8,13 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <atomic>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <ros/ros.h>
 #include <std_msgs/String.h>
 #include <std_msgs/Int32.h>
@@ -16,10 +23,43 @@
 #include "msp_cmn.h"
 #include "msp_errors.h"
 #include "voice_system/TTSService.h"
+#include "voice_system/TTSRequest.h"
+#include "voice_system/TTSStatus.h"
+#include "latency_stats.h"
 
 using namespace std;
 static const char* filename = "/tmp/voice.wav";
 static ros::Publisher pub_play;
+static ros::Publisher pub_status;
+
+// prompts wait by priority, one worker synthesizes and plays them in turn
+#define TTS_QUEUE_MAX	16
+#define TTS_TEXT_MAX	1024
+#define TTS_SOURCE_MAX	32
+#define TTS_PRIORITIES	(voice_system::TTSRequest::PRIORITY_URGENT + 1)
+#define TTS_TAIL_MS	1000	// echo dies down before the mic is back
+
+struct tts_job {
+	unsigned int id;
+	char source[TTS_SOURCE_MAX];
+	char text[TTS_TEXT_MAX];
+	int priority;
+	double t_ms;		// lat_now_ms() when queued
+	int *done;		// final status goes here, the service waits on it
+};
+
+static pthread_mutex_t tts_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tts_cond = PTHREAD_COND_INITIALIZER;	// queue or a job changed
+static struct tts_job tts_queue[TTS_QUEUE_MAX];	// in arrival order
+static int tts_count = 0;
+static struct tts_job tts_current;
+static bool tts_busy = false;		// tts_current is synthesized or played
+static std::atomic<int> tts_cancel(0);	// cut tts_current short, read unlocked by the synthesis
+static pid_t play_pid = 0;
+static unsigned int service_id = 0;
+static unsigned int coalesced_count = 0;
+static unsigned int preempted_count = 0;
+static struct latency_stats lat_wait[TTS_PRIORITIES];	// queued -> started
 
 /* wav音频头部格式 */
 typedef struct _wave_pcm_hdr
@@ -110,6 +150,13 @@ int text_to_speech(const char* src_text, const char* des_path, const char* param
 		}
 		if (MSP_TTS_FLAG_DATA_END == synth_status)
 			break;
+		if (tts_cancel)
+		{
+			printf("\ncanceled\n");
+			QTTSSessionEnd(sessionID, "Canceled");
+			fclose(fp);
+			return -1;
+		}
 		printf(">");
 		usleep(150*1000); //防止频繁占用CPU
 	}
@@ -176,7 +223,36 @@ int TextToWav(const char* text, const char* filename)
 exit:
 	MSPLogout(); //退出登录
 
-	return 0;
+	return ret;
+}
+
+// play in a child of our own, so a more urgent prompt can stop it
+static int play_file(const char *path)
+{
+	pid_t pid;
+	int status = -1;
+
+	pid = fork();
+	if (pid == 0) {
+		execlp("play", "play", path, (char *)NULL);
+		_exit(127);
+	}
+	if (pid < 0) {
+		printf("%s fork failed\n", __func__);
+		return -1;
+	}
+	pthread_mutex_lock(&tts_lock);
+	play_pid = pid;
+	// preempted after the caller looked, before there was a pid to kill
+	if (tts_cancel)
+		kill(pid, SIGTERM);
+	pthread_mutex_unlock(&tts_lock);
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+		;
+	pthread_mutex_lock(&tts_lock);
+	play_pid = 0;
+	pthread_mutex_unlock(&tts_lock);
+	return status;
 }
 
 void playWav()
@@ -186,60 +262,253 @@ void playWav()
 	system("amixer -c 1 cset numid=7,iface=MIXER,name='Mic Capture Switch' off");
 	system("amixer -c 0 cset numid=19,iface=MIXER,name='Capture Switch' off");
 	ROS_INFO("Start play...");
-	system("play /tmp/voice.wav");
+	play_file(filename);
 	ROS_INFO("End play...");
 	system("amixer -c 1 cset numid=7,iface=MIXER,name='Mic Capture Switch' on");
 	system("amixer -c 1 cset numid=3,iface=MIXER,name='Headset Capture Switch' on");
 	system("amixer -c 0 cset numid=19,iface=MIXER,name='Capture Switch' on");
 }
 
-static void ttsCallback(const std_msgs::String::ConstPtr& msg)
+static void publish_status(const struct tts_job *job, int status, double wait_ms)
+{
+	voice_system::TTSStatus st;
+
+	st.id = job->id;
+	st.source = job->source;
+	st.status = status;
+	st.wait_ms = wait_ms;
+	pub_status.publish(st);
+}
+
+// job ended before it was played, tts_lock held
+static void tts_drop(const struct tts_job *job, int status)
+{
+	if (job->done) {
+		*job->done = status;
+		pthread_cond_broadcast(&tts_cond);
+	}
+	publish_status(job, status, lat_now_ms() - job->t_ms);
+}
+
+// stop the prompt playing if job is more urgent, tts_lock held
+static void tts_preempt(const struct tts_job *job)
+{
+	if (!tts_busy || job->priority <= tts_current.priority || tts_cancel)
+		return;
+	ROS_INFO("%s [%s] preempts [%s]", __func__, job->text, tts_current.text);
+	tts_cancel = 1;
+	preempted_count++;
+	if (play_pid > 0)
+		kill(play_pid, SIGTERM);
+}
+
+// queue a prompt. a text already queued or playing is not said twice, a
+// more urgent prompt stops the one playing
+static void tts_enqueue(unsigned int id, const char *source, const char *text,
+		int priority, int *done)
+{
+	struct tts_job job;
+	int i;
+
+	memset(&job, 0, sizeof(job));
+	job.id = id;
+	strncpy(job.source, source, sizeof(job.source) - 1);
+	strncpy(job.text, text, sizeof(job.text) - 1);
+	job.priority = priority < TTS_PRIORITIES ? priority : TTS_PRIORITIES - 1;
+	job.t_ms = lat_now_ms();
+	job.done = done;
+
+	pthread_mutex_lock(&tts_lock);
+	if (tts_busy && !tts_cancel && !strcmp(tts_current.text, job.text)) {
+		coalesced_count++;
+		tts_drop(&job, voice_system::TTSStatus::COALESCED);
+		goto exit;
+	}
+	for (i = 0; i < tts_count; i++) {
+		if (!strcmp(tts_queue[i].text, job.text)) {
+			if (job.priority > tts_queue[i].priority)
+				tts_queue[i].priority = job.priority;
+			// urgent now, it does not wait behind what is playing
+			tts_preempt(&tts_queue[i]);
+			coalesced_count++;
+			tts_drop(&job, voice_system::TTSStatus::COALESCED);
+			goto exit;
+		}
+	}
+	if (tts_count >= TTS_QUEUE_MAX) {
+		ROS_ERROR("%s queue full, drop [%s]", __func__, job.text);
+		tts_drop(&job, voice_system::TTSStatus::FAILED);
+		goto exit;
+	}
+
+	tts_preempt(&job);
+	tts_queue[tts_count++] = job;
+	pthread_cond_broadcast(&tts_cond);
+
+exit:
+	pthread_mutex_unlock(&tts_lock);
+	ROS_INFO("%s %s/%u prio %d, %d queued, %u coalesced, %u preempted", __func__,
+		source, id, job.priority, tts_count, coalesced_count, preempted_count);
+}
+
+// drop every prompt up to priority, queued or playing
+static void tts_flush(int priority)
+{
+	int i, kept = 0;
+
+	pthread_mutex_lock(&tts_lock);
+	for (i = 0; i < tts_count; i++) {
+		if (tts_queue[i].priority <= priority) {
+			preempted_count++;
+			tts_drop(&tts_queue[i], voice_system::TTSStatus::PREEMPTED);
+		} else {
+			tts_queue[kept++] = tts_queue[i];
+		}
+	}
+	tts_count = kept;
+	if (tts_busy && tts_current.priority <= priority && !tts_cancel) {
+		tts_cancel = 1;
+		preempted_count++;
+		if (play_pid > 0)
+			kill(play_pid, SIGTERM);
+	}
+	pthread_mutex_unlock(&tts_lock);
+	ROS_INFO("%s up to prio %d, %d left", __func__, priority, kept);
+}
+
+// most urgent first, in arrival order within a priority. tts_lock held
+static void tts_pop(struct tts_job *job)
+{
+	int best = 0;
+	int i;
+
+	for (i = 1; i < tts_count; i++) {
+		if (tts_queue[i].priority > tts_queue[best].priority)
+			best = i;
+	}
+	*job = tts_queue[best];
+	for (i = best; i < tts_count - 1; i++)
+		tts_queue[i] = tts_queue[i + 1];
+	tts_count--;
+}
+
+static void publish_playing(int playing)
 {
 	std_msgs::Int32 msg_play;
 
+	msg_play.data = playing;
+	ROS_INFO("%s pub %d", __func__, playing);
+	pub_play.publish(msg_play);
+}
+
+static void *tts_worker(void *arg)
+{
+	bool playing = false;
+	double wait;
+	int status;
+	int ret;
+
+	for (;;) {
+		pthread_mutex_lock(&tts_lock);
+		while (tts_count == 0) {
+			struct timespec ts;
+
+			if (!playing) {
+				pthread_cond_wait(&tts_cond, &tts_lock);
+				continue;
+			}
+			// the mic stays off for the tail unless more is to be said
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += TTS_TAIL_MS / 1000;
+			if (pthread_cond_timedwait(&tts_cond, &tts_lock, &ts) == ETIMEDOUT
+				&& tts_count == 0) {
+				pthread_mutex_unlock(&tts_lock);
+				publish_playing(0);
+				playing = false;
+				pthread_mutex_lock(&tts_lock);
+			}
+		}
+		tts_pop(&tts_current);
+		tts_busy = true;
+		tts_cancel = 0;
+		pthread_mutex_unlock(&tts_lock);
+
+		if (!playing) {
+			publish_playing(1);
+			playing = true;
+		}
+		wait = lat_now_ms() - tts_current.t_ms;
+		lat_add(&lat_wait[tts_current.priority], wait);
+		lat_report(&lat_wait[tts_current.priority]);
+		publish_status(&tts_current, voice_system::TTSStatus::STARTED, wait);
+
+		printf("%s play [%s]\n", __func__, tts_current.text);
+		ret = TextToWav(tts_current.text, filename);
+		if (!tts_cancel && MSP_SUCCESS == ret)
+			playWav();
+
+		pthread_mutex_lock(&tts_lock);
+		if (tts_cancel)
+			status = voice_system::TTSStatus::PREEMPTED;
+		else if (MSP_SUCCESS != ret)
+			status = voice_system::TTSStatus::FAILED;
+		else
+			status = voice_system::TTSStatus::FINISHED;
+		tts_busy = false;
+		if (tts_current.done) {
+			*tts_current.done = status;
+			pthread_cond_broadcast(&tts_cond);
+		}
+		pthread_mutex_unlock(&tts_lock);
+		publish_status(&tts_current, status, wait);
+	}
+	return NULL;
+}
+
+static void ttsCallback(const std_msgs::String::ConstPtr& msg)
+{
 	ROS_INFO("+%s", __func__);
 	printf("%s [%s]\n", __func__, msg->data.c_str());
-	//std::cout<<"Get topic text: "<< msg->data.c_str() << endl; 
+	tts_enqueue(0, "topic", msg->data.c_str(),
+		voice_system::TTSRequest::PRIORITY_NORMAL, NULL);
+}
 
-	TextToWav(msg->data.c_str(), filename);
+// asynchronous requests, progress goes out on /voice/tts_status
+static void requestCallback(const voice_system::TTSRequest::ConstPtr& msg)
+{
+	ROS_INFO("+%s %s/%u prio %d [%s]", __func__, msg->source.c_str(), msg->id,
+		msg->priority, msg->text.c_str());
+	tts_enqueue(msg->id, msg->source.c_str(), msg->text.c_str(), msg->priority, NULL);
+}
 
-	//msg_play.data = 1;
-	//ROS_INFO("%s pub 1", __func__);
-	//pub_play.publish(msg_play);
-	playWav();
-	sleep(1);
-	msg_play.data = 0;
-	ROS_INFO("%s pub 0", __func__);
-	pub_play.publish(msg_play);	
-	
-	ROS_INFO("-%s", __func__);
+// a safety command was heard: what is queued is out of date
+static void flushCallback(const std_msgs::Int32::ConstPtr& msg)
+{
+	ROS_INFO("+%s %d", __func__, msg->data);
+	tts_flush(msg->data);
 }
 
+// blocking, returns once the prompt was played (or merged, or dropped)
 static bool ttsService(voice_system::TTSService::Request &req, voice_system::TTSService::Response &res)
 {
-	res.result = true;
+	int done = 0;
+	unsigned int id;
 
 	printf("+%s play [%s]", __func__, req.target.c_str());
 
-	TextToWav(req.target.c_str(), filename);
-	playWav();
-	sleep(1);
+	pthread_mutex_lock(&tts_lock);
+	id = ++service_id;
+	pthread_mutex_unlock(&tts_lock);
+	tts_enqueue(id, "service", req.target.c_str(),
+		voice_system::TTSRequest::PRIORITY_NORMAL, &done);
 
-#if 0
-	printf("%s [%s]\n", __func__, msg->data.c_str());
-	//std::cout<<"Get topic text: "<< msg->data.c_str() << endl; 
+	pthread_mutex_lock(&tts_lock);
+	while (!done)
+		pthread_cond_wait(&tts_cond, &tts_lock);
+	pthread_mutex_unlock(&tts_lock);
+	res.result = done == voice_system::TTSStatus::FINISHED
+		|| done == voice_system::TTSStatus::COALESCED;
 
-	TextToWav(msg->data.c_str(), filename);
-
-	//msg_play.data = 1;
-	//ROS_INFO("%s pub 1", __func__);
-	//pub_play.publish(msg_play);
-	playWav();
-	sleep(1);
-	msg_play.data = 0;
-	ROS_INFO("%s pub 0", __func__);
-	pub_play.publish(msg_play);	
-#endif	
 	ROS_INFO("-%s", __func__);
 	return true;
 }
@@ -248,25 +517,44 @@ static bool ttsService(voice_system::TTSService::Request &req, voice_system::TTS
 int main(int argc, char* argv[])
 {
 	const char* start = "在线语音合成模块启动";
+	pthread_t worker;
+	int i;
 
 	ros::init(argc, argv, "xf_tts_node");
 
 	ros::NodeHandle n;
 
-	ros::ServiceServer tts_service = n.advertiseService("tts_service", ttsService);
-
 	TextToWav(start, filename);
 	playWav();
 
+	for (i = 0; i < TTS_PRIORITIES; i++)
+		lat_init(&lat_wait[i], i == 0 ? "tts queued->start chat"
+			: i == 1 ? "tts queued->start normal" : "tts queued->start urgent");
+
 	// set 1 if there is playing
 	pub_play = n.advertise<std_msgs::Int32>("/voice/xf_tts_playing", 50);
+	pub_status = n.advertise<voice_system::TTSStatus>("/voice/tts_status", 50);
+
+	if (pthread_create(&worker, NULL, tts_worker, NULL)) {
+		ROS_ERROR("no tts worker");
+		return -1;
+	}
+
+	ros::ServiceServer tts_service = n.advertiseService("tts_service", ttsService);
+
+	// prompts with an id and a priority, see TTSRequest.msg
+	ros::Subscriber sub_request = n.subscribe("/voice/tts_request", 50, requestCallback);
+	// drop prompts up to a priority (std_msgs/Int32)
+	ros::Subscriber sub_flush = n.subscribe("/voice/tts_flush", 10, flushCallback);
 
 	// get msg published by tuling/ASR, and play it back
 	ros::Subscriber sub = n.subscribe("/voice/xf_tts_topic", 50, ttsCallback);
 	// rostopic pub  /voice/xf_tts_topic std_msgs/String "start ..."
 
-	ros::spin();
+	// a service call waits on one thread, requests keep coming on the other
+	ros::AsyncSpinner spinner(2);
+	spinner.start();
+	ros::waitForShutdown();
 
 	return 0;
 }
-
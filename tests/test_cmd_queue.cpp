@@ -0,0 +1,111 @@
+/*
+@file
+@brief cmd_queue: the order, coalescing and marks the dispatcher sees
+	for bursts of manual codes, with the rules of xf_asr_node
+*/
+
+#include <gtest/gtest.h>
+#include "cmd_queue.h"
+
+#define MANUAL_RULES	"0:cancel,2:never,4:never,21:never,101-999:latest"
+
+class CmdQueue : public ::testing::Test {
+protected:
+	virtual void SetUp()
+	{
+		cmdq_init(&q);
+		ASSERT_EQ(5, cmdq_set_rules(&q, MANUAL_RULES));
+	}
+
+	int drain()
+	{
+		n = cmdq_drain(&q, out, CMDQ_DRAIN_MAX);
+		return n;
+	}
+
+	struct cmd_queue q;
+	struct cmdq_entry out[CMDQ_DRAIN_MAX];
+	int n;
+};
+
+TEST_F(CmdQueue, BadRulesKeepOld)
+{
+	EXPECT_EQ(-1, cmdq_set_rules(&q, "0:sometimes"));
+	EXPECT_EQ(-1, cmdq_set_rules(&q, "0-:keep"));
+	EXPECT_EQ(5, q.nrules);
+}
+
+TEST_F(CmdQueue, MovesCollapseToLast)
+{
+	cmdq_push(&q, 500, 1);
+	cmdq_push(&q, 300, 0);
+	cmdq_push(&q, 600, 1);
+	ASSERT_EQ(1, drain());
+	EXPECT_EQ(600, out[0].code);
+	EXPECT_EQ(1, out[0].mark);
+	EXPECT_EQ(2u, q.coalesced);
+}
+
+/* the fast lane published the move, then the stop: the move must not
+ * run after the stop, the stop keeps its mark */
+TEST_F(CmdQueue, StopCancelsMoveBeforeIt)
+{
+	cmdq_push(&q, 600, 1);
+	cmdq_push(&q, 0, 1);
+	ASSERT_EQ(1, drain());
+	EXPECT_EQ(0, out[0].code);
+	EXPECT_EQ(1, out[0].mark);
+	EXPECT_EQ(1u, q.cancelled);
+}
+
+TEST_F(CmdQueue, MoveAfterStopRuns)
+{
+	cmdq_push(&q, 500, 1);
+	cmdq_push(&q, 2, 0);
+	cmdq_push(&q, 601, 0);
+	cmdq_push(&q, 0, 1);
+	cmdq_push(&q, 300, 1);
+	ASSERT_EQ(3, drain());
+	EXPECT_EQ(2, out[0].code);
+	EXPECT_EQ(0, out[0].mark);
+	EXPECT_EQ(0, out[1].code);
+	EXPECT_EQ(1, out[1].mark);
+	EXPECT_EQ(300, out[2].code);
+	EXPECT_EQ(1, out[2].mark);
+}
+
+/* a drain in between: what ran before the stop is not taken back */
+TEST_F(CmdQueue, StopOnlyCancelsQueued)
+{
+	cmdq_push(&q, 600, 1);
+	ASSERT_EQ(1, drain());
+	cmdq_push(&q, 0, 0);
+	ASSERT_EQ(1, drain());
+	EXPECT_EQ(0, out[0].code);
+	EXPECT_EQ(0, out[0].mark);
+	EXPECT_EQ(0u, q.cancelled);
+}
+
+TEST_F(CmdQueue, FullQueueKeepsStop)
+{
+	int i;
+
+	for (i = 0; i < CMDQ_SIZE; i++)
+		cmdq_push(&q, i & 1 ? 500 : 5, 0);
+	EXPECT_EQ(-1, cmdq_push(&q, 600, 1));
+	EXPECT_EQ(0, cmdq_push(&q, 0, 1));
+	EXPECT_EQ(CMDQ_SIZE / 2 + 1, drain());
+	EXPECT_EQ(0, out[n - 1].code);
+	EXPECT_EQ(1, out[n - 1].mark);
+	for (i = 0; i < n - 1; i++)
+		EXPECT_EQ(5, out[i].code);
+	EXPECT_EQ(1u, q.dropped.load());
+}
+
+TEST_F(CmdQueue, WakeOncePerDrain)
+{
+	EXPECT_EQ(1, cmdq_push(&q, 500, 0));
+	EXPECT_EQ(0, cmdq_push(&q, 0, 0));
+	drain();
+	EXPECT_EQ(1, cmdq_push(&q, 500, 0));
+}
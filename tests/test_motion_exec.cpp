@@ -0,0 +1,107 @@
+/*
+@file
+@brief motion_exec: goals end, at rest, on the executor thread
+*/
+
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "motion_exec.h"
+
+#define TEST_RATE	100
+#define WAIT_MS		2000
+
+static double last_vx, last_wz;
+static unsigned int sent;
+
+static void record(double vx, double wz, void *)
+{
+	last_vx = vx;
+	last_wz = wz;
+	sent++;
+}
+
+class MotionExec : public ::testing::Test {
+protected:
+	virtual void SetUp()
+	{
+		last_vx = last_wz = -1;
+		sent = 0;
+		ASSERT_EQ(0, motion_init(&m, TEST_RATE, 0.5, 4.0, record, NULL));
+	}
+
+	virtual void TearDown()
+	{
+		motion_destroy(&m);
+	}
+
+	/* true once the goal is done within WAIT_MS */
+	bool ends()
+	{
+		int ms;
+
+		for (ms = 0; ms < WAIT_MS; ms += 10) {
+			if (!motion_active(&m))
+				return true;
+			usleep(10 * 1000);
+		}
+		return false;
+	}
+
+	void start(double vx, double wz, double duration_ms, double distance)
+	{
+		struct motion_goal g;
+
+		g.vx = vx;
+		g.wz = wz;
+		g.duration_ms = duration_ms;
+		g.distance = distance;
+		motion_start(&m, &g);
+	}
+
+	struct motion_exec m;
+};
+
+TEST_F(MotionExec, DistanceGoalEnds)
+{
+	start(0.3, 0, 0, 0.05);
+	EXPECT_TRUE(ends());
+	EXPECT_EQ(0, last_vx);
+	EXPECT_EQ(0, last_wz);
+}
+
+TEST_F(MotionExec, DurationGoalEnds)
+{
+	start(0, 1.0, 200, 0);
+	EXPECT_TRUE(ends());
+	EXPECT_EQ(0, last_wz);
+}
+
+/* a code without a twist gives zero velocities and a distance, which
+ * used to stream zero setpoints forever */
+TEST_F(MotionExec, ZeroGoalEnds)
+{
+	start(0, 0, 2000, 0.5);
+	EXPECT_TRUE(ends());
+	EXPECT_EQ(0, last_vx);
+	EXPECT_EQ(0, last_wz);
+	EXPECT_LT(sent, 5u);
+}
+
+TEST_F(MotionExec, ZeroGoalRampsDownRunningOne)
+{
+	start(0.3, 0, 0, 1.0);
+	usleep(300 * 1000);
+	ASSERT_TRUE(motion_active(&m));
+	start(0, 0, 0, 0.5);
+	EXPECT_TRUE(ends());
+	EXPECT_EQ(0, last_vx);
+}
+
+TEST_F(MotionExec, StopEndsAtOnce)
+{
+	start(0.3, 0, 0, 1.0);
+	usleep(100 * 1000);
+	motion_stop(&m);
+	EXPECT_FALSE(motion_active(&m));
+	EXPECT_EQ(0, last_vx);
+}